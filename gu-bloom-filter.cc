@@ -0,0 +1,137 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-bloom-filter.h"
+#include <algorithm>
+#include <math.h>
+
+#define BLOOM_MAX_HASHES 16
+
+static uint32_t
+GetBitCount (uint32_t expectedCount, double falsePositiveRate)
+{
+  // m = -n ln p / (ln 2)^2
+  double bits = -(double) std::max (expectedCount, (uint32_t) 1) * log (falsePositiveRate) / (M_LN2 * M_LN2);
+  return std::max ((uint32_t) ceil (bits), (uint32_t) 8);
+}
+
+GUBloomFilter::GUBloomFilter ()
+  : m_hashCount (0)
+{
+}
+
+uint32_t
+GUBloomFilter::GetSizeFor (uint32_t expectedCount, double falsePositiveRate)
+{
+  return (GetBitCount (expectedCount, falsePositiveRate) + 7) / 8;
+}
+
+void
+GUBloomFilter::Init (uint32_t expectedCount, double falsePositiveRate)
+{
+  uint32_t bytes = GetSizeFor (expectedCount, falsePositiveRate);
+  // k = m / n ln 2
+  double hashes = (double) bytes * 8 / std::max (expectedCount, (uint32_t) 1) * M_LN2;
+  m_hashCount = (uint8_t) std::min (std::max ((uint32_t) floor (hashes + 0.5), (uint32_t) 1), (uint32_t) BLOOM_MAX_HASHES);
+  m_bits.assign (bytes, '\0');
+}
+
+void
+GUBloomFilter::Assign (uint8_t hashCount, std::string &bits)
+{
+  m_hashCount = hashCount;
+  m_bits.swap (bits);
+  bits.clear ();
+}
+
+void
+GUBloomFilter::Hash (const char *data, uint32_t length, uint64_t &h1, uint64_t &h2) const
+{
+  // FNV-1a, then a mixing step for the second, odd, stride
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint32_t i = 0; i < length; i++)
+    {
+      hash ^= (uint8_t) data[i];
+      hash *= 1099511628211ULL;
+    }
+  h1 = hash;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  h2 = hash | 1;
+}
+
+void
+GUBloomFilter::Add (const char *data, uint32_t length)
+{
+  uint64_t bitCount = (uint64_t) m_bits.size () * 8;
+  if (bitCount == 0)
+    {
+      return;
+    }
+  uint64_t h1, h2;
+  Hash (data, length, h1, h2);
+  for (uint32_t i = 0; i < m_hashCount; i++)
+    {
+      uint64_t bit = (h1 + i * h2) % bitCount;
+      m_bits[bit / 8] |= (char) (1 << (bit % 8));
+    }
+}
+
+void
+GUBloomFilter::Add (const std::string &name)
+{
+  Add (name.data (), name.size ());
+}
+
+bool
+GUBloomFilter::MayContain (const char *data, uint32_t length) const
+{
+  uint64_t bitCount = (uint64_t) m_bits.size () * 8;
+  if (bitCount == 0)
+    {
+      return false;
+    }
+  uint64_t h1, h2;
+  Hash (data, length, h1, h2);
+  for (uint32_t i = 0; i < m_hashCount; i++)
+    {
+      uint64_t bit = (h1 + i * h2) % bitCount;
+      if ((m_bits[bit / 8] & (1 << (bit % 8))) == 0)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+bool
+GUBloomFilter::MayContain (const std::string &name) const
+{
+  return MayContain (name.data (), name.size ());
+}
+
+uint8_t
+GUBloomFilter::GetHashCount () const
+{
+  return m_hashCount;
+}
+
+std::string&
+GUBloomFilter::GetBits ()
+{
+  return m_bits;
+}
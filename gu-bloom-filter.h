@@ -0,0 +1,68 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_BLOOM_FILTER_H
+#define GU_BLOOM_FILTER_H
+
+#include <stdint.h>
+#include <string>
+
+/**
+ *  Bloom filter over document names, compact enough to stand in for a
+ *  candidate list on the wire. Names are hashed rather than ids because
+ *  ids are local to each node.
+ *
+ *  The bits live in a std::string so they can be swapped in and out of a
+ *  message Blob field without copying.
+ */
+class GUBloomFilter
+{
+  public:
+    GUBloomFilter ();
+
+    /**
+     *  \brief Clears the filter and sizes it for expectedCount names at
+     *  the given false-positive rate
+     */
+    void Init (uint32_t expectedCount, double falsePositiveRate);
+
+    /**
+     *  \brief Takes over a filter received on the wire
+     *  \param bits swapped into the filter; left empty
+     */
+    void Assign (uint8_t hashCount, std::string &bits);
+
+    void Add (const char *data, uint32_t length);
+    void Add (const std::string &name);
+    bool MayContain (const char *data, uint32_t length) const;
+    bool MayContain (const std::string &name) const;
+
+    uint8_t GetHashCount () const;
+    std::string& GetBits ();
+
+    /**
+     *  \returns bytes of bits Init would allocate for these parameters
+     */
+    static uint32_t GetSizeFor (uint32_t expectedCount, double falsePositiveRate);
+
+  private:
+    void Hash (const char *data, uint32_t length, uint64_t &h1, uint64_t &h2) const;
+
+    uint8_t m_hashCount;
+    std::string m_bits;
+};
+
+#endif
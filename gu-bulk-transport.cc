@@ -0,0 +1,359 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-bulk-transport.h"
+#include "ns3/simulator.h"
+#include "ns3/random-variable.h"
+#include "ns3/log.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("GUBulkTransport");
+
+#define BULK_INITIAL_CWND 2
+#define BULK_INITIAL_SSTHRESH 64
+#define BULK_INITIAL_RTO_MS 1000
+#define BULK_MIN_RTO_MS 200
+#define BULK_MAX_RTO_MS 60000
+#define BULK_MAX_TIMEOUTS 8             //consecutive timeouts before a flow is abandoned
+#define BULK_DUP_THRESHOLD 3            //later sequences acked before a gap counts as lost
+#define BULK_MAX_SACKS 32
+#define BULK_MAX_RETIRED_FLOWS 8        //superseded flow ids remembered per sender
+
+GUBulkTransport::GUBulkTransport ()
+{
+}
+
+GUBulkTransport::~GUBulkTransport ()
+{
+  Cancel ();
+}
+
+void
+GUBulkTransport::SetSendDataCallback (SendDataCallback sendData)
+{
+  m_sendData = sendData;
+}
+
+void
+GUBulkTransport::SetSendAckCallback (SendAckCallback sendAck)
+{
+  m_sendAck = sendAck;
+}
+
+void
+GUBulkTransport::SetFailureCallback (FailureCallback failure)
+{
+  m_failure = failure;
+}
+
+void
+GUBulkTransport::Cancel ()
+{
+  for (std::map<Ipv4Address, OutboundFlow>::iterator iter = m_outbound.begin (); iter != m_outbound.end (); iter++)
+    {
+      iter->second.retransmitEvent.Cancel ();
+    }
+  m_outbound.clear ();
+  m_inbound.clear ();
+}
+
+GUBulkTransport::OutboundFlow&
+GUBulkTransport::GetOutboundFlow (Ipv4Address destAddress)
+{
+  std::map<Ipv4Address, OutboundFlow>::iterator iter = m_outbound.find (destAddress);
+  if (iter == m_outbound.end ())
+    {
+      UniformVariable random;
+      OutboundFlow flow;
+      // a fresh id lets the receiver tell a restarted sender from a late packet
+      flow.flowId = random.GetInteger (1, 0xFFFFFFFE);
+      flow.nextSequence = 0;
+      flow.cwnd = BULK_INITIAL_CWND;
+      flow.ssthresh = BULK_INITIAL_SSTHRESH;
+      flow.hasRtt = false;
+      flow.srtt = 0;
+      flow.rttVar = 0;
+      flow.rto = MilliSeconds (BULK_INITIAL_RTO_MS);
+      flow.recoverySequence = 0;
+      flow.timeouts = 0;
+      flow.lostCount = 0;
+      iter = m_outbound.insert (std::make_pair (destAddress, flow)).first;
+    }
+  return iter->second;
+}
+
+void
+GUBulkTransport::Send (Ipv4Address destAddress, Ptr<Packet> message)
+{
+  OutboundFlow &flow = GetOutboundFlow (destAddress);
+  flow.pending.push_back (message);
+  TrySend (destAddress, flow);
+}
+
+void
+GUBulkTransport::TrySend (Ipv4Address destAddress, OutboundFlow &flow)
+{
+  bool wasIdle = flow.inFlight.empty ();
+  uint32_t window = (uint32_t) floor (flow.cwnd);
+
+  // Segments a timeout gave up on go first, oldest first, as the window reopens
+  std::map<uint32_t, Segment>::iterator segment;
+  for (segment = flow.inFlight.begin (); segment != flow.inFlight.end () && flow.lostCount > 0; segment++)
+    {
+      if (flow.inFlight.size () - flow.lostCount >= window)
+        {
+          break;
+        }
+      if (segment->second.lost)
+        {
+          segment->second.lost = false;
+          flow.lostCount--;
+          Transmit (destAddress, flow, segment->first, segment->second);
+        }
+    }
+
+  while (!flow.pending.empty () && flow.inFlight.size () - flow.lostCount < window)
+    {
+      uint32_t sequence = flow.nextSequence++;
+      Segment &fresh = flow.inFlight[sequence];
+      fresh.message = flow.pending.front ();
+      fresh.retransmitted = false;
+      fresh.lost = false;
+      flow.pending.pop_front ();
+      Transmit (destAddress, flow, sequence, fresh);
+    }
+  if (wasIdle)
+    {
+      ArmRetransmitTimer (destAddress, flow);
+    }
+}
+
+void
+GUBulkTransport::Transmit (Ipv4Address destAddress, OutboundFlow &flow, uint32_t sequence, Segment &segment)
+{
+  segment.sentAt = Simulator::Now ();
+  m_sendData (destAddress, flow.flowId, sequence, segment.message);
+}
+
+void
+GUBulkTransport::UpdateRtt (OutboundFlow &flow, Time sample)
+{
+  // RFC 6298 estimator
+  double r = sample.GetSeconds ();
+  if (!flow.hasRtt)
+    {
+      flow.srtt = r;
+      flow.rttVar = r / 2;
+      flow.hasRtt = true;
+    }
+  else
+    {
+      flow.rttVar = 0.75 * flow.rttVar + 0.25 * fabs (flow.srtt - r);
+      flow.srtt = 0.875 * flow.srtt + 0.125 * r;
+    }
+  ResetRto (flow);
+}
+
+void
+GUBulkTransport::ResetRto (OutboundFlow &flow)
+{
+  if (!flow.hasRtt)
+    {
+      flow.rto = MilliSeconds (BULK_INITIAL_RTO_MS);
+      return;
+    }
+  double rtoMs = (flow.srtt + 4 * flow.rttVar) * 1000;
+  rtoMs = std::max (rtoMs, (double) BULK_MIN_RTO_MS);
+  rtoMs = std::min (rtoMs, (double) BULK_MAX_RTO_MS);
+  flow.rto = MilliSeconds ((uint64_t) rtoMs);
+}
+
+void
+GUBulkTransport::ArmRetransmitTimer (Ipv4Address destAddress, OutboundFlow &flow)
+{
+  flow.retransmitEvent.Cancel ();
+  if (!flow.inFlight.empty ())
+    {
+      flow.retransmitEvent = Simulator::Schedule (flow.rto, &GUBulkTransport::RetransmitTimeout, this, destAddress);
+    }
+}
+
+void
+GUBulkTransport::RetransmitTimeout (Ipv4Address destAddress)
+{
+  std::map<Ipv4Address, OutboundFlow>::iterator iter = m_outbound.find (destAddress);
+  if (iter == m_outbound.end () || iter->second.inFlight.empty ())
+    {
+      return;
+    }
+  OutboundFlow &flow = iter->second;
+  if (++flow.timeouts > BULK_MAX_TIMEOUTS)
+    {
+      NS_LOG_DEBUG ("Abandoning bulk flow to " << destAddress << " with " << flow.inFlight.size () + flow.pending.size () << " messages undelivered");
+      std::vector<Ptr<Packet> > undelivered;
+      for (std::map<uint32_t, Segment>::iterator segment = flow.inFlight.begin (); segment != flow.inFlight.end (); segment++)
+        {
+          undelivered.push_back (segment->second.message);
+        }
+      undelivered.insert (undelivered.end (), flow.pending.begin (), flow.pending.end ());
+      m_outbound.erase (iter);
+      if (!m_failure.IsNull ())
+        {
+          m_failure (destAddress, undelivered);
+        }
+      return;
+    }
+
+  // Everything in flight may be gone: restart from a window of one
+  flow.ssthresh = std::max (flow.inFlight.size () / 2.0, 2.0);
+  flow.cwnd = 1;
+  flow.recoverySequence = flow.nextSequence;
+  flow.rto = MilliSeconds (std::min ((uint64_t) flow.rto.GetMilliSeconds () * 2, (uint64_t) BULK_MAX_RTO_MS));
+
+  // Nothing sent before the timeout can be counted on: resend all of it as the window allows
+  for (std::map<uint32_t, Segment>::iterator segment = flow.inFlight.begin (); segment != flow.inFlight.end (); segment++)
+    {
+      segment->second.retransmitted = true;
+      segment->second.lost = true;
+    }
+  flow.lostCount = flow.inFlight.size ();
+  TrySend (destAddress, flow);
+  ArmRetransmitTimer (destAddress, flow);
+}
+
+void
+GUBulkTransport::ReceiveAck (Ipv4Address sourceAddress, uint32_t flowId, uint32_t cumulativeAck, const std::vector<uint32_t> &sackedSequences)
+{
+  std::map<Ipv4Address, OutboundFlow>::iterator iter = m_outbound.find (sourceAddress);
+  if (iter == m_outbound.end () || iter->second.flowId != flowId)
+    {
+      return;
+    }
+  OutboundFlow &flow = iter->second;
+
+  std::vector<uint32_t> sacked (sackedSequences);
+  std::sort (sacked.begin (), sacked.end ());
+
+  // Release everything the receiver holds, sampling RTT from first transmissions
+  uint32_t acked = 0;
+  std::map<uint32_t, Segment>::iterator segment;
+  for (segment = flow.inFlight.begin (); segment != flow.inFlight.end ();)
+    {
+      bool isAcked = segment->first < cumulativeAck
+        || std::binary_search (sacked.begin (), sacked.end (), segment->first);
+      if (!isAcked)
+        {
+          ++segment;
+          continue;
+        }
+      if (!segment->second.retransmitted)
+        {
+          UpdateRtt (flow, Simulator::Now () - segment->second.sentAt);
+        }
+      if (segment->second.lost)
+        {
+          flow.lostCount--;
+        }
+      flow.inFlight.erase (segment++);
+      acked++;
+    }
+
+  if (acked > 0)
+    {
+      // progress ends the backoff even when every acked segment was a retransmission
+      flow.timeouts = 0;
+      ResetRto (flow);
+      for (uint32_t i = 0; i < acked; i++)
+        {
+          // slow start below ssthresh, then roughly one message per window
+          flow.cwnd += flow.cwnd < flow.ssthresh ? 1 : 1 / flow.cwnd;
+        }
+      ArmRetransmitTimer (sourceAddress, flow);
+    }
+
+  // A gap with enough later sequences acked is a loss: resend it now
+  for (segment = flow.inFlight.begin (); segment != flow.inFlight.end (); segment++)
+    {
+      uint32_t laterAcked = sacked.end () - std::upper_bound (sacked.begin (), sacked.end (), segment->first);
+      if (laterAcked < BULK_DUP_THRESHOLD || segment->second.retransmitted || segment->second.lost)
+        {
+          continue;
+        }
+      if (segment->first >= flow.recoverySequence)
+        {
+          flow.ssthresh = std::max (flow.cwnd / 2, 2.0);
+          flow.cwnd = flow.ssthresh;
+          flow.recoverySequence = flow.nextSequence;
+        }
+      segment->second.retransmitted = true;
+      Transmit (sourceAddress, flow, segment->first, segment->second);
+    }
+
+  TrySend (sourceAddress, flow);
+}
+
+bool
+GUBulkTransport::ReceiveData (Ipv4Address sourceAddress, uint32_t flowId, uint32_t sequence)
+{
+  std::map<Ipv4Address, InboundFlow>::iterator iter = m_inbound.find (sourceAddress);
+  if (iter == m_inbound.end ())
+    {
+      InboundFlow fresh;
+      fresh.flowId = flowId;
+      fresh.cumulativeAck = 0;
+      iter = m_inbound.insert (std::make_pair (sourceAddress, fresh)).first;
+    }
+  InboundFlow &flow = iter->second;
+  if (flow.flowId != flowId)
+    {
+      // A late packet from a flow the sender gave up on must not reset the current one
+      if (std::find (flow.retired.begin (), flow.retired.end (), flowId) != flow.retired.end ())
+        {
+          return false;
+        }
+      flow.retired.push_back (flow.flowId);
+      if (flow.retired.size () > BULK_MAX_RETIRED_FLOWS)
+        {
+          flow.retired.pop_front ();
+        }
+      flow.flowId = flowId;
+      flow.cumulativeAck = 0;
+      flow.received.clear ();
+    }
+
+  bool isNew = sequence >= flow.cumulativeAck && flow.received.find (sequence) == flow.received.end ();
+  if (isNew)
+    {
+      flow.received.insert (sequence);
+      while (!flow.received.empty () && *flow.received.begin () == flow.cumulativeAck)
+        {
+          flow.received.erase (flow.received.begin ());
+          flow.cumulativeAck++;
+        }
+    }
+
+  // Acknowledge duplicates too: the earlier ack may be what was lost
+  std::vector<uint32_t> sacked;
+  for (std::set<uint32_t>::iterator it = flow.received.begin (); it != flow.received.end () && sacked.size () < BULK_MAX_SACKS; it++)
+    {
+      sacked.push_back (*it);
+    }
+  m_sendAck (sourceAddress, flowId, flow.cumulativeAck, sacked);
+  return isNew;
+}
@@ -0,0 +1,127 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_BULK_TRANSPORT_H
+#define GU_BULK_TRANSPORT_H
+
+#include "ns3/packet.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/callback.h"
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ *  Reliable delivery for bulk flows over an unreliable datagram socket.
+ *  Each destination gets one flow with a sliding window of numbered
+ *  messages, selective acknowledgements, slow start / congestion
+ *  avoidance and an RTT-based retransmit timeout.
+ *
+ *  The transport does not touch the wire itself: the owner frames data
+ *  and acks in its own message format through the two send callbacks and
+ *  feeds received data and acks back in. Messages may be delivered out of
+ *  order but never twice. A flow that makes no progress is abandoned and
+ *  its undelivered messages are handed back through the failure callback.
+ */
+class GUBulkTransport
+{
+  public:
+    // (destAddress, flowId, sequence, message)
+    typedef Callback<void, Ipv4Address, uint32_t, uint32_t, Ptr<Packet> > SendDataCallback;
+    // (destAddress, flowId, cumulativeAck, sackedSequences)
+    typedef Callback<void, Ipv4Address, uint32_t, uint32_t, std::vector<uint32_t> > SendAckCallback;
+    // (destAddress, undelivered messages, oldest first); some may have arrived unacknowledged
+    typedef Callback<void, Ipv4Address, std::vector<Ptr<Packet> > > FailureCallback;
+
+    GUBulkTransport ();
+    ~GUBulkTransport ();
+
+    void SetSendDataCallback (SendDataCallback sendData);
+    void SetSendAckCallback (SendAckCallback sendAck);
+    void SetFailureCallback (FailureCallback failure);
+
+    /**
+     *  \brief Queues a serialized message for reliable delivery to destAddress
+     */
+    void Send (Ipv4Address destAddress, Ptr<Packet> message);
+
+    /**
+     *  \brief Records a received data message and acknowledges it
+     *  \returns true if the message is new and should be delivered
+     */
+    bool ReceiveData (Ipv4Address sourceAddress, uint32_t flowId, uint32_t sequence);
+
+    void ReceiveAck (Ipv4Address sourceAddress, uint32_t flowId, uint32_t cumulativeAck, const std::vector<uint32_t> &sackedSequences);
+
+    /**
+     *  \brief Drops all flow state and cancels retransmissions
+     */
+    void Cancel ();
+
+  private:
+    struct Segment
+      {
+        Ptr<Packet> message;
+        Time sentAt;
+        bool retransmitted;             //no RTT sample from retransmitted segments
+        bool lost;                      //presumed lost by a timeout, waiting for window to resend
+      };
+    struct OutboundFlow
+      {
+        uint32_t flowId;
+        uint32_t nextSequence;
+        std::map<uint32_t, Segment> inFlight;
+        std::deque<Ptr<Packet> > pending;
+        double cwnd;                    //congestion window, in messages
+        double ssthresh;
+        bool hasRtt;
+        double srtt;                    //smoothed RTT, in seconds
+        double rttVar;
+        Time rto;
+        uint32_t recoverySequence;      //window cut at most once per window of data
+        uint32_t timeouts;              //consecutive timeouts without progress
+        uint32_t lostCount;             //segments in inFlight marked lost
+        EventId retransmitEvent;
+      };
+    struct InboundFlow
+      {
+        uint32_t flowId;
+        uint32_t cumulativeAck;         //every sequence below this was received
+        std::set<uint32_t> received;    //received above cumulativeAck
+        std::deque<uint32_t> retired;   //earlier flow ids from this sender, newest last
+      };
+
+    OutboundFlow& GetOutboundFlow (Ipv4Address destAddress);
+    void TrySend (Ipv4Address destAddress, OutboundFlow &flow);
+    void Transmit (Ipv4Address destAddress, OutboundFlow &flow, uint32_t sequence, Segment &segment);
+    void UpdateRtt (OutboundFlow &flow, Time sample);
+    void ResetRto (OutboundFlow &flow);
+    void ArmRetransmitTimer (Ipv4Address destAddress, OutboundFlow &flow);
+    void RetransmitTimeout (Ipv4Address destAddress);
+
+    SendDataCallback m_sendData;
+    SendAckCallback m_sendAck;
+    FailureCallback m_failure;
+    std::map<Ipv4Address, OutboundFlow> m_outbound;
+    std::map<Ipv4Address, InboundFlow> m_inbound;
+};
+
+#endif
@@ -24,6 +24,9 @@ NS_LOG_COMPONENT_DEFINE ("GUChordMessage");
 NS_OBJECT_ENSURE_REGISTERED (GUChordMessage);
 
 GUChordMessage::GUChordMessage ()
+  : m_messageType ((MessageType) 0),
+    m_wireVersion (WIRE_VERSION_1),
+    m_routeOnly (false)
 {
 }
 
@@ -35,6 +38,8 @@ GUChordMessage::GUChordMessage (GUChordMessage::MessageType messageType, uint32_
 {
   m_messageType = messageType;
   m_transactionId = transactionId;
+  m_wireVersion = WIRE_VERSION_1;
+  m_routeOnly = false;
 }
 
 TypeId 
@@ -53,50 +58,34 @@ GUChordMessage::GetInstanceTypeId (void) const
   return GetTypeId ();
 }
 
-
 uint32_t
 GUChordMessage::GetSerializedSize (void) const
 {
-  // size of messageType, transaction id
-  uint32_t size = sizeof (uint8_t) + sizeof (uint32_t);
+  // size of messageType, transaction id, sender domain
+  uint32_t size = sizeof (uint8_t) + sizeof (uint32_t) + sizeof (uint8_t) + m_senderDomain.length ();
+  if (m_routeOnly)
+    {
+      switch (m_messageType)
+        {
+#define GU_CHORD_ROUTE_SIZE_CASE(type, Payload) \
+          case type: \
+            size += m_payload.Get<Payload> ().GetRouteSerializedSize (m_wireVersion); \
+            break;
+          GU_CHORD_RELAYED_PAYLOADS (GU_CHORD_ROUTE_SIZE_CASE)
+#undef GU_CHORD_ROUTE_SIZE_CASE
+          default:
+            break;
+        }
+      return size;
+    }
   switch (m_messageType)
     {
-      case PING_REQ:
-        size += m_message.pingReq.GetSerializedSize ();
-        break;
-      case PING_RSP:
-        size += m_message.pingRsp.GetSerializedSize ();
-        break;
-      case CHORD_JOIN:
-        size += m_message.joinMessage.GetSerializedSize ();
-        break;
-      case CHORD_JOIN_RSP:
-        size += m_message.joinResponse.GetSerializedSize ();
-        break;
-      case RING_STATE:
-        size += m_message.rs.GetSerializedSize ();
-        break;
-      case STABLE_REQ:
-        size += m_message.stableMessage.GetSerializedSize ();
-        break;
-      case STABLE_RSP:
-        size += m_message.stableResponse.GetSerializedSize ();
-        break;
-      case SET_PRED:
-        size += m_message.setPredMessage.GetSerializedSize ();
-        break;
-      case NOTIFY:
-        size += m_message.notifyMessage.GetSerializedSize ();
-        break;
-      case CHORD_LEAVE:
-        size += m_message.leaveMessage.GetSerializedSize ();
-        break;
-      case FINGERME_REQ:
-        size += m_message.fingerReq.GetSerializedSize ();
-        break;
-      case FINGERME_RSP:
-        size += m_message.fingerRsp.GetSerializedSize ();
+#define GU_CHORD_SIZE_CASE(type, Payload) \
+      case type: \
+        size += m_payload.Get<Payload> ().GetSerializedSize (m_wireVersion); \
         break;
+      GU_CHORD_PAYLOADS (GU_CHORD_SIZE_CASE)
+#undef GU_CHORD_SIZE_CASE
       default:
         NS_ASSERT (false);
     }
@@ -109,48 +98,20 @@ GUChordMessage::Print (std::ostream &os) const
   os << "\n****GUChordMessage Dump****\n" ;
   os << "messageType: " << m_messageType << "\n";
   os << "transactionId: " << m_transactionId << "\n";
+  os << "wireVersion: " << (uint32_t) m_wireVersion << "\n";
+  os << "senderDomain: " << m_senderDomain << "\n";
   os << "PAYLOAD:: \n";
   
   switch (m_messageType)
     {
-      case PING_REQ:
-        m_message.pingReq.Print (os);
-        break;
-      case PING_RSP:
-        m_message.pingRsp.Print (os);
-        break;
-      case CHORD_JOIN:
-        m_message.joinMessage.Print (os);
-        break;
-      case CHORD_JOIN_RSP:
-        m_message.joinResponse.Print (os);
-        break;
-      case RING_STATE:
-        m_message.rs.Print (os);
-        break;
-      case STABLE_REQ:
-        m_message.stableMessage.Print (os);
-        break;
-      case STABLE_RSP:
-        m_message.stableResponse.Print (os);
-        break;
-      case SET_PRED:
-        m_message.setPredMessage.Print (os);
-        break;
-      case NOTIFY:
-        m_message.notifyMessage.Print (os);
-        break;
-      case CHORD_LEAVE:
-        m_message.leaveMessage.Print (os);
-        break;
-      case FINGERME_REQ:
-        m_message.fingerReq.Print (os);
-        break;
-      case FINGERME_RSP:
-        m_message.fingerRsp.Print (os);
+#define GU_CHORD_PRINT_CASE(type, Payload) \
+      case type: \
+        m_payload.Get<Payload> ().Print (os); \
         break;
+      GU_CHORD_PAYLOADS (GU_CHORD_PRINT_CASE)
+#undef GU_CHORD_PRINT_CASE
       default:
-        break;  
+        break;
     }
   os << "\n****END OF MESSAGE****\n";
 }
@@ -159,49 +120,37 @@ void
 GUChordMessage::Serialize (Buffer::Iterator start) const
 {
   Buffer::Iterator i = start;
-  i.WriteU8 (m_messageType);
+  // message types fit in the low 6 bits; the top 2 carry the wire version
+  i.WriteU8 (m_messageType | ((m_wireVersion - 1) << 6));
   i.WriteHtonU32 (m_transactionId);
+  i.WriteU8 (m_senderDomain.length ());
+  i.Write ((uint8_t *) (const_cast<char*> (m_senderDomain.c_str())), m_senderDomain.length());
 
+  if (m_routeOnly)
+    {
+      switch (m_messageType)
+        {
+#define GU_CHORD_ROUTE_SERIALIZE_CASE(type, Payload) \
+          case type: \
+            m_payload.Get<Payload> ().SerializeRoute (i, m_wireVersion); \
+            break;
+          GU_CHORD_RELAYED_PAYLOADS (GU_CHORD_ROUTE_SERIALIZE_CASE)
+#undef GU_CHORD_ROUTE_SERIALIZE_CASE
+          default:
+            break;
+        }
+      return;
+    }
   switch (m_messageType)
     {
-      case PING_REQ:
-        m_message.pingReq.Serialize (i);
-        break;
-      case PING_RSP:
-        m_message.pingRsp.Serialize (i);
-        break;
-      case CHORD_JOIN:
-        m_message.joinMessage.Serialize (i);
-        break;
-      case CHORD_JOIN_RSP:
-        m_message.joinResponse.Serialize (i);
-        break;
-      case RING_STATE:
-        m_message.rs.Serialize (i);
-        break;
-      case STABLE_REQ:
-        m_message.stableMessage.Serialize (i);
-        break;
-      case STABLE_RSP:
-        m_message.stableResponse.Serialize (i);
-        break;
-      case SET_PRED:
-        m_message.setPredMessage.Serialize (i);
-        break;
-      case NOTIFY:
-        m_message.notifyMessage.Serialize (i);
-        break;
-      case CHORD_LEAVE:
-        m_message.leaveMessage.Serialize (i);
-        break;
-      case FINGERME_REQ:
-        m_message.fingerReq.Serialize (i);
-        break;
-      case FINGERME_RSP:
-        m_message.fingerRsp.Serialize (i);
+#define GU_CHORD_SERIALIZE_CASE(type, Payload) \
+      case type: \
+        m_payload.Get<Payload> ().Serialize (i, m_wireVersion); \
         break;
+      GU_CHORD_PAYLOADS (GU_CHORD_SERIALIZE_CASE)
+#undef GU_CHORD_SERIALIZE_CASE
       default:
-        NS_ASSERT (false);   
+        NS_ASSERT (false);
     }
 }
 
@@ -210,49 +159,42 @@ GUChordMessage::Deserialize (Buffer::Iterator start)
 {
   uint32_t size;
   Buffer::Iterator i = start;
-  m_messageType = (MessageType) i.ReadU8 ();
+  uint8_t typeByte = i.ReadU8 ();
+  m_wireVersion = (typeByte >> 6) + 1;
+  m_messageType = (MessageType) (typeByte & 0x3f);
   m_transactionId = i.ReadNtohU32 ();
 
-  size = sizeof (uint8_t) + sizeof (uint32_t);
+  uint8_t domainLength = i.ReadU8 ();
+  char domain[MAX_DOMAIN_LENGTH];
+  i.Read ((uint8_t*)domain, domainLength);
+  m_senderDomain = std::string (domain, domainLength);
 
+  size = sizeof (uint8_t) + sizeof (uint32_t) + sizeof (uint8_t) + domainLength;
+
+  if (m_routeOnly)
+    {
+      switch (m_messageType)
+        {
+#define GU_CHORD_ROUTE_DESERIALIZE_CASE(type, Payload) \
+          case type: \
+            size += m_payload.Reset<Payload> ().DeserializeRoute (i, m_wireVersion); \
+            break;
+          GU_CHORD_RELAYED_PAYLOADS (GU_CHORD_ROUTE_DESERIALIZE_CASE)
+#undef GU_CHORD_ROUTE_DESERIALIZE_CASE
+          default:
+            m_payload.Clear ();
+            break;
+        }
+      return size;
+    }
   switch (m_messageType)
     {
-      case PING_REQ:
-        size += m_message.pingReq.Deserialize (i);
-        break;
-      case PING_RSP:
-        size += m_message.pingRsp.Deserialize (i);
-        break;
-      case CHORD_JOIN:
-        size += m_message.joinMessage.Deserialize (i);
-        break;
-      case CHORD_JOIN_RSP:
-        size += m_message.joinResponse.Deserialize (i);
-        break;
-      case RING_STATE:
-        size += m_message.rs.Deserialize (i);
-        break;
-      case STABLE_REQ:
-        size += m_message.stableMessage.Deserialize (i);
-        break;
-      case STABLE_RSP:
-        size += m_message.stableResponse.Deserialize (i);
-        break;
-      case SET_PRED:
-        size += m_message.setPredMessage.Deserialize (i);
-        break;
-      case NOTIFY:
-        size += m_message.notifyMessage.Deserialize (i);
-        break;
-      case CHORD_LEAVE:
-        size += m_message.leaveMessage.Deserialize (i);
-        break;
-      case FINGERME_REQ:
-        size += m_message.fingerReq.Deserialize (i);
-        break;
-      case FINGERME_RSP:
-        size += m_message.fingerRsp.Deserialize (i);
+#define GU_CHORD_DESERIALIZE_CASE(type, Payload) \
+      case type: \
+        size += m_payload.Reset<Payload> ().Deserialize (i, m_wireVersion); \
         break;
+      GU_CHORD_PAYLOADS (GU_CHORD_DESERIALIZE_CASE)
+#undef GU_CHORD_DESERIALIZE_CASE
       default:
         NS_ASSERT (false);
     }
@@ -261,38 +203,12 @@ GUChordMessage::Deserialize (Buffer::Iterator start)
 
 /* PING_REQ */
 
-uint32_t 
-GUChordMessage::PingReq::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t) + pingMessage.length();
-  return size;
-}
-
 void
 GUChordMessage::PingReq::Print (std::ostream &os) const
 {
   os << "PingReq:: Message: " << pingMessage << "\n";
 }
 
-void
-GUChordMessage::PingReq::Serialize (Buffer::Iterator &start) const
-{
-  start.WriteU16 (pingMessage.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (pingMessage.c_str())), pingMessage.length());
-}
-
-uint32_t
-GUChordMessage::PingReq::Deserialize (Buffer::Iterator &start)
-{  
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  pingMessage = std::string (str, length);
-  free (str);
-  return PingReq::GetSerializedSize ();
-}
-
 void
 GUChordMessage::SetPingReq (std::string pingMessage)
 {
@@ -304,49 +220,24 @@ GUChordMessage::SetPingReq (std::string pingMessage)
     {
       NS_ASSERT (m_messageType == PING_REQ);
     }
-  m_message.pingReq.pingMessage = pingMessage;
+  PingReq &payload = m_payload.GetOrCreate<PingReq> ();
+  payload.pingMessage.swap (pingMessage);
 }
 
-GUChordMessage::PingReq
-GUChordMessage::GetPingReq ()
+const GUChordMessage::PingReq&
+GUChordMessage::GetPingReq () const
 {
-  return m_message.pingReq;
+  return m_payload.Get<PingReq> ();
 }
 
 /* PING_RSP */
 
-uint32_t 
-GUChordMessage::PingRsp::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t) + pingMessage.length();
-  return size;
-}
-
 void
 GUChordMessage::PingRsp::Print (std::ostream &os) const
 {
   os << "PingReq:: Message: " << pingMessage << "\n";
 }
 
-void
-GUChordMessage::PingRsp::Serialize (Buffer::Iterator &start) const
-{
-  start.WriteU16 (pingMessage.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (pingMessage.c_str())), pingMessage.length());
-}
-
-uint32_t
-GUChordMessage::PingRsp::Deserialize (Buffer::Iterator &start)
-{  
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  pingMessage = std::string (str, length);
-  free (str);
-  return PingRsp::GetSerializedSize ();
-}
-
 void
 GUChordMessage::SetPingRsp (std::string pingMessage)
 {
@@ -358,13 +249,14 @@ GUChordMessage::SetPingRsp (std::string pingMessage)
     {
       NS_ASSERT (m_messageType == PING_RSP);
     }
-  m_message.pingRsp.pingMessage = pingMessage;
+  PingRsp &payload = m_payload.GetOrCreate<PingRsp> ();
+  payload.pingMessage.swap (pingMessage);
 }
 
-GUChordMessage::PingRsp
-GUChordMessage::GetPingRsp ()
+const GUChordMessage::PingRsp&
+GUChordMessage::GetPingRsp () const
 {
-  return m_message.pingRsp;
+  return m_payload.Get<PingRsp> ();
 }
 
 
@@ -374,58 +266,13 @@ GUChordMessage::GetPingRsp ()
 
 /******                 CHORD JOIN METHODS                      ********/
 
-
-uint32_t
-GUChordMessage::ChordJoin::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = (2*IPV4_ADDRESS_SIZE) + sizeof(uint16_t) + requesterID.length() + landmarkID.length();
-  return 10*size;
-}
 void
 GUChordMessage::ChordJoin::Print (std::ostream &os) const
 {
-  os << "ChordJoin::requesterID: " << requesterID << "\n";
-}
-void
-GUChordMessage::ChordJoin::Serialize (Buffer::Iterator &start) const
-{
-  start.WriteU16 (requesterID.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (requesterID.c_str())), requesterID.length());
-
-  start.WriteU16 (landmarkID.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (landmarkID.c_str())), landmarkID.length());
-
-  start.WriteHtonU32 (originatorAddress.Get ());
-  start.WriteHtonU32 (landmarkAddress.Get ());
-  
-        
-}
-uint32_t
-GUChordMessage::ChordJoin::Deserialize (Buffer::Iterator &start)
-{
-
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  requesterID = std::string (str, length);
-  free (str);
-
-  uint16_t length2 = start.ReadU16 ();
-  char* str2 = (char*) malloc (length2);
-  start.Read ((uint8_t*)str2, length2);
-  landmarkID = std::string (str2, length2);
-  free (str2);
-
-  originatorAddress = Ipv4Address (start.ReadNtohU32 ());
-  landmarkAddress = Ipv4Address (start.ReadNtohU32 ());
-
-  return ChordJoin::GetSerializedSize ();
-
-
+  os << "ChordJoin::requesterID: " << requesterID << " hopCount: " << (uint32_t) hopCount << "\n";
 }
 void
-GUChordMessage::SetChordJoin ( std::string rqID, std::string lmID, Ipv4Address originAddr, Ipv4Address landmarkAddr )
+GUChordMessage::SetChordJoin ( std::string rqID, std::string lmID, Ipv4Address originAddr, Ipv4Address landmarkAddr, uint8_t maxWireVersion, uint8_t hopCount )
 {
    if (m_messageType == 0)
       {
@@ -435,57 +282,31 @@ GUChordMessage::SetChordJoin ( std::string rqID, std::string lmID, Ipv4Address o
       {
         NS_ASSERT (m_messageType == CHORD_JOIN);
       }
-        m_message.joinMessage.requesterID = rqID;
-        m_message.joinMessage.landmarkID = lmID;
-        m_message.joinMessage.originatorAddress = originAddr;
-        m_message.joinMessage.landmarkAddress = landmarkAddr;
+        ChordJoin &payload = m_payload.GetOrCreate<ChordJoin> ();
+        payload.requesterID.swap (rqID);
+        payload.landmarkID.swap (lmID);
+        payload.originatorAddress = originAddr;
+        payload.landmarkAddress = landmarkAddr;
+        payload.maxWireVersion = maxWireVersion;
+        payload.hopCount = hopCount;
 }
 
-GUChordMessage::ChordJoin
-GUChordMessage::GetChordJoin ()
+const GUChordMessage::ChordJoin&
+GUChordMessage::GetChordJoin () const
 {
-  return m_message.joinMessage;
+  return m_payload.Get<ChordJoin> ();
 }
 
 
-
 /************************       CHORD JOIN RESPONSE METHODS                  ******************************/
 
-
-uint32_t
-GUChordMessage::ChordJoinRsp::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = (IPV4_ADDRESS_SIZE) + sizeof(uint16_t) + newSucc.length();
-  return size;
-}
 void
 GUChordMessage::ChordJoinRsp::Print (std::ostream &os) const
 {
   os << "ChordJoinRsp::succ: "<< successorVal <<"\n";
 }
 void
-GUChordMessage::ChordJoinRsp::Serialize (Buffer::Iterator &start) const
-{
-        start.WriteU16 (newSucc.length ());
-        start.Write ((uint8_t *) (const_cast<char*> (newSucc.c_str())), newSucc.length());
-        start.WriteHtonU32 (successorVal.Get ());
-}
-uint32_t
-GUChordMessage::ChordJoinRsp::Deserialize (Buffer::Iterator &start)
-{
-
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  newSucc = std::string (str, length);
-  free (str);
-
-  successorVal = Ipv4Address (start.ReadNtohU32 ());
-  return ChordJoinRsp::GetSerializedSize ();
-}
-void
-GUChordMessage::SetChordJoinRsp ( std::string succVal, Ipv4Address succ)
+GUChordMessage::SetChordJoinRsp ( std::string succVal, Ipv4Address succ, uint8_t maxWireVersion)
 {
    if (m_messageType == 0)
       {
@@ -495,53 +316,27 @@ GUChordMessage::SetChordJoinRsp ( std::string succVal, Ipv4Address succ)
       {
         NS_ASSERT (m_messageType == CHORD_JOIN_RSP);
       }
-        m_message.joinResponse.newSucc = succVal;
-        m_message.joinResponse.successorVal = succ;
+        ChordJoinRsp &payload = m_payload.GetOrCreate<ChordJoinRsp> ();
+        payload.newSucc.swap (succVal);
+        payload.successorVal = succ;
+        payload.maxWireVersion = maxWireVersion;
 }
 
-GUChordMessage::ChordJoinRsp
-GUChordMessage::GetChordJoinRsp ()
+const GUChordMessage::ChordJoinRsp&
+GUChordMessage::GetChordJoinRsp () const
 {
-  return m_message.joinResponse;
+  return m_payload.Get<ChordJoinRsp> ();
 }
 
 
-
 /************************** RING STATE MESSAGE **********************************/
 
-
-uint32_t
-GUChordMessage::RingState::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t) + originatorNodeID.length();
-  return size;
-}
 void
 GUChordMessage::RingState::Print (std::ostream &os) const
 {
   os << "Ring State message \n";
 }
 void
-GUChordMessage::RingState::Serialize (Buffer::Iterator &start) const
-{
-        start.WriteU16 (originatorNodeID.length ());
-        start.Write ((uint8_t *) (const_cast<char*> (originatorNodeID.c_str())), originatorNodeID.length());
-  
-}
-uint32_t
-GUChordMessage::RingState::Deserialize (Buffer::Iterator &start)
-{
-
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  originatorNodeID = std::string (str, length);
-  free (str);
-  
-  return RingState::GetSerializedSize ();
-}
-void
 GUChordMessage::SetRingState ( std::string origin )
 {
    if (m_messageType == 0)
@@ -552,13 +347,14 @@ GUChordMessage::SetRingState ( std::string origin )
       {
         NS_ASSERT (m_messageType == RING_STATE);
       }
-        m_message.rs.originatorNodeID = origin;
+        RingState &payload = m_payload.GetOrCreate<RingState> ();
+        payload.originatorNodeID.swap (origin);
 }
 
-GUChordMessage::RingState
-GUChordMessage::GetRingState ()
+const GUChordMessage::RingState&
+GUChordMessage::GetRingState () const
 {
-  return m_message.rs;
+  return m_payload.Get<RingState> ();
 }
 
 //
@@ -567,32 +363,12 @@ GUChordMessage::GetRingState ()
 
 /******                 STABILIZE REQUEST METHODS                      ********/
 
-
-uint32_t
-GUChordMessage::StableReq::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t);
-  return size;
-}
 void
 GUChordMessage::StableReq::Print (std::ostream &os) const
 {
   os << "StabilizeReq \n";
 }
 void
-GUChordMessage::StableReq::Serialize (Buffer::Iterator &start) const
-{
-        
-}
-uint32_t
-GUChordMessage::StableReq::Deserialize (Buffer::Iterator &start)
-{
-
-  return StableReq::GetSerializedSize ();
-
-}
-void
 GUChordMessage::SetStableReq ()
 {
    if (m_messageType == 0)
@@ -605,50 +381,20 @@ GUChordMessage::SetStableReq ()
       }
 }
 
-GUChordMessage::StableReq
-GUChordMessage::GetStableReq ()
+const GUChordMessage::StableReq&
+GUChordMessage::GetStableReq () const
 {
-  return m_message.stableMessage;
+  return m_payload.Get<StableReq> ();
 }
 
 /************************       STABILIZE RESPONSE METHODS                  ******************************/
 
-uint32_t
-GUChordMessage::StableRsp::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = (IPV4_ADDRESS_SIZE) + sizeof(uint16_t) + predID.length();
-  return size;
-}
 void
 GUChordMessage::StableRsp::Print (std::ostream &os) const
 {
   os << "StableRsp::pred: "<< predAddress << "\n";
 }
 void
-GUChordMessage::StableRsp::Serialize (Buffer::Iterator &start) const
-{
-
-        start.WriteU16 (predID.length ());
-        start.Write ((uint8_t *) (const_cast<char*> (predID.c_str())), predID.length());
-
-        start.WriteHtonU32 (predAddress.Get ());
-}
-uint32_t
-GUChordMessage::StableRsp::Deserialize (Buffer::Iterator &start)
-{
-
-        uint16_t length = start.ReadU16 ();
-        char* str = (char*) malloc (length);
-        start.Read ((uint8_t*)str, length);
-        predID = std::string (str, length);
-        free (str);
-
-        predAddress = Ipv4Address (start.ReadNtohU32 ());
-
-        return StableRsp::GetSerializedSize ();
-}
-void
 GUChordMessage::SetStableRsp (std::string predId, Ipv4Address predIp)
 {
    if (m_messageType == 0)
@@ -659,400 +405,476 @@ GUChordMessage::SetStableRsp (std::string predId, Ipv4Address predIp)
       {
         NS_ASSERT (m_messageType == STABLE_RSP);
       }
-        m_message.stableResponse.predID = predId;
-        m_message.stableResponse.predAddress = predIp;
+        StableRsp &payload = m_payload.GetOrCreate<StableRsp> ();
+        payload.predID.swap (predId);
+        payload.predAddress = predIp;
 }
 
-GUChordMessage::StableRsp
-GUChordMessage::GetStableRsp ()
+const GUChordMessage::StableRsp&
+GUChordMessage::GetStableRsp () const
 {
-  return m_message.stableResponse;
+  return m_payload.Get<StableRsp> ();
 }
 
 
 /************************************      SET PRED METHODS         ***************************/
 
-uint32_t
-GUChordMessage::SetPred::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = (IPV4_ADDRESS_SIZE) + sizeof(uint16_t) + newPredID.length();
-  return size;
-}
 void
 GUChordMessage::SetPred::Print (std::ostream &os) const
 {
   os << "SetPred\n";
 }
 void
-GUChordMessage::SetPred::Serialize (Buffer::Iterator &start) const
+GUChordMessage::SetSetPred (std::string newPredId, Ipv4Address newPredIp)
 {
-
-        start.WriteU16 (newPredID.length ());
-        start.Write ((uint8_t *) (const_cast<char*> (newPredID.c_str())), newPredID.length());
-
-        start.WriteHtonU32 (newPredIP.Get ());
+   if (m_messageType == 0)
+      {
+        m_messageType = SET_PRED;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == SET_PRED);
+      }
+        SetPred &payload = m_payload.GetOrCreate<SetPred> ();
+        payload.newPredID.swap (newPredId);
+        payload.newPredIP = newPredIp;
 }
-uint32_t
-GUChordMessage::SetPred::Deserialize (Buffer::Iterator &start)
+
+const GUChordMessage::SetPred&
+GUChordMessage::GetSetPred () const
 {
+  return m_payload.Get<SetPred> ();
+}
 
-        uint16_t length = start.ReadU16 ();
-        char* str = (char*) malloc (length);
-        start.Read ((uint8_t*)str, length);
-        newPredID = std::string (str, length);
-        free (str);
 
-        newPredIP = Ipv4Address (start.ReadNtohU32 ());
+/************************************      NOTIFY METHODS             **************************/
 
-        return SetPred::GetSerializedSize ();
+void
+GUChordMessage::Notify::Print (std::ostream &os) const
+{
+  os << "Notify\n";
 }
 void
-GUChordMessage::SetSetPred (std::string newPredId, Ipv4Address newPredIp)
+GUChordMessage::SetNotify (std::string potPredId, Ipv4Address potPredIp)
 {
    if (m_messageType == 0)
       {
-        m_messageType = SET_PRED;
+        m_messageType = NOTIFY;
       }
    else
       {
-        NS_ASSERT (m_messageType == SET_PRED);
+        NS_ASSERT (m_messageType == NOTIFY);
       }
-        m_message.setPredMessage.newPredID = newPredId;
-        m_message.setPredMessage.newPredIP = newPredIp;
+        Notify &payload = m_payload.GetOrCreate<Notify> ();
+        payload.potentialPredID.swap (potPredId);
+        payload.potentialPredIP = potPredIp;
 }
 
-GUChordMessage::SetPred
-GUChordMessage::GetSetPred ()
+const GUChordMessage::Notify&
+GUChordMessage::GetNotify () const
 {
-  return m_message.setPredMessage;
+  return m_payload.Get<Notify> ();
 }
 
 
-/************************************      NOTIFY METHODS             **************************/
+/************************************      CHORD LEAVE METHODS      ****************************/
 
-uint32_t
-GUChordMessage::Notify::GetSerializedSize (void) const
+void
+GUChordMessage::ChordLeave::Print (std::ostream &os) const
 {
-  uint32_t size;
-  size = (IPV4_ADDRESS_SIZE) + sizeof(uint16_t) + potentialPredID.length();
-  return size;
+  os << "ChordJoin\n";
 }
 void
-GUChordMessage::Notify::Print (std::ostream &os) const
+GUChordMessage::SetChordLeave ( Ipv4Address successor, Ipv4Address predecessor, std::string sId, std::string pId )
 {
-  os << "Notify\n";
+   if (m_messageType == 0)
+      {
+        m_messageType = CHORD_LEAVE;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == CHORD_LEAVE);
+      }
+        ChordLeave &payload = m_payload.GetOrCreate<ChordLeave> ();
+        payload.successorID.swap (sId);
+        payload.predecessorID.swap (pId);
+        payload.successorAddress = successor;
+        payload.predecessorAddress = predecessor;
 }
-void
-GUChordMessage::Notify::Serialize (Buffer::Iterator &start) const
+
+const GUChordMessage::ChordLeave&
+GUChordMessage::GetChordLeave () const
 {
+  return m_payload.Get<ChordLeave> ();
+}
 
-        start.WriteU16 (potentialPredID.length ());
-        start.Write ((uint8_t *) (const_cast<char*> (potentialPredID.c_str())), potentialPredID.length());
+/********************************      FINGER REQ       **************************************/
 
-        start.WriteHtonU32 (potentialPredIP.Get ());
+void
+GUChordMessage::FingerReq::Print (std::ostream &os) const
+{
+  os << "FingerReq:: targetID: " << targetID << " hopCount: " << (uint32_t) hopCount << "\n";
 }
-uint32_t
-GUChordMessage::Notify::Deserialize (Buffer::Iterator &start)
+void
+GUChordMessage::SetFingerReq (std::vector<std::string> &testIds, std::vector<std::string> &fingerEntries, std::vector<Ipv4Address> &fingerIP, Ipv4Address originator, uint8_t hopCount)
 {
+   if (m_messageType == 0)
+      {
+        m_messageType = FINGERME_REQ;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == FINGERME_REQ);
+      }        
+        FingerReq &payload = m_payload.GetOrCreate<FingerReq> ();
+        payload.originatorNode = originator;
+        payload.targetID = testIds.empty () ? std::string () : testIds.back ();
+        payload.hopCount = hopCount;
+        payload.testIdentifiers.swap (testIds);
+        payload.fingerEntries.swap (fingerEntries);
+        payload.fingerIps.swap (fingerIP);
+}
 
-        uint16_t length = start.ReadU16 ();
-        char* str = (char*) malloc (length);
-        start.Read ((uint8_t*)str, length);
-        potentialPredID = std::string (str, length);
-        free (str);
+const GUChordMessage::FingerReq&
+GUChordMessage::GetFingerReq () const
+{
+  return m_payload.Get<FingerReq> ();
+}
 
-        potentialPredIP = Ipv4Address (start.ReadNtohU32 ());
 
-        return Notify::GetSerializedSize ();
+/**********************************      FINGER RSP     ************************************/
+
+void
+GUChordMessage::FingerRsp::Print (std::ostream &os) const
+{
+  os << "FingerRsq\n";
 }
 void
-GUChordMessage::SetNotify (std::string potPredId, Ipv4Address potPredIp)
+GUChordMessage::SetFingerRsp (std::vector<std::string> &fingerNum, std::vector<Ipv4Address> &fingerAddr)
 {
    if (m_messageType == 0)
       {
-        m_messageType = NOTIFY;
+        m_messageType = FINGERME_RSP;
       }
    else
       {
-        NS_ASSERT (m_messageType == NOTIFY);
+        NS_ASSERT (m_messageType == FINGERME_RSP);
       }
-        m_message.notifyMessage.potentialPredID = potPredId;
-        m_message.notifyMessage.potentialPredIP = potPredIp;
+        FingerRsp &payload = m_payload.GetOrCreate<FingerRsp> ();
+        payload.fingerID.swap (fingerNum);
+        payload.fingerAddress.swap (fingerAddr);
 }
 
-GUChordMessage::Notify
-GUChordMessage::GetNotify ()
+const GUChordMessage::FingerRsp&
+GUChordMessage::GetFingerRsp () const
 {
-  return m_message.notifyMessage;
+  return m_payload.Get<FingerRsp> ();
 }
 
+/**********************************      RING AGG REQ     ************************************/
 
-
-/************************************      CHORD LEAVE METHODS      ****************************/
-
-uint32_t
-GUChordMessage::ChordLeave::GetSerializedSize (void) const
+void
+GUChordMessage::RingAggReq::Print (std::ostream &os) const
 {
-  uint32_t size;
-  size = (2*IPV4_ADDRESS_SIZE) + sizeof(uint16_t) + successorID.length() + predecessorID.length();
-  return 10*size;
+  os << "RingAggReq:: queryId: " << queryId << " limit: " << limitID << "\n";
 }
 void
-GUChordMessage::ChordLeave::Print (std::ostream &os) const
+GUChordMessage::SetRingAggReq (uint32_t queryId, uint32_t timeoutMs, std::string limitId)
 {
-  os << "ChordJoin\n";
+   if (m_messageType == 0)
+      {
+        m_messageType = RING_AGG_REQ;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == RING_AGG_REQ);
+      }
+        RingAggReq &payload = m_payload.GetOrCreate<RingAggReq> ();
+        payload.queryId = queryId;
+        payload.timeoutMs = timeoutMs;
+        payload.limitID.swap (limitId);
 }
-void
-GUChordMessage::ChordLeave::Serialize (Buffer::Iterator &start) const
+
+const GUChordMessage::RingAggReq&
+GUChordMessage::GetRingAggReq () const
 {
+  return m_payload.Get<RingAggReq> ();
+}
 
-  start.WriteU16 (successorID.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (successorID.c_str())), successorID.length());
-  
-  start.WriteU16 (predecessorID.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (predecessorID.c_str())), predecessorID.length());
 
-  start.WriteHtonU32 (successorAddress.Get ());
-  start.WriteHtonU32 (predecessorAddress.Get ());
-        
+/**********************************      RING AGG RSP     ************************************/
+
+void
+GUChordMessage::RingAggRsp::Print (std::ostream &os) const
+{
+  os << "RingAggRsp:: nodes: " << nodeCount
+     << " keys(min/max/mean): " << minKeys << "/" << maxKeys << "/"
+     << (nodeCount ? (double) totalKeys / nodeCount : 0.0)
+     << " inconsistentSuccessors: " << inconsistentSuccessors
+     << " nodesWithoutFingers: " << nodesWithoutFingers
+     << " fingerAgeMs(max/mean): " << maxFingerAgeMs << "/"
+     << (nodeCount > nodesWithoutFingers ? (double) totalFingerAgeMs / (nodeCount - nodesWithoutFingers) : 0.0)
+     << "\n";
 }
-uint32_t
-GUChordMessage::ChordLeave::Deserialize (Buffer::Iterator &start)
+void
+GUChordMessage::RingAggRsp::Merge (const RingAggRsp &other)
+{
+  if (other.nodeCount == 0)
+    {
+      return;
+    }
+  minKeys = (nodeCount == 0 || other.minKeys < minKeys) ? other.minKeys : minKeys;
+  maxKeys = (nodeCount == 0 || other.maxKeys > maxKeys) ? other.maxKeys : maxKeys;
+  nodeCount += other.nodeCount;
+  totalKeys += other.totalKeys;
+  inconsistentSuccessors += other.inconsistentSuccessors;
+  nodesWithoutFingers += other.nodesWithoutFingers;
+  maxFingerAgeMs = other.maxFingerAgeMs > maxFingerAgeMs ? other.maxFingerAgeMs : maxFingerAgeMs;
+  totalFingerAgeMs += other.totalFingerAgeMs;
+}
+void
+GUChordMessage::SetRingAggRsp (RingAggRsp summary)
 {
+   if (m_messageType == 0)
+      {
+        m_messageType = RING_AGG_RSP;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == RING_AGG_RSP);
+      }
+        m_payload.GetOrCreate<RingAggRsp> () = summary;
+}
 
-        uint16_t length = start.ReadU16 ();
-        char* str = (char*) malloc (length);
-        start.Read ((uint8_t*)str, length);
-        successorID = std::string (str, length);
-        free (str);
+const GUChordMessage::RingAggRsp&
+GUChordMessage::GetRingAggRsp () const
+{
+  return m_payload.Get<RingAggRsp> ();
+}
 
-        uint16_t length2 = start.ReadU16 ();
-        char* str2 = (char*) malloc (length2);
-        start.Read ((uint8_t*)str2, length2);
-        predecessorID = std::string (str, length);
-        free (str);
+/**********************************      CHORD LOOKUP     ************************************/
 
-        successorAddress = Ipv4Address (start.ReadNtohU32 ());
-        predecessorAddress = Ipv4Address (start.ReadNtohU32 ());
-          
-        return ChordLeave::GetSerializedSize ();
+void
+GUChordMessage::ChordLookup::Print (std::ostream &os) const
+{
+  os << "ChordLookup:: key: " << lookupKey << " originator: " << originatorAddress << " hops: " << (uint32_t) hopCount << "\n";
 }
 void
-GUChordMessage::SetChordLeave ( Ipv4Address successor, Ipv4Address predecessor, std::string sId, std::string pId )
+GUChordMessage::SetChordLookup (ChordLookup lookup)
 {
    if (m_messageType == 0)
       {
-        m_messageType = CHORD_LEAVE;
+        m_messageType = CHORD_LOOKUP;
       }
    else
       {
-        NS_ASSERT (m_messageType == CHORD_LEAVE);
+        NS_ASSERT (m_messageType == CHORD_LOOKUP);
       }
-        m_message.leaveMessage.successorID = sId;
-        m_message.leaveMessage.predecessorID = pId;
-        m_message.leaveMessage.successorAddress = successor;
-        m_message.leaveMessage.predecessorAddress = predecessor;
+        m_payload.GetOrCreate<ChordLookup> () = lookup;
 }
 
-GUChordMessage::ChordLeave
-GUChordMessage::GetChordLeave ()
+const GUChordMessage::ChordLookup&
+GUChordMessage::GetChordLookup () const
 {
-  return m_message.leaveMessage;
+  return m_payload.Get<ChordLookup> ();
 }
 
-/********************************      FINGER REQ       **************************************/
-
-uint32_t
-GUChordMessage::FingerReq::GetSerializedSize (void) const
-{
 
-  uint32_t size;
-  size = sizeof(uint16_t) + (IPV4_ADDRESS_SIZE);
-  size += sizeof(uint32_t);
-
-  for (std::vector<std::string>::const_iterator it = testIdentifiers.begin(); it != testIdentifiers.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
-
-  for (std::vector<std::string>::const_iterator it = fingerEntries.begin(); it != fingerEntries.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
-  
-  for (std::vector<Ipv4Address>::const_iterator it = fingerIps.begin(); it != fingerIps.end(); it++) {
-    size += sizeof(uint16_t) + (IPV4_ADDRESS_SIZE);
-  }
+/**********************************      CHORD LOOKUP RSP     ************************************/
 
-  return 5*size;
-}
 void
-GUChordMessage::FingerReq::Print (std::ostream &os) const
+GUChordMessage::ChordLookupRsp::Print (std::ostream &os) const
 {
-  os << "FingerReq\n";
+  os << "ChordLookupRsp:: key: " << lookupKey << " owner: " << ownerAddress << " hops: " << (uint32_t) hopCount << "\n";
 }
 void
-GUChordMessage::FingerReq::Serialize (Buffer::Iterator &start) const
+GUChordMessage::SetChordLookupRsp (ChordLookupRsp response)
 {
-        start.WriteHtonU32 (originatorNode.Get ());  
-        
-        start.WriteHtonU32(testIdentifiers.size());
-  
-        for (std::vector<std::string>::const_iterator it = testIdentifiers.begin(); it != testIdentifiers.end(); it++) {
-        start.WriteU16 ((*it).length());
-        start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
-        }
-        
-        start.WriteHtonU32(fingerEntries.size());
-  
-        for (std::vector<std::string>::const_iterator it = fingerEntries.begin(); it != fingerEntries.end(); it++) {
-        start.WriteU16 ((*it).length());
-        start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
-        }
-        
-        start.WriteHtonU32(fingerIps.size());
-  
-        for (std::vector<Ipv4Address>::const_iterator it = fingerIps.begin(); it != fingerIps.end(); it++) {
-        start.WriteHtonU32 ((*it).Get ());
-        }
+   if (m_messageType == 0)
+      {
+        m_messageType = CHORD_LOOKUP_RSP;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == CHORD_LOOKUP_RSP);
+      }
+        m_payload.GetOrCreate<ChordLookupRsp> () = response;
 }
-uint32_t
-GUChordMessage::FingerReq::Deserialize (Buffer::Iterator &start)
-{
-        originatorNode = Ipv4Address (start.ReadNtohU32 ());
-        
-        uint32_t dlen = start.ReadNtohU32();
-          for (uint32_t i = 0; i < dlen; i++) {
-            uint16_t length = start.ReadU16 ();
-            char* str = (char*) malloc (length);
-            start.Read ((uint8_t*)str, length);
-            testIdentifiers.push_back(std::string (str, length));
-            free (str);
-          }
-
-        uint32_t dlen2 = start.ReadNtohU32();
-          for (uint32_t i = 0; i < dlen2; i++) {
-            uint16_t length = start.ReadU16 ();
-            char* str = (char*) malloc (length);
-            start.Read ((uint8_t*)str, length);
-            fingerEntries.push_back(std::string (str, length));
-            free (str);
-          }
-        
-        uint32_t dlen3 = start.ReadNtohU32();
-          for (uint32_t i = 0; i < dlen3; i++) {
-                fingerIps.push_back(Ipv4Address (start.ReadNtohU32 ()));            
-          }
-
-        return FingerReq::GetSerializedSize ();
+
+const GUChordMessage::ChordLookupRsp&
+GUChordMessage::GetChordLookupRsp () const
+{
+  return m_payload.Get<ChordLookupRsp> ();
 }
+
+/**********************************      EXPLORE REQ     ************************************/
+
 void
-GUChordMessage::SetFingerReq (std::vector<std::string> testIds, std::vector<std::string> fingerEntries, std::vector<Ipv4Address> fingerIP, Ipv4Address originator)
+GUChordMessage::ExploreReq::Print (std::ostream &os) const
+{
+  os << "ExploreReq:: target: " << targetID << " maxEntries: " << (uint32_t) maxEntries << "\n";
+}
+void
+GUChordMessage::SetExploreReq (std::string targetId, uint8_t maxEntries)
 {
    if (m_messageType == 0)
       {
-        m_messageType = FINGERME_REQ;
+        m_messageType = EXPLORE_REQ;
       }
    else
       {
-        NS_ASSERT (m_messageType == FINGERME_REQ);
-      }        
-        m_message.fingerReq.originatorNode = originator;
-        m_message.fingerReq.testIdentifiers = testIds;
-        m_message.fingerReq.fingerEntries = fingerEntries;
-        m_message.fingerReq.fingerIps = fingerIP;
+        NS_ASSERT (m_messageType == EXPLORE_REQ);
+      }
+        ExploreReq &payload = m_payload.GetOrCreate<ExploreReq> ();
+        payload.targetID.swap (targetId);
+        payload.maxEntries = maxEntries;
 }
 
-GUChordMessage::FingerReq
-GUChordMessage::GetFingerReq ()
+const GUChordMessage::ExploreReq&
+GUChordMessage::GetExploreReq () const
 {
-  return m_message.fingerReq;
+  return m_payload.Get<ExploreReq> ();
 }
 
 
-/**********************************      FINGER RSP     ************************************/
+/**********************************      EXPLORE RSP     ************************************/
 
+void
+GUChordMessage::ExploreRsp::Print (std::ostream &os) const
+{
+  os << "ExploreRsp:: entries: " << entries.size() << "\n";
+}
+void
+GUChordMessage::SetExploreRsp (std::vector<Ipv4Address> &entries)
+{
+   if (m_messageType == 0)
+      {
+        m_messageType = EXPLORE_RSP;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == EXPLORE_RSP);
+      }
+        NS_ASSERT (entries.size () <= 255);
+        ExploreRsp &payload = m_payload.GetOrCreate<ExploreRsp> ();
+        payload.entries.swap (entries);
+}
 
-uint32_t
-GUChordMessage::FingerRsp::GetSerializedSize (void) const
+const GUChordMessage::ExploreRsp&
+GUChordMessage::GetExploreRsp () const
 {
-  uint32_t size;
-  size = sizeof(uint16_t);
-  size += sizeof(uint32_t);
+  return m_payload.Get<ExploreRsp> ();
+}
 
-  for (std::vector<std::string>::const_iterator it = fingerID.begin(); it != fingerID.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
+/**********************************      FINGER LIST REQ     ************************************/
 
-  for (std::vector<Ipv4Address>::const_iterator it = fingerAddress.begin(); it != fingerAddress.end(); it++) {
-    size += sizeof(uint16_t) + (IPV4_ADDRESS_SIZE);
-  }
+void
+GUChordMessage::FingerListReq::Print (std::ostream &os) const
+{
+  os << "FingerListReq\n";
+}
+void
+GUChordMessage::SetFingerListReq ()
+{
+   if (m_messageType == 0)
+      {
+        m_messageType = FINGER_LIST_REQ;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == FINGER_LIST_REQ);
+      }
+}
 
-  return 5*size;
+const GUChordMessage::FingerListReq&
+GUChordMessage::GetFingerListReq () const
+{
+  return m_payload.Get<FingerListReq> ();
 }
+
+/**********************************      FINGER LIST RSP     ************************************/
+
 void
-GUChordMessage::FingerRsp::Print (std::ostream &os) const
+GUChordMessage::FingerListRsp::Print (std::ostream &os) const
 {
-  os << "FingerRsq\n";
+  os << "FingerListRsp:: fingers: " << fingers.size() << "\n";
 }
 void
-GUChordMessage::FingerRsp::Serialize (Buffer::Iterator &start) const
+GUChordMessage::SetFingerListRsp (std::vector<Ipv4Address> &fingers)
+{
+   if (m_messageType == 0)
+      {
+        m_messageType = FINGER_LIST_RSP;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == FINGER_LIST_RSP);
+      }
+        NS_ASSERT (fingers.size () <= 255);
+        FingerListRsp &payload = m_payload.GetOrCreate<FingerListRsp> ();
+        payload.fingers.swap (fingers);
+}
+
+const GUChordMessage::FingerListRsp&
+GUChordMessage::GetFingerListRsp () const
 {
+  return m_payload.Get<FingerListRsp> ();
+}
 
-        start.WriteHtonU32(fingerID.size());
-  
-        for (std::vector<std::string>::const_iterator it = fingerID.begin(); it != fingerID.end(); it++) {
-        start.WriteU16 ((*it).length());
-        start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
-        }
+/**********************************      SIZE ESTIMATE REQ     ************************************/
 
-        start.WriteHtonU32(fingerAddress.size());
-  
-        for (std::vector<Ipv4Address>::const_iterator it = fingerAddress.begin(); it != fingerAddress.end(); it++) {
-        start.WriteHtonU32 ((*it).Get ());
-        }
+void
+GUChordMessage::SizeEstimateReq::Print (std::ostream &os) const
+{
+  os << "SizeEstimateReq:: networkSize: " << networkSize << "\n";
 }
-uint32_t
-GUChordMessage::FingerRsp::Deserialize (Buffer::Iterator &start)
+void
+GUChordMessage::SetSizeEstimateReq (uint32_t networkSize)
 {
+   if (m_messageType == 0)
+      {
+        m_messageType = SIZE_EST_REQ;
+      }
+   else
+      {
+        NS_ASSERT (m_messageType == SIZE_EST_REQ);
+      }
+        SizeEstimateReq &payload = m_payload.GetOrCreate<SizeEstimateReq> ();
+        payload.networkSize = networkSize;
+}
 
-        uint32_t dlen2 = start.ReadNtohU32();
-          for (uint32_t i = 0; i < dlen2; i++) {
-            uint16_t length = start.ReadU16 ();
-            char* str = (char*) malloc (length);
-            start.Read ((uint8_t*)str, length);
-            fingerID.push_back(std::string (str, length));
-            free (str);
-          }
+const GUChordMessage::SizeEstimateReq&
+GUChordMessage::GetSizeEstimateReq () const
+{
+  return m_payload.Get<SizeEstimateReq> ();
+}
 
-        uint32_t dlen3 = start.ReadNtohU32();
-          for (uint32_t i = 0; i < dlen3; i++) {
-                fingerAddress.push_back(Ipv4Address (start.ReadNtohU32 ()));            
-          }
+/**********************************      SIZE ESTIMATE RSP     ************************************/
 
-        return FingerRsp::GetSerializedSize ();
+void
+GUChordMessage::SizeEstimateRsp::Print (std::ostream &os) const
+{
+  os << "SizeEstimateRsp:: networkSize: " << networkSize << "\n";
 }
 void
-GUChordMessage::SetFingerRsp (std::vector<std::string> fingerNum, std::vector<Ipv4Address> fingerAddr)
+GUChordMessage::SetSizeEstimateRsp (uint32_t networkSize)
 {
    if (m_messageType == 0)
       {
-        m_messageType = FINGERME_RSP;
+        m_messageType = SIZE_EST_RSP;
       }
    else
       {
-        NS_ASSERT (m_messageType == FINGERME_RSP);
+        NS_ASSERT (m_messageType == SIZE_EST_RSP);
       }
-        m_message.fingerRsp.fingerID = fingerNum;
-        m_message.fingerRsp.fingerAddress = fingerAddr;
+        SizeEstimateRsp &payload = m_payload.GetOrCreate<SizeEstimateRsp> ();
+        payload.networkSize = networkSize;
 }
 
-GUChordMessage::FingerRsp
-GUChordMessage::GetFingerRsp ()
+const GUChordMessage::SizeEstimateRsp&
+GUChordMessage::GetSizeEstimateRsp () const
 {
-  return m_message.fingerRsp;
+  return m_payload.Get<SizeEstimateRsp> ();
 }
 
 /***************************************************************/
@@ -1060,6 +882,10 @@ GUChordMessage::GetFingerRsp ()
 void
 GUChordMessage::SetMessageType (MessageType messageType)
 {
+  if (messageType != m_messageType)
+    {
+      m_payload.Clear ();
+    }
   m_messageType = messageType;
 }
 
@@ -1081,3 +907,80 @@ GUChordMessage::GetTransactionId (void) const
   return m_transactionId;
 }
 
+void
+GUChordMessage::SetSenderDomain (std::string senderDomain)
+{
+  NS_ASSERT (senderDomain.length () <= MAX_DOMAIN_LENGTH);
+  m_senderDomain = senderDomain;
+}
+
+std::string
+GUChordMessage::GetSenderDomain () const
+{
+  return m_senderDomain;
+}
+
+void
+GUChordMessage::SetWireVersion (uint8_t wireVersion)
+{
+  NS_ASSERT (wireVersion >= WIRE_VERSION_1 && wireVersion <= WIRE_VERSION_2);
+  m_wireVersion = wireVersion;
+}
+
+uint8_t
+GUChordMessage::GetWireVersion () const
+{
+  return m_wireVersion;
+}
+
+void
+GUChordMessage::SetRouteOnly (bool routeOnly)
+{
+  m_routeOnly = routeOnly;
+}
+
+bool
+GUChordMessage::IsRelayed (MessageType messageType)
+{
+  switch (messageType)
+    {
+#define GU_CHORD_RELAYED_CASE(type, Payload) \
+      case type: \
+        return true;
+      GU_CHORD_RELAYED_PAYLOADS (GU_CHORD_RELAYED_CASE)
+#undef GU_CHORD_RELAYED_CASE
+      default:
+        return false;
+    }
+}
+
+uint8_t
+GUChordMessage::GetHopCount () const
+{
+  switch (m_messageType)
+    {
+#define GU_CHORD_GET_HOPS_CASE(type, Payload) \
+      case type: \
+        return m_payload.Get<Payload> ().hopCount;
+      GU_CHORD_RELAYED_PAYLOADS (GU_CHORD_GET_HOPS_CASE)
+#undef GU_CHORD_GET_HOPS_CASE
+      default:
+        return 0;
+    }
+}
+
+void
+GUChordMessage::SetHopCount (uint8_t hopCount)
+{
+  switch (m_messageType)
+    {
+#define GU_CHORD_SET_HOPS_CASE(type, Payload) \
+      case type: \
+        m_payload.GetOrCreate<Payload> ().hopCount = hopCount; \
+        break;
+      GU_CHORD_RELAYED_PAYLOADS (GU_CHORD_SET_HOPS_CASE)
+#undef GU_CHORD_SET_HOPS_CASE
+      default:
+        NS_ASSERT (false);
+    }
+}
@@ -21,11 +21,46 @@
 #include "ns3/ipv4-address.h"
 #include "ns3/packet.h"
 #include "ns3/object.h"
+#include "ns3/gu-tagged-payload.h"
+#include "ns3/gu-payload-view.h"
+#include "ns3/gu-wire-codec.h"
 #include <vector>
 
 using namespace ns3;
 
 #define IPV4_ADDRESS_SIZE 4
+#define MAX_DOMAIN_LENGTH 255
+
+// Payload struct carried by each message type. The codec switches in
+// gu-chord-message.cc are generated from this list.
+#define GU_CHORD_PAYLOADS(X) \
+  X (PING_REQ, PingReq) \
+  X (PING_RSP, PingRsp) \
+  X (CHORD_JOIN, ChordJoin) \
+  X (CHORD_JOIN_RSP, ChordJoinRsp) \
+  X (RING_STATE, RingState) \
+  X (STABLE_REQ, StableReq) \
+  X (STABLE_RSP, StableRsp) \
+  X (SET_PRED, SetPred) \
+  X (NOTIFY, Notify) \
+  X (CHORD_LEAVE, ChordLeave) \
+  X (FINGERME_REQ, FingerReq) \
+  X (FINGERME_RSP, FingerRsp) \
+  X (RING_AGG_REQ, RingAggReq) \
+  X (RING_AGG_RSP, RingAggRsp) \
+  X (CHORD_LOOKUP, ChordLookup) \
+  X (CHORD_LOOKUP_RSP, ChordLookupRsp) \
+  X (EXPLORE_REQ, ExploreReq) \
+  X (EXPLORE_RSP, ExploreRsp) \
+  X (FINGER_LIST_REQ, FingerListReq) \
+  X (FINGER_LIST_RSP, FingerListRsp) \
+  X (SIZE_EST_REQ, SizeEstimateReq) \
+  X (SIZE_EST_RSP, SizeEstimateRsp)
+
+// Message types relays forward on their routing fields alone
+#define GU_CHORD_RELAYED_PAYLOADS(X) \
+  X (CHORD_JOIN, ChordJoin) \
+  X (FINGERME_REQ, FingerReq)
 
 class GUChordMessage : public Header
 {
@@ -47,7 +82,17 @@ class GUChordMessage : public Header
         NOTIFY = 9,
         CHORD_LEAVE = 10,
         FINGERME_REQ = 11,
-        FINGERME_RSP = 12,    
+        FINGERME_RSP = 12,
+        RING_AGG_REQ = 13,
+        RING_AGG_RSP = 14,
+        CHORD_LOOKUP = 15,
+        CHORD_LOOKUP_RSP = 16,
+        EXPLORE_REQ = 17,
+        EXPLORE_RSP = 18,
+        FINGER_LIST_REQ = 19,
+        FINGER_LIST_RSP = 20,
+        SIZE_EST_REQ = 21,
+        SIZE_EST_RSP = 22,
       };
 
     GUChordMessage (GUChordMessage::MessageType messageType, uint32_t transactionId);
@@ -74,12 +119,57 @@ class GUChordMessage : public Header
      */
     uint32_t GetTransactionId () const;
 
+    /**
+     *  \brief Sets the hierarchical domain of the sending node
+     *  \param senderDomain Domain path such as "site1/rack2", empty when flat
+     */
+    void SetSenderDomain (std::string senderDomain);
+
+    /**
+     *  \returns Domain of the sending node
+     */
+    std::string GetSenderDomain () const;
+
+    /**
+     *  \brief Sets the wire format the payload is encoded with
+     *  \param wireVersion WIRE_VERSION_1 or WIRE_VERSION_2
+     */
+    void SetWireVersion (uint8_t wireVersion);
+
+    /**
+     *  \returns Wire format the payload was (or will be) encoded with
+     */
+    uint8_t GetWireVersion () const;
+
+    /**
+     *  \brief Limits the codec to the routing header: the fields above plus,
+     *  for relayed types, the payload's routing fields. A relay peeks this
+     *  header, updates it and puts it back in front of the untouched payload.
+     *  \param routeOnly true to stop after the routing header
+     */
+    void SetRouteOnly (bool routeOnly);
+
+    /**
+     *  \returns true if messageType is forwarded on its routing header alone
+     */
+    static bool IsRelayed (MessageType messageType);
+
+    /**
+     *  \returns Hops a relayed message has taken so far
+     */
+    uint8_t GetHopCount () const;
+
+    void SetHopCount (uint8_t hopCount);
+
   private:
     /**
      *  \cond
      */
     MessageType m_messageType;
     uint32_t m_transactionId;
+    std::string m_senderDomain;
+    uint8_t m_wireVersion;
+    bool m_routeOnly;
     /**
      *  \endcond
      */
@@ -95,151 +185,387 @@ class GUChordMessage : public Header
     struct PingReq
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
         std::string pingMessage;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (pingMessage);
+        }
       };
 
     struct PingRsp
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
         std::string pingMessage;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (pingMessage);
+        }
       };
     struct ChordJoin
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
+        WIRE_ROUTE_CODEC_METHODS
         // Payload
         std::string requesterID;
         std::string landmarkID;
         Ipv4Address originatorAddress;
+        uint8_t hopCount;
         Ipv4Address landmarkAddress;
-        
+        uint8_t maxWireVersion;
+
+        // Everything a relay decides on
+        template <typename Codec>
+        void RouteFields (Codec &codec)
+        {
+          codec.Id (requesterID);
+          codec.Id (landmarkID);
+          codec.Address (originatorAddress);
+          codec.U8 (hopCount);
+          codec.U8 (maxWireVersion);
+        }
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          RouteFields (codec);
+          codec.Address (landmarkAddress);
+        }
       };
     struct ChordJoinRsp
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         //Payload
         std::string newSucc;
         Ipv4Address successorVal;
+        uint8_t maxWireVersion;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.Id (newSucc);
+          codec.Address (successorVal);
+          codec.U8 (maxWireVersion);
+        }
       };
     struct RingState
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         std::string originatorNodeID;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.Id (originatorNodeID);
+        }
       };
     struct StableReq
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
+
+        template <typename Codec>
+        void Fields (Codec &codec) {}
       };
     struct StableRsp
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         //Payload
         std::string predID;
         Ipv4Address predAddress;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.Id (predID);
+          codec.Address (predAddress);
+        }
       };
     struct SetPred
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         //Payload
         std::string newPredID;
         Ipv4Address newPredIP;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.Id (newPredID);
+          codec.Address (newPredIP);
+        }
       };
     struct Notify
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         //Payload
         std::string potentialPredID;
         Ipv4Address potentialPredIP;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.Id (potentialPredID);
+          codec.Address (potentialPredIP);
+        }
       };    
     struct ChordLeave
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         //Payload
         std::string successorID;
         std::string predecessorID;        
         Ipv4Address successorAddress;
         Ipv4Address predecessorAddress;
-        
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.Id (successorID);
+          codec.Id (predecessorID);
+          codec.Address (successorAddress);
+          codec.Address (predecessorAddress);
+        }
       };
     struct FingerReq
         {
           void Print (std::ostream &os) const;
-          uint32_t GetSerializedSize (void) const;
-          void Serialize (Buffer::Iterator &start) const;
-          uint32_t Deserialize (Buffer::Iterator &start);
+          WIRE_CODEC_METHODS
+          WIRE_ROUTE_CODEC_METHODS
           //Payload
           Ipv4Address originatorNode;
+          std::string targetID;     // identifier being resolved, the last of testIdentifiers
+          uint8_t hopCount;
           std::vector<std::string> testIdentifiers;
           std::vector<std::string> fingerEntries;
           std::vector<Ipv4Address> fingerIps;
-          
+
+          // Everything a relay decides on; the lists grow with each finger found
+          template <typename Codec>
+          void RouteFields (Codec &codec)
+          {
+            codec.Address (originatorNode);
+            codec.Id (targetID);
+            codec.U8 (hopCount);
+          }
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            RouteFields (codec);
+            codec.IdList (testIdentifiers, sizeof (uint32_t));
+            codec.IdList (fingerEntries, sizeof (uint32_t));
+            codec.AddressList (fingerIps, sizeof (uint32_t));
+          }
         };
     struct FingerRsp
         {
           void Print (std::ostream &os) const;
-          uint32_t GetSerializedSize (void) const;
-          void Serialize (Buffer::Iterator &start) const;
-          uint32_t Deserialize (Buffer::Iterator &start);
+          WIRE_CODEC_METHODS
           //Payload
           std::vector<std::string> fingerID;
           std::vector<Ipv4Address> fingerAddress;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.IdList (fingerID, sizeof (uint32_t));
+            codec.AddressList (fingerAddress, sizeof (uint32_t));
+          }
+        };
+    struct RingAggReq
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload
+          uint32_t queryId;
+          uint32_t timeoutMs;       // budget the receiver has to answer its parent
+          std::string limitID;      // receiver covers the ring interval (self, limitID)
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.U32 (queryId);
+            codec.U32 (timeoutMs);
+            codec.Id (limitID);
+          }
+        };
+    struct RingAggRsp
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          void Merge (const RingAggRsp &other);
+          //Payload: summary of the subtree rooted at the sender
+          uint32_t queryId;
+          uint32_t nodeCount;
+          uint32_t minKeys;
+          uint32_t maxKeys;
+          uint64_t totalKeys;
+          uint32_t inconsistentSuccessors;  // nodes whose successor does not point back at them
+          uint32_t nodesWithoutFingers;
+          uint32_t maxFingerAgeMs;
+          uint64_t totalFingerAgeMs;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.U32 (queryId);
+            codec.U32 (nodeCount);
+            codec.U32 (minKeys);
+            codec.U32 (maxKeys);
+            codec.U64 (totalKeys);
+            codec.U32 (inconsistentSuccessors);
+            codec.U32 (nodesWithoutFingers);
+            codec.U32 (maxFingerAgeMs);
+            codec.U64 (totalFingerAgeMs);
+          }
+        };
+    struct ChordLookup
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload
+          std::string lookupKey;
+          Ipv4Address originatorAddress;
+          uint32_t originatorTransId;
+          uint8_t hopCount;
+          uint8_t crossDomainHops;
+          uint8_t ownerProbe;       // receiver is asked whether it owns lookupKey
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.Id (lookupKey);
+            codec.Address (originatorAddress);
+            codec.U32 (originatorTransId);
+            codec.U8 (hopCount);
+            codec.U8 (crossDomainHops);
+            codec.U8 (ownerProbe);
+          }
+        };
+    struct ChordLookupRsp
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload
+          std::string lookupKey;
+          std::string ownerID;
+          Ipv4Address ownerAddress;
+          uint32_t originatorTransId;
+          uint8_t hopCount;
+          uint8_t crossDomainHops;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.Id (lookupKey);
+            codec.Id (ownerID);
+            codec.Address (ownerAddress);
+            codec.U32 (originatorTransId);
+            codec.U8 (hopCount);
+            codec.U8 (crossDomainHops);
+          }
+        };
+    struct ExploreReq
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload
+          std::string targetID;
+          uint8_t maxEntries;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.Id (targetID);
+            codec.U8 (maxEntries);
+          }
+        };
+    struct ExploreRsp
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload: nodes following targetID, IDs are derived from the addresses
+          std::vector<Ipv4Address> entries;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.AddressList (entries, sizeof (uint8_t));
+          }
+        };
+    struct FingerListReq
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+
+          template <typename Codec>
+          void Fields (Codec &codec) {}
+        };
+    struct FingerListRsp
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload: sender's fingers, IDs are derived from the addresses
+          std::vector<Ipv4Address> fingers;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.AddressList (fingers, sizeof (uint8_t));
+          }
+        };
+    struct SizeEstimateReq
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload
+          uint32_t networkSize;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.U32 (networkSize);
+          }
+        };
+    struct SizeEstimateRsp
+        {
+          void Print (std::ostream &os) const;
+          WIRE_CODEC_METHODS
+          //Payload
+          uint32_t networkSize;
+
+          template <typename Codec>
+          void Fields (Codec &codec)
+          {
+            codec.U32 (networkSize);
+          }
         };
 
 
 
   private:
-    struct
-      {
-        PingReq pingReq;
-        PingRsp pingRsp;
-        ChordJoin joinMessage;
-        ChordJoinRsp joinResponse;
-        RingState rs;
-        StableReq stableMessage;
-        StableRsp stableResponse;
-        SetPred setPredMessage;
-        Notify notifyMessage;
-        ChordLeave leaveMessage;
-        FingerReq fingerReq;
-        FingerRsp fingerRsp;
-      } m_message;
+    TaggedPayload m_payload;
     
   public:
     /**
      *  \returns PingReq Struct
      */
-    PingReq GetPingReq ();
+    const PingReq& GetPingReq () const;
 
     /**
      *  \brief Sets PingReq message params
@@ -251,7 +577,7 @@ class GUChordMessage : public Header
     /**
      * \returns PingRsp Struct
      */
-    PingRsp GetPingRsp ();
+    const PingRsp& GetPingRsp () const;
     /**
      *  \brief Sets PingRsp message params
      *  \param message Payload String
@@ -260,46 +586,86 @@ class GUChordMessage : public Header
 
     //Get & Set for ChordJoin
     
-    ChordJoin GetChordJoin ();
+    const ChordJoin& GetChordJoin () const;
    
-    void SetChordJoin (std::string rqID, std::string lmID, Ipv4Address originAddr, Ipv4Address landmarkAddr);
+    void SetChordJoin (std::string rqID, std::string lmID, Ipv4Address originAddr, Ipv4Address landmarkAddr, uint8_t maxWireVersion, uint8_t hopCount);
 
-    ChordJoinRsp GetChordJoinRsp ();
+    const ChordJoinRsp& GetChordJoinRsp () const;
     
-    void SetChordJoinRsp (std::string succVal, Ipv4Address succ);
+    void SetChordJoinRsp (std::string succVal, Ipv4Address succ, uint8_t maxWireVersion);
         
-    RingState GetRingState ();
+    const RingState& GetRingState () const;
         
     void SetRingState (std::string origin);
    
-    StableReq GetStableReq ();
+    const StableReq& GetStableReq () const;
 
     void SetStableReq ();
 
-    StableRsp GetStableRsp ();
+    const StableRsp& GetStableRsp () const;
 
     void SetStableRsp (std::string predId, Ipv4Address predIp);
 
-    SetPred GetSetPred ();
+    const SetPred& GetSetPred () const;
     
     void SetSetPred (std::string newPredId, Ipv4Address newPredIp);
 
-    Notify GetNotify ();
+    const Notify& GetNotify () const;
         
     void SetNotify (std::string potPredId, Ipv4Address potPredIp);
 
-    ChordLeave GetChordLeave ();
+    const ChordLeave& GetChordLeave () const;
         
     void SetChordLeave (Ipv4Address successor, Ipv4Address predecessor, std::string sId, std::string pId);
 
-    FingerReq GetFingerReq ();
+    const FingerReq& GetFingerReq () const;
         
-    void SetFingerReq (std::vector<std::string> testIds, std::vector<std::string> fingerEntries, std::vector<Ipv4Address> fingerIP, Ipv4Address originator);
+    // Vector arguments of the setters below are swapped in and left empty
+    void SetFingerReq (std::vector<std::string> &testIds, std::vector<std::string> &fingerEntries, std::vector<Ipv4Address> &fingerIP, Ipv4Address originator, uint8_t hopCount);
 
-    FingerRsp GetFingerRsp ();
+    const FingerRsp& GetFingerRsp () const;
         
-    void SetFingerRsp (std::vector<std::string> fingerNum, std::vector<Ipv4Address> fingerAddr);
-    
+    void SetFingerRsp (std::vector<std::string> &fingerNum, std::vector<Ipv4Address> &fingerAddr);
+
+    const RingAggReq& GetRingAggReq () const;
+
+    void SetRingAggReq (uint32_t queryId, uint32_t timeoutMs, std::string limitId);
+
+    const RingAggRsp& GetRingAggRsp () const;
+
+    void SetRingAggRsp (RingAggRsp summary);
+
+    const ChordLookup& GetChordLookup () const;
+
+    void SetChordLookup (ChordLookup lookup);
+
+    const ChordLookupRsp& GetChordLookupRsp () const;
+
+    void SetChordLookupRsp (ChordLookupRsp response);
+
+    const ExploreReq& GetExploreReq () const;
+
+    void SetExploreReq (std::string targetId, uint8_t maxEntries);
+
+    const ExploreRsp& GetExploreRsp () const;
+
+    void SetExploreRsp (std::vector<Ipv4Address> &entries);
+
+    const FingerListReq& GetFingerListReq () const;
+
+    void SetFingerListReq ();
+
+    const FingerListRsp& GetFingerListRsp () const;
+
+    void SetFingerListRsp (std::vector<Ipv4Address> &fingers);
+
+    const SizeEstimateReq& GetSizeEstimateReq () const;
+
+    void SetSizeEstimateReq (uint32_t networkSize);
+
+    const SizeEstimateRsp& GetSizeEstimateRsp () const;
+
+    void SetSizeEstimateRsp (uint32_t networkSize);
 
 
 
@@ -24,20 +24,30 @@
 #include <openssl/sha.h>
 #include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string>
 #include <sstream>
 #include <iostream>
 
 #define M_VALUE 4
+#define MAX_LOOKUP_HOPS 64
+#define EXPLORE_ENTRIES 8
+#define UDP_IP_OVERHEAD 28
+#define ID_BITS 160
+#define SIZE_SAMPLE_PEERS 8
+#define SIZE_SAMPLE_GAP_RATIO 4 //a gap this many times the mean so far is taken as nodes we don't know
+#define RING_AGG_HOP_MS 100     //time a RINGSTATE subtree leaves its parent to pass a summary up one hop
 
 using namespace ns3;
 
+NS_OBJECT_ENSURE_REGISTERED (GUChord);
+
 TypeId
 GUChord::GetTypeId ()
 {
   static TypeId tid = TypeId ("GUChord")
-    .SetParent<GUApplication> ()
+    .SetParent<GUOverlay> ()
     .AddConstructor<GUChord> ()
     .AddAttribute ("AppPort",
                    "Listening port for Application",
@@ -59,6 +69,76 @@ GUChord::GetTypeId ()
                  TimeValue (MilliSeconds (20000)),
                  MakeTimeAccessor (&GUChord::m_fixFingerTimeout),
                  MakeTimeChecker ())
+    .AddAttribute ("RingStateTimeout",
+                 "Time the RINGSTATE aggregation root waits for its subtrees in milliseconds",
+                 TimeValue (MilliSeconds (2000)),
+                 MakeTimeAccessor (&GUChord::m_ringAggTimeout),
+                 MakeTimeChecker ())
+    .AddAttribute ("Domain",
+                 "Hierarchical location of this node, outermost first (e.g. \"site1/rack2\"). Lookups prefer hops inside the deepest shared domain",
+                 StringValue (""),
+                 MakeStringAccessor (&GUChord::m_domain),
+                 MakeStringChecker ())
+    .AddAttribute ("MaxCrossDomainHops",
+                 "Hops a lookup may take out of the forwarding node's domain before the node answers with its successor as the best owner it knows. 0 for no limit",
+                 UintegerValue (0),
+                 MakeUintegerAccessor (&GUChord::m_maxCrossDomainHops),
+                 MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("AdaptiveRoutingTable",
+                 "Size the routing table by MaintenanceBudget instead of keeping every peer seen",
+                 BooleanValue (false),
+                 MakeBooleanAccessor (&GUChord::m_adaptiveRoutingTable),
+                 MakeBooleanChecker ())
+    .AddAttribute ("MaintenanceBudget",
+                 "Bytes per second this node may spend exploring for routing entries",
+                 UintegerValue (200),
+                 MakeUintegerAccessor (&GUChord::m_maintenanceBudget),
+                 MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("ExploreInterval",
+                 "Interval between routing table exploration attempts in milliseconds",
+                 TimeValue (MilliSeconds (1000)),
+                 MakeTimeAccessor (&GUChord::m_exploreInterval),
+                 MakeTimeChecker ())
+    .AddAttribute ("PeerTimeout",
+                 "Routing entries not heard from within this time are evicted, in milliseconds",
+                 TimeValue (MilliSeconds (60000)),
+                 MakeTimeAccessor (&GUChord::m_peerTimeout),
+                 MakeTimeChecker ())
+    .AddAttribute ("MinRoutingEntries",
+                 "Routing table size kept regardless of budget",
+                 UintegerValue (16),
+                 MakeUintegerAccessor (&GUChord::m_minRoutingEntries),
+                 MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("NeighborOfNeighborRouting",
+                 "Fetch fingers' finger lists and route greedily with two-hop lookahead",
+                 BooleanValue (false),
+                 MakeBooleanAccessor (&GUChord::m_neighborOfNeighbor),
+                 MakeBooleanChecker ())
+    .AddAttribute ("SizeEstimateInterval",
+                 "Interval between network size gossip rounds in milliseconds",
+                 TimeValue (MilliSeconds (5000)),
+                 MakeTimeAccessor (&GUChord::m_sizeEstimateInterval),
+                 MakeTimeChecker ())
+    .AddAttribute ("ScaleWithNetworkSize",
+                 "Derive the routing table floor and finger list refresh rate from the network size estimate",
+                 BooleanValue (false),
+                 MakeBooleanAccessor (&GUChord::m_scaleWithNetworkSize),
+                 MakeBooleanChecker ())
+    .AddAttribute ("CoalesceWindow",
+                 "Time messages to the same destination are held to share a datagram, in milliseconds. 0 coalesces within one event only",
+                 TimeValue (MilliSeconds (0)),
+                 MakeTimeAccessor (&GUChord::m_coalesceWindow),
+                 MakeTimeChecker ())
+    .AddAttribute ("MaxDatagramSize",
+                 "Coalesced datagrams are sent early once they reach this many bytes",
+                 UintegerValue (1400),
+                 MakeUintegerAccessor (&GUChord::m_maxDatagramSize),
+                 MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("WireVersion",
+                 "Highest wire format this node speaks. Each peer is sent the lower of this and its own, learned at join",
+                 UintegerValue (WIRE_VERSION_2),
+                 MakeUintegerAccessor (&GUChord::m_wireVersion),
+                 MakeUintegerChecker<uint8_t> (WIRE_VERSION_1, WIRE_VERSION_2))
 
     ;
   return tid;
@@ -67,10 +147,7 @@ GUChord::GetTypeId ()
 GUChord::GUChord ()
   : m_auditPingsTimer (Timer::CANCEL_ON_DESTROY)
 {
-  RandomVariable random;
   SeedManager::SetSeed (time (NULL));
-  random = UniformVariable (0x00000000, 0xFFFFFFFF);
-  m_currentTransactionId = random.GetInteger ();
 }
 
 GUChord::~GUChord ()
@@ -88,19 +165,27 @@ GUChord::DoDispose ()
 void
 GUChord::StartApplication (void)
 {
-  if (m_socket == 0)
-    { 
-      TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
-      m_socket = Socket::CreateSocket (GetNode (), tid);
-      InetSocketAddress local = InetSocketAddress (Ipv4Address::GetAny(), m_appPort);
-      m_socket->Bind (local);
-      m_socket->SetRecvCallback (MakeCallback (&GUChord::RecvMessage, this));
+  AttachTransport (m_appPort, MakeCallback (&GUChord::HandleMessage, this));
+  // A shared endpoint is configured by the application that owns it
+  if (m_ownsTransport)
+    {
+      m_transport->SetWindow (m_coalesceWindow);
+      m_transport->SetMaxDatagramSize (m_maxDatagramSize);
     }
 
    
    
    m_mainAddress = GetMainInterface();
    m_chordIdentifier = getNodeID(m_mainAddress);
+   m_messageTemplates.clear();
+
+   m_domainLevels.clear();
+   std::istringstream domainStream (m_domain);
+   std::string level;
+   while( std::getline(domainStream, level, '/') ){
+        if( level != "" )
+                m_domainLevels.push_back(level);
+   }
    predecessor = "";
    m_predecessor = ReverseLookup(predIP);
 
@@ -118,27 +203,49 @@ GUChord::StartApplication (void)
   m_auditPingsTimer.SetFunction (&GUChord::AuditPings, this);
   m_sendStableTimer.SetFunction (&GUChord::startSendingStableReq, this);
   m_fixFingerTimer.SetFunction (&GUChord::startSendingFixFinger, this);
+  m_exploreTimer.SetFunction (&GUChord::Explore, this);
+  m_peerExpiryTimer.SetFunction (&GUChord::ExpirePeers, this);
+  m_sizeEstimateTimer.SetFunction (&GUChord::UpdateSizeEstimate, this);
   // Start timers
   m_auditPingsTimer.Schedule (m_pingTimeout);
   m_sendStableTimer.Schedule (m_sendStableTimeout);
   m_fixFingerTimer.Schedule (m_fixFingerTimeout);
+  m_peerExpiryTimer.Schedule (m_peerTimeout);
+  m_sizeEstimate = 0;
+  if (m_scaleWithNetworkSize)
+    {
+      m_sizeEstimateTimer.Schedule (m_sizeEstimateInterval);
+    }
+  if (m_adaptiveRoutingTable)
+    {
+      m_budgetTokens = 0;
+      m_budgetRefillTime = Simulator::Now ();
+      m_exploreTimer.Schedule (m_exploreInterval);
+    }
 }
 
 void
 GUChord::StopApplication (void)
 {
-  // Close socket
-  if (m_socket)
-    {
-      m_socket->Close ();
-      m_socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
-      m_socket = 0;
-    }
+  DetachTransport ();
 
   // Cancel timers
   m_auditPingsTimer.Cancel ();
+  m_fixFingerTimer.Cancel ();
+  m_exploreTimer.Cancel ();
+  m_peerExpiryTimer.Cancel ();
+  m_sizeEstimateTimer.Cancel ();
 
   m_pingTracker.clear ();
+  m_peerTable.clear ();
+  m_neighborFingers.clear ();
+
+  std::map<uint32_t, RingAggState>::iterator iter;
+  for (iter = m_ringAggTracker.begin (); iter != m_ringAggTracker.end (); iter++)
+    {
+      iter->second.timeoutEvent.Cancel ();
+    }
+  m_ringAggTracker.clear ();
 }
 
 /***********************************************************************************/
@@ -163,6 +270,15 @@ GUChord::startSendingFixFinger(){
         //SendFingerReq(succIP, fingerTestVals, fentry, faddress, m_mainAddress);
         //m_fixFingerTimer.Schedule (m_fixFingerTimeout);
 
+        if( m_neighborOfNeighbor ){
+                RefreshNeighborFingers();
+                // one list per round: with scaling, every finger's list is renewed once per timeout
+                if( m_scaleWithNetworkSize )
+                        m_fixFingerTimer.Schedule (MilliSeconds (m_fixFingerTimeout.GetMilliSeconds () / GetLogNetworkSize()));
+                else
+                        m_fixFingerTimer.Schedule (m_fixFingerTimeout);
+        }
+
 }
 void
 GUChord::ProcessCommand (std::vector<std::string> tokens)
@@ -192,22 +308,14 @@ GUChord::ProcessCommand (std::vector<std::string> tokens)
       sd >> str;
 
       if( thisNodeNum == str ){
-                SetSelfToLandmark();
+                Join(m_mainAddress);
       }else{
-                Ipv4Address lndmrkIP = ResolveNodeIpAddress(str);
-                std::cout<<"landmarkIP: "<<lndmrkIP<<std::endl;
-                std::string lndmrkID = "notset";                
-                SendJoinRequest(lndmrkIP, m_mainAddress, m_chordIdentifier, lndmrkIP, lndmrkID);
+                Join(ResolveNodeIpAddress(str));
       }
       
   }else if (command == "LEAVE"){
 
-      //send leave requests to successor and predecessor
-      std::cout<<"LEAVE successor = "<<successor<<std::endl;
-      std::cout<<"LEAVE predecessor = "<<predecessor<<std::endl;
-      
-      SendLeaveRequest(succIP, succIP, predIP, successor, predecessor);    
-      SendLeaveRequest(predIP, succIP, predIP, successor, predecessor);
+      Leave();
 
   }else if (command == "RINGSTATE"){
 
@@ -215,10 +323,17 @@ GUChord::ProcessCommand (std::vector<std::string> tokens)
 
         CHORD_LOG ("Network Node: " << ReverseLookup(GetMainInterface()) << " Node ID: " << m_chordIdentifier << " Successor: " << successor << " Predecessor: " << predecessor );
 
-        SendRingStateMessage(succIP, m_chordIdentifier);
+        StartRingAggregation();
   }else if (command == "STABILIZE"){
                 SendStableReq(succIP);
                 
+  }else if (command == "NETSIZE"){
+
+        // without ScaleWithNetworkSize nothing gossips until the estimate is first asked for
+        if( !m_sizeEstimateTimer.IsRunning() )
+                UpdateSizeEstimate();
+        CHORD_LOG ("Network Node: " << ReverseLookup(GetMainInterface()) << " Estimated network size: " << GetNetworkSizeEstimate() << " (local sample: " << GetLocalSizeEstimate() << ")");
+
   }else if (command == "FINGER"){
 
         std::cout<<"\nNode "<<m_chordIdentifier<<": "<<std::endl;
@@ -228,6 +343,56 @@ GUChord::ProcessCommand (std::vector<std::string> tokens)
   }
 
 }
+void
+GUChord::Join (Ipv4Address landmarkAddress){
+
+        if( landmarkAddress == m_mainAddress ){
+                SetSelfToLandmark();
+        }else{
+                std::cout<<"landmarkIP: "<<landmarkAddress<<std::endl;
+                // an unset landmark ID asks the landmark to place us
+                std::string lndmrkID = "";
+                SendJoinRequest(landmarkAddress, m_mainAddress, m_chordIdentifier, landmarkAddress, lndmrkID, m_wireVersion, 0);
+        }
+}
+
+void
+GUChord::Leave (){
+
+        //send leave requests to successor and predecessor
+        std::cout<<"LEAVE successor = "<<successor<<std::endl;
+        std::cout<<"LEAVE predecessor = "<<predecessor<<std::endl;
+      
+        SendLeaveRequest(succIP, succIP, predIP, successor, predecessor);    
+        SendLeaveRequest(predIP, succIP, predIP, successor, predecessor);
+
+        // our keys now belong to the successor
+        if( successor != "" && successor != m_chordIdentifier && !m_leaveFn.IsNull () ){
+                uint32_t successorNum;
+                std::istringstream sin (ReverseLookup(succIP));
+                sin >> successorNum;
+                m_leaveFn (succIP, successorNum);
+        }
+}
+
+bool
+GUChord::IsResponsibleFor (std::string lookupKey){
+
+        if( predecessor == "" || predecessor == m_chordIdentifier )
+                return true;
+        return lookupKey == m_chordIdentifier || IsInInterval(lookupKey, predecessor, m_chordIdentifier);
+}
+
+bool
+GUChord::GetHandoverTarget (std::string newcomerId, Ipv4Address newcomerAddress, std::string lookupKey, Ipv4Address &target){
+
+        // a new predecessor takes exactly the keys we stop owning
+        if( IsResponsibleFor(lookupKey) )
+                return false;
+        target = newcomerAddress;
+        return true;
+}
+
 void
 GUChord::setMaxHash(){
  
@@ -306,6 +471,18 @@ GUChord::getFingerBound( Ipv4Address addr, uint32_t i ){
         
 }
 
+//True if key lies strictly inside the clockwise ring interval (start, end).
+//start == end denotes the whole ring except start itself.
+bool
+GUChord::IsInInterval(std::string key, std::string start, std::string end){
+
+        if( start < end )
+                return key > start && key < end;
+        if( start > end )
+                return key > start || key < end;
+        return key != start;
+}
+
 //Set local node to be landmark node by changing boolean values and succ, predecessor
 void
 GUChord::SetSelfToLandmark(){
@@ -316,7 +493,7 @@ GUChord::SetSelfToLandmark(){
 
 //Send a Join Message to attempt to join a Chord Network
 void
-GUChord::SendJoinRequest( Ipv4Address destAddress, Ipv4Address srcAddress, std::string srcId, Ipv4Address landmarkAddress, std::string landmarkId )
+GUChord::SendJoinRequest( Ipv4Address destAddress, Ipv4Address srcAddress, std::string srcId, Ipv4Address landmarkAddress, std::string landmarkId, uint8_t srcWireVersion, uint8_t hopCount )
 {
 
 if (destAddress != Ipv4Address::GetAny ())
@@ -325,11 +502,9 @@ if (destAddress != Ipv4Address::GetAny ())
       uint32_t transactionId = GetNextTransactionId ();
       CHORD_LOG ("Sending CHORD_JOIN to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId << "Node ID: "<<m_chordIdentifier);
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::CHORD_JOIN, transactionId);
-      message.SetChordJoin ( srcId, landmarkId, srcAddress, landmarkAddress);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      message.SetChordJoin ( srcId, landmarkId, srcAddress, landmarkAddress, srcWireVersion, hopCount);
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -347,12 +522,10 @@ GUChord::SendJoinResponse(Ipv4Address destAddress, Ipv4Address succ, std::string
       uint32_t transactionId = GetNextTransactionId ();
       CHORD_LOG ("Sending CHORD_JOIN_RSP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId << " Node ID: "<<m_chordIdentifier);
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::CHORD_JOIN_RSP, transactionId);
       
-      message.SetChordJoinRsp (newSuccessor, succ);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      message.SetChordJoinRsp (newSuccessor, succ, m_wireVersion);
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -371,12 +544,10 @@ GUChord::SendRingStateMessage(Ipv4Address destAddress, std::string srcNodeID){
       //CHORD_LOG ("Sending RING_STATE to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::RING_STATE, transactionId);
       
       message.SetRingState (srcNodeID);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -395,12 +566,7 @@ GUChord::SendStableReq(Ipv4Address destAddress){
       //CHORD_LOG ("Sending STABLE_REQ to Node: " << ReverseLookup(succIP) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
-      GUChordMessage message = GUChordMessage (GUChordMessage::STABLE_REQ, transactionId);
-      
-      message.SetStableReq ();
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendFromTemplate (destAddress, GUChordMessage::STABLE_REQ, transactionId);
     }
   else
     {
@@ -419,12 +585,10 @@ GUChord::SendStableRsp(Ipv4Address destAddress, std::string predecessorId, Ipv4A
         //std::cout<<"Sending STABLE_RSP"<<std::endl;
       
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::STABLE_RSP, transactionId);
       
       message.SetStableRsp (predecessorId, predecessorIp);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -443,12 +607,10 @@ GUChord::SendSetPred(Ipv4Address destAddress, std::string ndId, Ipv4Address ndAd
       //CHORD_LOG ("Sending SET_PRED to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::SET_PRED, transactionId);
       
       message.SetSetPred (ndId, ndAddr);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -467,12 +629,15 @@ GUChord::SendNotify(Ipv4Address destAddress, std::string ndId, Ipv4Address ndAdd
       //CHORD_LOG ("Sending NOTIFY to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
+      // Notifying about ourselves is the periodic case and never changes
+      if( ndId == m_chordIdentifier && ndAddr == m_mainAddress ){
+                SendFromTemplate (destAddress, GUChordMessage::NOTIFY, transactionId);
+                return;
+      }
       GUChordMessage message = GUChordMessage (GUChordMessage::NOTIFY, transactionId);
       
       message.SetNotify (ndId, ndAddr);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -492,12 +657,10 @@ if (destAddress != Ipv4Address::GetAny ())
       //CHORD_LOG ("Sending CHORD_LEAVE to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::CHORD_LEAVE, transactionId);
       
       message.SetChordLeave (sucIp, predIp, succ, pred);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -509,7 +672,7 @@ if (destAddress != Ipv4Address::GetAny ())
 }
 
 void
-GUChord::SendFingerReq(Ipv4Address destAddress, std::vector<std::string> testIds, std::vector<std::string> fingerEntries, std::vector<Ipv4Address> fingerIP, Ipv4Address originator){
+GUChord::SendFingerReq(Ipv4Address destAddress, std::vector<std::string> &testIds, std::vector<std::string> &fingerEntries, std::vector<Ipv4Address> &fingerIP, Ipv4Address originator, uint8_t hopCount){
 
         if (destAddress != Ipv4Address::GetAny ())
     {
@@ -517,12 +680,10 @@ GUChord::SendFingerReq(Ipv4Address destAddress, std::vector<std::string> testIds
       //CHORD_LOG ("Sending FINGER_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::FINGERME_REQ, transactionId);
       
-      message.SetFingerReq (testIds, fingerEntries, fingerIP, originator);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      message.SetFingerReq (testIds, fingerEntries, fingerIP, originator, hopCount);
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -532,7 +693,7 @@ GUChord::SendFingerReq(Ipv4Address destAddress, std::vector<std::string> testIds
 
 }
 void
-GUChord::SendFingerRsp(Ipv4Address destAddress, std::vector<std::string> fingerNum, std::vector<Ipv4Address> fingerAddr){
+GUChord::SendFingerRsp(Ipv4Address destAddress, std::vector<std::string> &fingerNum, std::vector<Ipv4Address> &fingerAddr){
 
         if (destAddress != Ipv4Address::GetAny ())
     {
@@ -540,12 +701,10 @@ GUChord::SendFingerRsp(Ipv4Address destAddress, std::vector<std::string> fingerN
       //CHORD_LOG ("Sending FINGER RSP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
       
       
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::FINGERME_RSP, transactionId);
       
       message.SetFingerRsp (fingerNum, fingerAddr);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -555,176 +714,286 @@ GUChord::SendFingerRsp(Ipv4Address destAddress, std::vector<std::string> fingerN
 
 }
 
+void
+GUChord::SendRingAggReq(Ipv4Address destAddress, uint32_t queryId, uint32_t timeoutMs, std::string limitId){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending RING_AGG_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::RING_AGG_REQ, transactionId);
+
+      message.SetRingAggReq (queryId, timeoutMs, limitId);
+      SendMessage (destAddress, m_appPort, message);
+    }
+  else
+    {
+      // Report failure
+      std::cout<<"RING AGG REQUEST FAILED" <<std::endl;
+    }
+}
+
+void
+GUChord::SendRingAggRsp(Ipv4Address destAddress, GUChordMessage::RingAggRsp summary){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending RING_AGG_RSP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::RING_AGG_RSP, transactionId);
+
+      message.SetRingAggRsp (summary);
+      SendMessage (destAddress, m_appPort, message);
+    }
+  else
+    {
+      // Report failure
+      std::cout<<"RING AGG RESPONSE FAILED" <<std::endl;
+    }
+}
+
 void 
-GUChord::SendChordLookup (std::string lookupKey, uint32_t transId){
+GUChord::Lookup (std::string lookupKey, uint32_t transId){
 
+        GUChordMessage::ChordLookup lookup;
+        lookup.lookupKey = lookupKey;
+        lookup.originatorAddress = m_mainAddress;
+        lookup.originatorTransId = transId;
+        lookup.hopCount = 0;
+        lookup.crossDomainHops = 0;
+        lookup.ownerProbe = 0;
+
+        RouteLookup(lookup);
+}
 
+void
+GUChord::SendMessage (Ipv4Address destAddress, uint16_t destPort, GUChordMessage &message)
+{
+  message.SetSenderDomain (m_domain);
+  message.SetWireVersion (GetPeerWireVersion (destAddress));
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (message);
+  m_transport->Send (GUTransport::OVERLAY_LAYER, packet, destAddress, destPort);
+}
 
+void
+GUChord::SendFromTemplate (Ipv4Address destAddress, GUChordMessage::MessageType messageType, uint32_t transactionId)
+{
+  uint8_t wireVersion = GetPeerWireVersion (destAddress);
+  std::vector<uint8_t> &bytes = m_messageTemplates[(messageType << 8) | wireVersion];
+  if (bytes.empty ())
+    {
+      GUChordMessage message = GUChordMessage (messageType, transactionId);
+      switch (messageType)
+        {
+          case GUChordMessage::STABLE_REQ:
+            message.SetStableReq ();
+            break;
+          case GUChordMessage::NOTIFY:
+            message.SetNotify (m_chordIdentifier, m_mainAddress);
+            break;
+          case GUChordMessage::FINGER_LIST_REQ:
+            message.SetFingerListReq ();
+            break;
+          default:
+            NS_ASSERT (false);
+        }
+      message.SetSenderDomain (m_domain);
+      message.SetWireVersion (wireVersion);
+      Ptr<Packet> packet = Create<Packet> ();
+      packet->AddHeader (message);
+      bytes.resize (packet->GetSize ());
+      packet->CopyData (&bytes[0], bytes.size ());
+    }
 
+  // Transaction id follows the type byte, in network order
+  bytes[1] = (transactionId >> 24) & 0xff;
+  bytes[2] = (transactionId >> 16) & 0xff;
+  bytes[3] = (transactionId >> 8) & 0xff;
+  bytes[4] = transactionId & 0xff;
+  m_transport->Send (GUTransport::OVERLAY_LAYER, Create<Packet> (&bytes[0], bytes.size ()), destAddress, m_appPort);
 }
 
 void
-GUChord::RecvMessage (Ptr<Socket> socket)
+GUChord::HandleMessage (Ptr<Packet> packet, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
-  Address sourceAddr;
-  Ptr<Packet> packet = socket->RecvFrom (sourceAddr);
-  InetSocketAddress inetSocketAddr = InetSocketAddress::ConvertFrom (sourceAddr);
-  Ipv4Address sourceAddress = inetSocketAddr.GetIpv4 ();
-  uint16_t sourcePort = inetSocketAddr.GetPort ();
+  // Read the routing header first: messages we only pass on keep their payload undecoded
+  GUChordMessage route;
+  route.SetRouteOnly (true);
+  uint32_t routeSize = packet->PeekHeader (route);
+
+  LearnPeer (sourceAddress, route.GetSenderDomain ());
+  NotePeerWireVersion (sourceAddress, route.GetWireVersion ());
+  if (GUChordMessage::IsRelayed (route.GetMessageType ()) && RelayMessage (route, packet, routeSize))
+    {
+      return;
+    }
+
   GUChordMessage message;
   packet->RemoveHeader (message);
 
-  switch (message.GetMessageType ())
+  static const MessageHandler handlers[] =
+    {
+      0,
+      &GUChord::ProcessPingReq,         // PING_REQ
+      &GUChord::ProcessPingRsp,         // PING_RSP
+      &GUChord::ProcessChordJoin,       // CHORD_JOIN
+      &GUChord::ProcessChordJoinRsp,    // CHORD_JOIN_RSP
+      &GUChord::PrintRingState,         // RING_STATE
+      &GUChord::ProcessStableReq,       // STABLE_REQ
+      &GUChord::ProcessStableRsp,       // STABLE_RSP
+      &GUChord::ProcessSetPred,         // SET_PRED
+      &GUChord::ProcessNotify,          // NOTIFY
+      &GUChord::ProcessChordLeave,      // CHORD_LEAVE
+      &GUChord::ProcessFingerReq,       // FINGERME_REQ
+      &GUChord::ProcessFingerRsp,       // FINGERME_RSP
+      &GUChord::ProcessRingAggReq,      // RING_AGG_REQ
+      &GUChord::ProcessRingAggRsp,      // RING_AGG_RSP
+      &GUChord::ProcessChordLookup,     // CHORD_LOOKUP
+      &GUChord::ProcessChordLookupRsp,  // CHORD_LOOKUP_RSP
+      &GUChord::ProcessExploreReq,      // EXPLORE_REQ
+      &GUChord::ProcessExploreRsp,      // EXPLORE_RSP
+      &GUChord::ProcessFingerListReq,   // FINGER_LIST_REQ
+      &GUChord::ProcessFingerListRsp,   // FINGER_LIST_RSP
+      &GUChord::ProcessSizeEstimateReq, // SIZE_EST_REQ
+      &GUChord::ProcessSizeEstimateRsp, // SIZE_EST_RSP
+    };
+  // fails to compile if a message type is added without a handler
+  typedef char HandlerTableIsComplete[(sizeof (handlers) / sizeof (handlers[0]) == GUChordMessage::SIZE_EST_RSP + 1) ? 1 : -1];
+  (void) sizeof (HandlerTableIsComplete);
+
+  uint32_t messageType = message.GetMessageType ();
+  if (messageType == 0 || messageType >= sizeof (handlers) / sizeof (handlers[0]))
+    {
+      ERROR_LOG ("Unknown Message Type!");
+      return;
+    }
+  (this->*handlers[messageType]) (message, sourceAddress, sourcePort);
+}
+
+bool
+GUChord::RelayMessage (GUChordMessage &route, Ptr<Packet> packet, uint32_t routeSize)
+{
+  Ipv4Address nextHop;
+  switch (route.GetMessageType ())
     {
-      case GUChordMessage::PING_REQ:
-        ProcessPingReq (message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::PING_RSP:
-        ProcessPingRsp (message, sourceAddress, sourcePort);
-        break;
       case GUChordMessage::CHORD_JOIN:
-        ProcessChordJoin(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::CHORD_JOIN_RSP:
-        ProcessChordJoinRsp(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::RING_STATE:
-        PrintRingState(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::STABLE_REQ:
-        ProcessStableReq(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::STABLE_RSP:
-        ProcessStableRsp(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::SET_PRED:
-        ProcessSetPred(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::NOTIFY:
-        ProcessNotify(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::CHORD_LEAVE:
-        ProcessChordLeave(message, sourceAddress, sourcePort);
-        break;
+        {
+          const GUChordMessage::ChordJoin &join = route.GetChordJoin ();
+          // joins that get placed here, or that pick us as their landmark, need the full message
+          if (!PassesJoinOn (join.requesterID, join.landmarkID) || (join.landmarkID == "" && m_mainAddress != succIP))
+            {
+              return false;
+            }
+          LearnPeerAddress (join.originatorAddress);
+          NotePeerWireVersion (join.originatorAddress, join.maxWireVersion);
+          nextHop = succIP;
+          break;
+        }
       case GUChordMessage::FINGERME_REQ:
-        ProcessFingerReq(message, sourceAddress, sourcePort);
-        break;
-      case GUChordMessage::FINGERME_RSP:
-        ProcessFingerRsp(message, sourceAddress, sourcePort);
-        break;
+        {
+          const GUChordMessage::FingerReq &request = route.GetFingerReq ();
+          // answering, or adding a finger to the lists, needs the full message
+          if (succIP == request.originatorNode || request.targetID == "" || ResolvesFingerTarget (request.targetID))
+            {
+              return false;
+            }
+          nextHop = succIP;
+          break;
+        }
       default:
-        ERROR_LOG ("Unknown Message Type!");
-        break;
+        return false;
+    }
+  // The payload stays in the wire format it arrived in, which the next hop must read
+  if (route.GetWireVersion () > GetPeerWireVersion (nextHop))
+    {
+      return false;
     }
+
+  packet->RemoveAtStart (routeSize);
+  route.SetHopCount (route.GetHopCount () + 1);
+  route.SetSenderDomain (m_domain);
+  packet->AddHeader (route);
+  m_transport->Send (GUTransport::OVERLAY_LAYER, packet, nextHop, m_appPort);
+  return true;
 }
 
 void    
-GUChord::ProcessChordJoin (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort)
+GUChord::ProcessChordJoin (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
 
-        std::string messageNodeID = message.GetChordJoin().requesterID;
-        std::string landmID = message.GetChordJoin().landmarkID;
-        Ipv4Address originAddress = message.GetChordJoin().originatorAddress;
-        Ipv4Address landmarkIP = message.GetChordJoin().landmarkAddress;
+        const GUChordMessage::ChordJoin &join = message.GetChordJoin();
+        const std::string &messageNodeID = join.requesterID;
+        const std::string &landmID = join.landmarkID;
+        Ipv4Address originAddress = join.originatorAddress;
+        Ipv4Address landmarkIP = join.landmarkAddress;
+        uint8_t originWireVersion = join.maxWireVersion;
+
+        // Remember what the joining node speaks so our replies to it can use it
+        LearnPeerAddress(originAddress);
+        NotePeerWireVersion(originAddress, originWireVersion);
 
         CHORD_LOG ("Received JOIN_REQ from Node: " << ReverseLookup(sourceAddress) << "Message Node ID: "<<messageNodeID <<" IP: " << m_mainAddress << "Node ID: "<<m_chordIdentifier);
  
         std::cout<<"Recieved join request message with messageNodeID: "<< messageNodeID << "mainAddress: " << m_mainAddress << " originAddress: "<< originAddress << " node ID: "<< m_chordIdentifier << " Successor: " << successor << " Pred: " << predecessor << std::endl;
-        
-
-        if( landmID == "notset" && m_mainAddress != succIP ){
-                std::cout<<"LMID NOT SET"<<std::endl;
-                //SendJoinRequest(succIP, originAddress, messageNodeID, m_mainAddress, m_chordIdentifier);
 
-                if( m_chordIdentifier < successor && messageNodeID > successor ){
-                        //std::cout<<"non-wraparound case. pass node."<<std::endl;
-                        SendJoinRequest(succIP, originAddress, messageNodeID, m_mainAddress, m_chordIdentifier);
-                        
-                }else if( m_chordIdentifier < successor && messageNodeID < successor ){
-                        
-                        //std::cout<<"non-wraparound case. place node."<<std::endl;
-                
-                        SendJoinResponse(originAddress, succIP, successor);
-                        
-                        succIP = originAddress;
-                        successor = messageNodeID;
-                }else if( m_chordIdentifier > successor && messageNodeID > successor ){
-                        //std::cout<<"wraparound case. pass node."<<std::endl;
-        
-                        SendJoinRequest(succIP, originAddress, messageNodeID, m_mainAddress, m_chordIdentifier);
+        if( PassesJoinOn(messageNodeID, landmID) ){
+                if( landmID == "" && m_mainAddress != succIP ){
+                        std::cout<<"LMID NOT SET"<<std::endl;
+                        // first node past the landmark: we become the reference point for the rest of the walk
+                        SendJoinRequest(succIP, originAddress, messageNodeID, m_mainAddress, m_chordIdentifier, originWireVersion, join.hopCount + 1);
                 }else{
-                        //std::cout<<"wraparound case. place node."<<
-                        SendJoinResponse(originAddress, succIP, successor);
-                        
-                        succIP = originAddress;
-                        successor = messageNodeID;
+                        SendJoinRequest(succIP, originAddress, messageNodeID, landmarkIP, landmID, originWireVersion, join.hopCount + 1);
                 }
-                                                       
-        }else if( successor == m_chordIdentifier ){
+        }else{
+                // the node goes between us and our successor
+                if( successor == m_chordIdentifier )
+                        SendJoinResponse(originAddress, m_mainAddress, m_chordIdentifier);
+                else
+                        SendJoinResponse(originAddress, succIP, successor);
 
-                SendJoinResponse(originAddress, m_mainAddress, m_chordIdentifier);
-                
                 succIP = originAddress;
                 successor = messageNodeID;
-
-        } else if( successor == landmID ){
-                
-                if( messageNodeID < successor && m_chordIdentifier < successor ){
-                        
-                        SendJoinResponse(originAddress, succIP, successor);
-                        
-                        succIP = originAddress;
-                        successor = messageNodeID;
- 
-                } else if( messageNodeID > successor && m_chordIdentifier < successor){
-
-                        SendJoinRequest(succIP, originAddress, messageNodeID, landmarkIP, landmID);
-                }else if( messageNodeID > m_chordIdentifier && m_chordIdentifier > successor){
-
-                        SendJoinResponse(originAddress, succIP, successor);
-                        
-                        succIP = originAddress;
-                        successor = messageNodeID;
-                }else{
-                        SendJoinRequest(succIP, originAddress, messageNodeID, landmarkIP, landmID);
-                }
-
-        } else if( successor != landmID ){
-                
-                if( m_chordIdentifier < successor && messageNodeID > successor ){
-                        //std::cout<<"non-wraparound case. pass node."<<std::endl;
-                        SendJoinRequest(succIP, originAddress, messageNodeID, landmarkIP, landmID);
-                        
-                }else if( m_chordIdentifier < successor && messageNodeID < successor ){
-                        
-                        //std::cout<<"non-wraparound case. place node."<<std::endl;
-                
-                        SendJoinResponse(originAddress, succIP, successor);
-                        
-                        succIP = originAddress;
-                        successor = messageNodeID;
-                }else if( m_chordIdentifier > successor && messageNodeID > successor ){
-                        //std::cout<<"wraparound case. pass node."<<std::endl;
-        
-                        SendJoinRequest(succIP, originAddress, messageNodeID, landmarkIP, landmID);
-                }else{
-                        //std::cout<<"wraparound case. place node."<<
-                        SendJoinResponse(originAddress, succIP, successor);
-                        
-                        succIP = originAddress;
-                        successor = messageNodeID;
-                          
-                }     
-
         }
            
 }
+
+//True if a join for messageNodeID is passed on to our successor rather than placed after us
+bool
+GUChord::PassesJoinOn(const std::string &messageNodeID, const std::string &landmID){
+
+        // until a landmark is set the walk starts at our successor whatever it is
+        bool landmarkSet = !(landmID == "" && m_mainAddress != succIP);
+
+        if( landmarkSet && successor == m_chordIdentifier )
+                return false;
+        if( landmarkSet && successor == landmID ){
+                if( messageNodeID < successor && m_chordIdentifier < successor )
+                        return false;
+                else if( messageNodeID > successor && m_chordIdentifier < successor )
+                        return true;
+                else if( messageNodeID > m_chordIdentifier && m_chordIdentifier > successor )
+                        return false;
+                return true;
+        }
+
+        if( m_chordIdentifier < successor )
+                //non-wraparound case
+                return messageNodeID > successor;
+        //wraparound case
+        return m_chordIdentifier > successor && messageNodeID > successor;
+}
+
 void
-GUChord::ProcessChordJoinRsp (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort)
+GUChord::ProcessChordJoinRsp (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
 
         succIP = message.GetChordJoinRsp().successorVal;
         successor = message.GetChordJoinRsp().newSucc;
+        LearnPeerAddress(succIP);
+        NotePeerWireVersion(sourceAddress, message.GetChordJoinRsp().maxWireVersion);
 
         std::vector<std::string> fentry;
         std::vector<Ipv4Address> faddress;
@@ -736,7 +1005,7 @@ GUChord::ProcessChordJoinRsp (GUChordMessage message, Ipv4Address sourceAddress,
 }
 
 void 
-GUChord::PrintRingState(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::PrintRingState(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
         std::string origin = message.GetRingState().originatorNodeID;
 
@@ -752,7 +1021,7 @@ GUChord::PrintRingState(GUChordMessage message, Ipv4Address sourceAddress, uint1
 }
 
 void
-GUChord::ProcessStableReq(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessStableReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
         
         if( sourceAddress != m_mainAddress ){    
@@ -770,10 +1039,12 @@ GUChord::ProcessStableReq(GUChordMessage message, Ipv4Address sourceAddress, uin
 }
 
 void
-GUChord::ProcessStableRsp(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessStableRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
         std::string prdID = message.GetStableRsp().predID;
         Ipv4Address prdIP = message.GetStableRsp().predAddress;
+        m_succPredecessor = prdID;
+        LearnPeerAddress(prdIP);
 
         if( prdID == successor )
                 SendSetPred(succIP, m_chordIdentifier, m_mainAddress);
@@ -799,7 +1070,7 @@ GUChord::ProcessStableRsp(GUChordMessage message, Ipv4Address sourceAddress, uin
 }
 
 void
-GUChord::ProcessSetPred(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessSetPred(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
         //std::cout<<"SetPredRecieved"<<std::endl;
 
         std::string setPredID = message.GetSetPred().newPredID;
@@ -809,13 +1080,15 @@ GUChord::ProcessSetPred(GUChordMessage message, Ipv4Address sourceAddress, uint1
                         
                 predecessor = setPredID;
                 predIP = setPredIP;
+                if( !m_ownershipChangeFn.IsNull () )
+                        m_ownershipChangeFn (predIP, predecessor);
         }
         //std::cout<<"Node ID: "<<m_chordIdentifier<<"\nNew predecessor: "<< predecessor << "  Pred IP: "<<predIP <<std::endl;
 
 }
 
 void
-GUChord::ProcessNotify(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessNotify(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
         std::string messageNodeID = message.GetNotify().potentialPredID;
         Ipv4Address messageNodeIP = message.GetNotify().potentialPredIP;
@@ -823,13 +1096,16 @@ GUChord::ProcessNotify(GUChordMessage message, Ipv4Address sourceAddress, uint16
         
         if( predecessor == "" || messageNodeID > predecessor || (m_chordIdentifier > successor && messageNodeID < predecessor )){
                 //std::cout<<"Predecessor for node: "<<m_chordIdentifier<<" changed to "<<messageNodeID<<std::endl;
+                bool changed = ( messageNodeID != predecessor );
                 predecessor = messageNodeID;                
                 predIP = messageNodeIP;
+                if( changed && !m_ownershipChangeFn.IsNull () )
+                        m_ownershipChangeFn (predIP, predecessor);
         }
 }
 
 void
-GUChord::ProcessChordLeave (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessChordLeave (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
         Ipv4Address predecessorIP = message.GetChordLeave().predecessorAddress;
         Ipv4Address successorIP = message.GetChordLeave().successorAddress;
@@ -837,6 +1113,7 @@ GUChord::ProcessChordLeave (GUChordMessage message, Ipv4Address sourceAddress, u
         std::string successorID = message.GetChordLeave().successorID;
 
         std::cout<<"successor is: "<<successorID<<"  predecessor is: "<<predecessorID<<std::endl;
+        ForgetPeer(sourceAddress);
         if( m_chordIdentifier == successorID ){
                 predecessor = predecessorID;
                 predIP = predecessorIP;
@@ -849,7 +1126,7 @@ GUChord::ProcessChordLeave (GUChordMessage message, Ipv4Address sourceAddress, u
 }
 
 void
-GUChord::ProcessFingerReq(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessFingerReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
         //std::cout<<"Recieved Request."<<std::endl;
         Ipv4Address origin = message.GetFingerReq().originatorNode;
         std::vector<std::string> testIds = message.GetFingerReq().testIdentifiers;
@@ -871,73 +1148,946 @@ GUChord::ProcessFingerReq(GUChordMessage message, Ipv4Address sourceAddress, uin
                         //std::cout <<"ith val: " <<ithvalue <<std::endl;
                         //std::cout <<"node id: " <<m_chordIdentifier <<std::endl;
 
-                        if( m_chordIdentifier < successor ){
-
-                                //std::cout <<"m_chordIdentifier < successor" <<std::endl;
-
-                                /*if( ithvalue <= m_chordIdentifier ){
-                                        testIds.pop_back();
-                                        fingerIds.push_back(m_chordIdentifier);
-                                        fingerAddrs.push_back(m_mainAddress);
-
-                                }else */if( successor >= ithvalue ){
-                                        //std::cout << "ithvalue > m_chordIdentifier && ithvalue <= successor" <<std::endl;
-                                        testIds.pop_back();
-                                        fingerIds.push_back(successor);
-                                        fingerAddrs.push_back(succIP);
-                                }
-
-                        }else if ( m_chordIdentifier > successor ){
-
-                                //std::cout <<"m_chordIdentifier > successor" <<std::endl;
-
-                                /*if( ithvalue <= m_chordIdentifier ){
-                                        testIds.pop_back();
-                                        fingerIds.push_back(m_chordIdentifier);
-                                        fingerAddrs.push_back(m_mainAddress);
-
-                                }*/if( ithvalue > m_chordIdentifier && ithvalue >= successor ){
-                                        //std::cout <<"ithvalue > m_chordIdentifier || ithvalue <= successor" <<std::endl;
-                                        testIds.pop_back();
-                                        //if( fingerIds.size() != M_VALUE ){
-                                                fingerIds.push_back(successor);
-                                                fingerAddrs.push_back(succIP);
-                                        //}
-                                }                                                                
+                        if( ResolvesFingerTarget(ithvalue) ){
+                                testIds.pop_back();
+                                fingerIds.push_back(successor);
+                                fingerAddrs.push_back(succIP);
                         }
 
                         if( testIds.empty() ){
-                                SendFingerRsp(origin, fingerIds, fingerAddrs);
                                 //std::cout<<"Sending Finger Response."<<std::endl;
                                 std::cout<<fingerIds.size()<<std::endl;
                                 for(uint32_t i = 0; i < fingerIds.size(); i++){
                                         std::cout <<"ID # " <<i <<": " <<fingerIds.at(i) <<std::endl;
                                 }
+                                SendFingerRsp(origin, fingerIds, fingerAddrs);
                         }else{
                                 //std::cout <<"still not empty" <<std::endl;
-                                SendFingerReq(succIP, testIds, fingerIds, fingerAddrs, origin);
+                                SendFingerReq(succIP, testIds, fingerIds, fingerAddrs, origin, message.GetFingerReq().hopCount + 1);
                         }
                 }
         }
 }
+
+//True if our successor is the finger for target
+bool
+GUChord::ResolvesFingerTarget(const std::string &target){
+
+        if( m_chordIdentifier < successor )
+                return successor >= target;
+        if( m_chordIdentifier > successor )
+                return target > m_chordIdentifier && target >= successor;
+        return false;
+}
+
 void
-GUChord::ProcessFingerRsp(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUChord::ProcessFingerRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
-        std::vector<std::string> fingerIds = message.GetFingerRsp().fingerID;
-        std::vector<Ipv4Address> fingerAddrs = message.GetFingerRsp().fingerAddress;
+        const std::vector<std::string> &fingerIds = message.GetFingerRsp().fingerID;
+        const std::vector<Ipv4Address> &fingerAddrs = message.GetFingerRsp().fingerAddress;
 
                 for( uint32_t i = 0; i < fingerIds.size(); i++ ){
                         Finger fingEntry;
                         fingEntry.setFinger(fingerIds[i], fingerAddrs[i]);
                         fingerTable.push_back(fingEntry);
+                        LearnPeerAddress(fingerAddrs[i]);
                 }
                 Finger fEntry;
                 fEntry.setFinger(successor, succIP);
                 if( !fingerTable.empty() )
                         fingerTable[0] = fEntry;
+                m_fingerUpdateTime = Simulator::Now();
         
 }
 
+/********************************************************************************************/
+
+// Lookups are routed recursively. Each hop first tries to make progress using
+// peers that share its innermost domain, then widens one level at a time up to
+// the global ring (Canon-style). When no same-domain peer precedes the key, the
+// lookup is handed to the domain's next node after us as an ownership probe;
+// that node answers if it owns the key and otherwise walks back towards it.
+// Keys owned inside the site are therefore resolved without leaving it.
+
+uint32_t
+GUChord::GetCommonDomainDepth(std::string domain){
+
+        uint32_t depth = 0;
+        std::istringstream domainStream (domain);
+        std::string level;
+        while( std::getline(domainStream, level, '/') ){
+                if( level == "" )
+                        continue;
+                if( depth >= m_domainLevels.size() || m_domainLevels[depth] != level )
+                        break;
+                depth++;
+        }
+        return depth;
+}
+
+void
+GUChord::LearnPeer(Ipv4Address address, std::string domain){
+
+        if( address == m_mainAddress || address == Ipv4Address::GetAny () )
+                return;
+
+        ChordPeer &peer = m_peerTable[getNodeID(address)];
+        peer.address = address;
+        peer.domain = domain;
+        peer.domainKnown = true;
+        peer.lastSeen = Simulator::Now ();
+}
+
+void
+GUChord::LearnPeerAddress(Ipv4Address address){
+
+        if( address == m_mainAddress || address == Ipv4Address::GetAny () )
+                return;
+
+        std::string peerId = getNodeID(address);
+        if( m_peerTable.find(peerId) == m_peerTable.end() ){
+                // Until we hear from it directly, treat the node as being outside our domain
+                ChordPeer &peer = m_peerTable[peerId];
+                peer.address = address;
+                peer.domainKnown = false;
+                peer.lastSeen = Simulator::Now ();
+        }
+}
+
+uint8_t
+GUChord::GetPeerWireVersion(Ipv4Address address){
+
+        // Peers we have not negotiated with get the format every node understands
+        std::map<std::string, ChordPeer>::iterator iter = m_peerTable.find(getNodeID(address));
+        if( iter == m_peerTable.end() )
+                return WIRE_VERSION_1;
+
+        return std::min(iter->second.wireVersion, m_wireVersion);
+}
+
+void
+GUChord::NotePeerWireVersion(Ipv4Address address, uint8_t wireVersion){
+
+        std::map<std::string, ChordPeer>::iterator iter = m_peerTable.find(getNodeID(address));
+        if( iter != m_peerTable.end() && wireVersion > iter->second.wireVersion )
+                iter->second.wireVersion = wireVersion;
+}
+
+void
+GUChord::ForgetPeer(Ipv4Address address){
+
+        m_peerTable.erase(getNodeID(address));
+        m_neighborFingers.erase(getNodeID(address));
+}
+
+void
+GUChord::RouteLookup(GUChordMessage::ChordLookup lookup){
+
+        std::string key = lookup.lookupKey;
+
+        if( predecessor != "" && ( key == m_chordIdentifier || IsInInterval(key, predecessor, m_chordIdentifier) ) ){
+                SendLookupResult(lookup, m_chordIdentifier, m_mainAddress);
+                return;
+        }
+        if( successor == "" ){
+                ERROR_LOG ("Lookup for key: " << key << " before joining the ring");
+                return;
+        }
+        if( key == successor || IsInInterval(key, m_chordIdentifier, successor) ){
+                SendLookupResult(lookup, successor, succIP);
+                return;
+        }
+        if( lookup.hopCount >= MAX_LOOKUP_HOPS ){
+                ERROR_LOG ("Lookup for key: " << key << " exceeded " << MAX_LOOKUP_HOPS << " hops");
+                SendLookupResult(lookup, successor, succIP);
+                return;
+        }
+
+        std::map<std::string, ChordPeer>::iterator iter;
+        // once the cross-domain budget is spent, only peers in our own domain are next hops
+        bool mayCross = m_maxCrossDomainHops == 0 || lookup.crossDomainHops < m_maxCrossDomainHops;
+
+        if( lookup.ownerProbe ){
+                // key lies just before us but we don't own it: step back to the known
+                // node closest after the key and ask again
+                std::string bestId = "";
+                Ipv4Address bestAddress;
+                for( iter = m_peerTable.begin(); iter != m_peerTable.end(); iter++ ){
+                        if( ( iter->first == key || IsInInterval(iter->first, key, m_chordIdentifier) )
+                            && ( bestId == "" || IsInInterval(iter->first, key, bestId) ) ){
+                                bestId = iter->first;
+                                bestAddress = iter->second.address;
+                        }
+                }
+                if( bestId == "" ){
+                        // nobody known between the key and us, so we are its best owner
+                        SendLookupResult(lookup, m_chordIdentifier, m_mainAddress);
+                }else if( !mayCross && !IsInOwnDomain(bestAddress) ){
+                        SendLookupResult(lookup, bestId, bestAddress);
+                }else{
+                        ForwardLookup(bestAddress, lookup, true);
+                }
+                return;
+        }
+
+        for( int32_t depth = m_domainLevels.size(); depth >= 0; depth-- ){
+
+                std::string closestId = "", nextId = "", lookaheadId = "";
+                Ipv4Address closestAddress, nextAddress, lookaheadAddress;
+
+                for( iter = m_peerTable.begin(); iter != m_peerTable.end(); iter++ ){
+                        if( depth > 0 && ( !iter->second.domainKnown || GetCommonDomainDepth(iter->second.domain) < (uint32_t) depth ) )
+                                continue;
+                        if( !mayCross && !IsInOwnDomain(iter->second.address) )
+                                continue;
+                        // closest node preceding the key
+                        if( IsInInterval(iter->first, m_chordIdentifier, key)
+                            && ( closestId == "" || IsInInterval(closestId, m_chordIdentifier, iter->first) ) ){
+                                closestId = iter->first;
+                                closestAddress = iter->second.address;
+                        }
+                        // closest node preceding the key two hops away, through this peer
+                        if( m_neighborOfNeighbor && IsInInterval(iter->first, m_chordIdentifier, key) ){
+                                std::map<std::string, NeighborFingers>::iterator nonIter = m_neighborFingers.find(iter->first);
+                                if( nonIter != m_neighborFingers.end() ){
+                                        std::vector<std::string> &ids = nonIter->second.fingerIds;
+                                        for( uint32_t i = 0; i < ids.size(); i++ ){
+                                                if( ( ids[i] == key || IsInInterval(ids[i], m_chordIdentifier, key) )
+                                                    && ( lookaheadId == "" || IsInInterval(lookaheadId, m_chordIdentifier, ids[i]) ) ){
+                                                        lookaheadId = ids[i];
+                                                        lookaheadAddress = iter->second.address;
+                                                }
+                                        }
+                                }
+                        }
+                        // first node after us at this level
+                        if( nextId == "" || IsInInterval(iter->first, m_chordIdentifier, nextId) ){
+                                nextId = iter->first;
+                                nextAddress = iter->second.address;
+                        }
+                }
+
+                if( closestId != "" ){
+                        // prefer the neighbor whose own fingers get closest to the key
+                        if( lookaheadId != "" && IsInInterval(closestId, m_chordIdentifier, lookaheadId) )
+                                closestAddress = lookaheadAddress;
+                        ForwardLookup(closestAddress, lookup, false);
+                        return;
+                }
+                if( nextId != "" && ( key == nextId || IsInInterval(key, m_chordIdentifier, nextId) ) ){
+                        ForwardLookup(nextAddress, lookup, true);
+                        return;
+                }
+        }
+
+        if( !mayCross && !IsInOwnDomain(succIP) ){
+                DEBUG_LOG ("Lookup for key: " << key << " used its " << m_maxCrossDomainHops << " cross-domain hops");
+                SendLookupResult(lookup, successor, succIP);
+                return;
+        }
+        ForwardLookup(succIP, lookup, false);
+}
+
+bool
+GUChord::IsInOwnDomain(Ipv4Address address){
+
+        std::map<std::string, ChordPeer>::iterator iter = m_peerTable.find(getNodeID(address));
+        return iter != m_peerTable.end() && iter->second.domainKnown && iter->second.domain == m_domain;
+}
+
+void
+GUChord::ForwardLookup(Ipv4Address destAddress, GUChordMessage::ChordLookup lookup, bool ownerProbe){
+
+        if( !IsInOwnDomain(destAddress) )
+                lookup.crossDomainHops++;
+        lookup.hopCount++;
+        lookup.ownerProbe = ownerProbe ? 1 : 0;
+
+        uint32_t transactionId = GetNextTransactionId ();
+        //CHORD_LOG ("Sending CHORD_LOOKUP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+        GUChordMessage message = GUChordMessage (GUChordMessage::CHORD_LOOKUP, transactionId);
+        message.SetChordLookup (lookup);
+        SendMessage (destAddress, m_appPort, message);
+}
+
+void
+GUChord::SendLookupResult(GUChordMessage::ChordLookup lookup, std::string ownerId, Ipv4Address ownerAddress){
+
+        GUChordMessage::ChordLookupRsp response;
+        response.lookupKey = lookup.lookupKey;
+        response.ownerID = ownerId;
+        response.ownerAddress = ownerAddress;
+        response.originatorTransId = lookup.originatorTransId;
+        response.hopCount = lookup.hopCount;
+        response.crossDomainHops = lookup.crossDomainHops;
+
+        GUChordMessage message = GUChordMessage (GUChordMessage::CHORD_LOOKUP_RSP, GetNextTransactionId ());
+        message.SetChordLookupRsp (response);
+
+        if( lookup.originatorAddress == m_mainAddress ){
+                ProcessChordLookupRsp (message, m_mainAddress, m_appPort);
+        }else{
+                SendMessage (lookup.originatorAddress, m_appPort, message);
+        }
+}
+
+void
+GUChord::ProcessChordLookup(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        RouteLookup(message.GetChordLookup());
+}
+
+void
+GUChord::ProcessChordLookupRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        const GUChordMessage::ChordLookupRsp &response = message.GetChordLookupRsp();
+        LearnPeerAddress(response.ownerAddress);
+
+        CHORD_LOG ("LookupResult< key: " << response.lookupKey << ", owner: " << ReverseLookup(response.ownerAddress) << ", hops: " << (uint32_t) response.hopCount << ", crossDomainHops: " << (uint32_t) response.crossDomainHops << " >");
+
+        uint32_t ownerNum;
+        std::istringstream sin (ReverseLookup(response.ownerAddress));
+        sin >> ownerNum;
+
+        if( !m_lookupFn.IsNull () )
+                m_lookupFn (sourceAddress, ownerNum, response.ownerID, response.originatorTransId);
+}
+
+/********************************************************************************************/
+
+// Accordion-style routing table. Lookup traffic adds entries for free (every
+// sender and every lookup owner is learned); with AdaptiveRoutingTable set the
+// node also spends its MaintenanceBudget on EXPLORE_REQs towards targets drawn
+// with density 1/distance, so spare bandwidth buys mostly nearby entries. The
+// table is capped at the size that budget can keep fresh within PeerTimeout,
+// so constrained nodes shrink back towards MinRoutingEntries.
+
+double
+GUChord::GetRingDistance(std::string from, std::string to){
+
+        // 52 leading bits are plenty to compare distances and fit a double exactly
+        uint64_t a = strtoull(from.substr(0, 13).c_str(), NULL, 16);
+        uint64_t b = strtoull(to.substr(0, 13).c_str(), NULL, 16);
+        uint64_t ringSize = ((uint64_t) 1) << 52;
+        return (double) ((b - a) & (ringSize - 1)) / (double) ringSize;
+}
+
+std::string
+GUChord::AddPowerOfTwo(std::string id, uint32_t exponent){
+
+        static const char hexDigits[] = "0123456789abcdef";
+        std::string result = id;
+        int32_t pos = (int32_t) result.length() - 1 - exponent / 4;
+        uint32_t carry = 1 << (exponent % 4);
+        for( ; pos >= 0 && carry; pos-- ){
+                char c = result[pos];
+                uint32_t digit = (c >= 'a') ? (c - 'a' + 10) : (c - '0');
+                digit += carry;
+                result[pos] = hexDigits[digit & 0xf];
+                carry = digit >> 4;
+        }
+        return result;
+}
+
+// Churn: drop entries that have gone quiet, counting traffic from the search layer too.
+// Runs whatever the table size policy, so a crashed node stops being a next hop
+void
+GUChord::ExpirePeers(){
+
+        std::set<std::string> pinned;
+        pinned.insert(successor);
+        pinned.insert(predecessor);
+        for( uint32_t i = 0; i < fingerTable.size(); i++ )
+                pinned.insert(fingerTable[i].getFingerID());
+
+        Ptr<GUPeerLiveness> liveness = GetLiveness();
+        std::map<std::string, ChordPeer>::iterator iter;
+        for( iter = m_peerTable.begin(); iter != m_peerTable.end(); ){
+                if( pinned.find(iter->first) == pinned.end() && iter->second.lastSeen + m_peerTimeout < Simulator::Now ()
+                    && !liveness->HeardWithin(iter->second.address, m_peerTimeout) ){
+                        m_neighborFingers.erase(iter->first);
+                        m_peerTable.erase(iter++);
+                }else
+                        iter++;
+        }
+
+        m_peerExpiryTimer.Schedule (m_peerTimeout);
+}
+
+double
+GUChord::GetExploreCost(){
+
+        // Bytes of one EXPLORE_REQ and a full EXPLORE_RSP, as this node would put them on the wire
+        GUChordMessage request = GUChordMessage (GUChordMessage::EXPLORE_REQ, 0);
+        request.SetExploreReq (m_chordIdentifier, EXPLORE_ENTRIES);
+        std::vector<Ipv4Address> entries (EXPLORE_ENTRIES, m_mainAddress);
+        GUChordMessage response = GUChordMessage (GUChordMessage::EXPLORE_RSP, 0);
+        response.SetExploreRsp (entries);
+        request.SetSenderDomain (m_domain);
+        response.SetSenderDomain (m_domain);
+        request.SetWireVersion (m_wireVersion);
+        response.SetWireVersion (m_wireVersion);
+        return 2 * UDP_IP_OVERHEAD + request.GetSerializedSize () + response.GetSerializedSize ();
+}
+
+uint32_t
+GUChord::GetRoutingTableCapacity(){
+
+        // Entries learnt per second at full budget, kept alive for one PeerTimeout
+        double capacity = m_maintenanceBudget / GetExploreCost() * EXPLORE_ENTRIES * m_peerTimeout.GetSeconds ();
+        // a ring of N nodes needs about log N fingers plus as many nearby nodes
+        uint32_t minEntries = m_scaleWithNetworkSize ? 2 * GetLogNetworkSize() : m_minRoutingEntries;
+        return std::max((uint32_t) capacity, minEntries);
+}
+
+void
+GUChord::PruneRoutingTable(){
+
+        std::set<std::string> pinned;
+        pinned.insert(successor);
+        pinned.insert(predecessor);
+        for( uint32_t i = 0; i < fingerTable.size(); i++ )
+                pinned.insert(fingerTable[i].getFingerID());
+
+        // Budget: evict the entry that adds least to a 1/distance density,
+        // i.e. the one closest to its clockwise neighbour relative to its distance from us
+        std::map<std::string, ChordPeer>::iterator iter;
+        uint32_t capacity = GetRoutingTableCapacity();
+        while( m_peerTable.size() > capacity ){
+                std::vector<std::string> ring;
+                for( iter = m_peerTable.begin(); iter != m_peerTable.end(); iter++ ){
+                        if( iter->first > m_chordIdentifier )
+                                ring.push_back(iter->first);
+                }
+                for( iter = m_peerTable.begin(); iter != m_peerTable.end() && iter->first < m_chordIdentifier; iter++ )
+                        ring.push_back(iter->first);
+
+                std::string victim = "";
+                double victimScore = 0;
+                for( uint32_t i = 0; i + 1 < ring.size(); i++ ){
+                        if( pinned.find(ring[i]) != pinned.end() )
+                                continue;
+                        double gap = GetRingDistance(ring[i], ring[i + 1]);
+                        double score = gap / GetRingDistance(m_chordIdentifier, ring[i]);
+                        if( victim == "" || score < victimScore ){
+                                victim = ring[i];
+                                victimScore = score;
+                        }
+                }
+                if( victim == "" )
+                        break;
+                m_peerTable.erase(victim);
+        }
+}
+
+void
+GUChord::Explore(){
+
+        Time now = Simulator::Now ();
+        m_budgetTokens += m_maintenanceBudget * (now - m_budgetRefillTime).GetSeconds ();
+        // Don't let an idle node bank more than a few seconds of budget
+        m_budgetTokens = std::min(m_budgetTokens, 4.0 * m_maintenanceBudget);
+        m_budgetRefillTime = now;
+
+        PruneRoutingTable();
+
+        double exploreCost = GetExploreCost();
+        if( successor != "" && successor != m_chordIdentifier && m_budgetTokens >= exploreCost
+            && m_peerTable.size() < GetRoutingTableCapacity() ){
+
+                // Pick a distance between our successor gap and half the ring, log-uniformly (density 1/d)
+                double successorGap = GetRingDistance(m_chordIdentifier, successor);
+                uint32_t lowestExponent = ID_BITS - 1;
+                if( successorGap > 0 )
+                        lowestExponent = (uint32_t) std::max(0.0, ID_BITS + floor(log(successorGap) / log(2.0)));
+                UniformVariable random;
+                uint32_t exponent = random.GetInteger(lowestExponent, ID_BITS - 1);
+                std::string target = AddPowerOfTwo(m_chordIdentifier, exponent);
+
+                // Ask the known node closest before the target for what follows it
+                Ipv4Address destAddress = succIP;
+                std::string closestId = successor;
+                std::map<std::string, ChordPeer>::iterator iter;
+                for( iter = m_peerTable.begin(); iter != m_peerTable.end(); iter++ ){
+                        if( IsInInterval(iter->first, closestId, target) ){
+                                closestId = iter->first;
+                                destAddress = iter->second.address;
+                        }
+                }
+                SendExploreReq(destAddress, target);
+                m_budgetTokens -= exploreCost;
+        }
+
+        m_exploreTimer.Schedule (m_exploreInterval);
+}
+
+void
+GUChord::SendExploreReq(Ipv4Address destAddress, std::string targetId){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending EXPLORE_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::EXPLORE_REQ, transactionId);
+
+      message.SetExploreReq (targetId, EXPLORE_ENTRIES);
+      SendMessage (destAddress, m_appPort, message);
+    }
+}
+
+void
+GUChord::SendExploreRsp(Ipv4Address destAddress, std::vector<Ipv4Address> &entries){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending EXPLORE_RSP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::EXPLORE_RSP, transactionId);
+
+      message.SetExploreRsp (entries);
+      SendMessage (destAddress, m_appPort, message);
+    }
+}
+
+void
+GUChord::ProcessExploreReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        std::string target = message.GetExploreReq().targetID;
+        uint32_t maxEntries = std::min((uint32_t) message.GetExploreReq().maxEntries, (uint32_t) EXPLORE_ENTRIES);
+
+        // Known nodes (ourselves included) in clockwise order from the target
+        std::map<std::string, Ipv4Address> after, wrapped;
+        std::map<std::string, ChordPeer>::iterator iter;
+        for( iter = m_peerTable.begin(); iter != m_peerTable.end(); iter++ ){
+                if( iter->second.address != sourceAddress )
+                        (iter->first >= target ? after : wrapped)[iter->first] = iter->second.address;
+        }
+        (m_chordIdentifier >= target ? after : wrapped)[m_chordIdentifier] = m_mainAddress;
+
+        std::vector<Ipv4Address> entries;
+        std::map<std::string, Ipv4Address>::iterator it;
+        for( it = after.begin(); it != after.end() && entries.size() < maxEntries; it++ )
+                entries.push_back(it->second);
+        for( it = wrapped.begin(); it != wrapped.end() && entries.size() < maxEntries; it++ )
+                entries.push_back(it->second);
+
+        SendExploreRsp(sourceAddress, entries);
+}
+
+void
+GUChord::ProcessExploreRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        const std::vector<Ipv4Address> &entries = message.GetExploreRsp().entries;
+        for( uint32_t i = 0; i < entries.size(); i++ )
+                LearnPeerAddress(entries[i]);
+}
+
+/********************************************************************************************/
+
+// Neighbor-of-neighbor routing. Each fix-finger round fetches the finger list
+// of one of our fingers (the one refreshed longest ago), so every finger's
+// list is renewed lazily once per O(log N) rounds. RouteLookup then picks the
+// neighbor through which the node closest before the key is reachable in two
+// hops, rather than the neighbor closest to the key itself.
+
+std::vector<Ipv4Address>
+GUChord::GetFingerList(){
+
+        // first known node at or after self + 2^i, for every i
+        std::vector<Ipv4Address> fingers;
+        std::string lastId = "";
+        for( uint32_t i = 0; i < ID_BITS && !m_peerTable.empty(); i++ ){
+                std::string target = AddPowerOfTwo(m_chordIdentifier, i);
+                std::map<std::string, ChordPeer>::iterator iter = m_peerTable.lower_bound(target);
+                if( iter == m_peerTable.end() )
+                        iter = m_peerTable.begin();
+                // wrapped past ourselves: no node beyond this distance
+                if( iter->first != target && !IsInInterval(iter->first, target, m_chordIdentifier) )
+                        break;
+                if( iter->first == lastId )
+                        continue;
+                lastId = iter->first;
+                fingers.push_back(iter->second.address);
+        }
+        return fingers;
+}
+
+void
+GUChord::RefreshNeighborFingers(){
+
+        std::vector<Ipv4Address> fingers = GetFingerList();
+        std::set<std::string> fingerIds;
+        std::string stalestId = "";
+        Ipv4Address stalestAddress;
+        Time stalestUpdate;
+
+        for( uint32_t i = 0; i < fingers.size(); i++ ){
+                std::string fingerId = getNodeID(fingers[i]);
+                fingerIds.insert(fingerId);
+                std::map<std::string, NeighborFingers>::iterator iter = m_neighborFingers.find(fingerId);
+                Time lastUpdate = ( iter == m_neighborFingers.end() ) ? Seconds (0) : iter->second.lastUpdate;
+                if( stalestId == "" || lastUpdate < stalestUpdate ){
+                        stalestId = fingerId;
+                        stalestAddress = fingers[i];
+                        stalestUpdate = lastUpdate;
+                }
+        }
+
+        // keep lists only for current fingers
+        std::map<std::string, NeighborFingers>::iterator iter;
+        for( iter = m_neighborFingers.begin(); iter != m_neighborFingers.end(); ){
+                if( fingerIds.find(iter->first) == fingerIds.end() )
+                        m_neighborFingers.erase(iter++);
+                else
+                        iter++;
+        }
+
+        if( stalestId != "" )
+                SendFingerListReq(stalestAddress);
+}
+
+void
+GUChord::SendFingerListReq(Ipv4Address destAddress){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending FINGER_LIST_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      SendFromTemplate (destAddress, GUChordMessage::FINGER_LIST_REQ, transactionId);
+    }
+}
+
+void
+GUChord::SendFingerListRsp(Ipv4Address destAddress, std::vector<Ipv4Address> &fingers){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending FINGER_LIST_RSP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::FINGER_LIST_RSP, transactionId);
+
+      message.SetFingerListRsp (fingers);
+      SendMessage (destAddress, m_appPort, message);
+    }
+}
+
+void
+GUChord::ProcessFingerListReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        std::vector<Ipv4Address> fingers = GetFingerList();
+        SendFingerListRsp(sourceAddress, fingers);
+}
+
+void
+GUChord::ProcessFingerListRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        // Only the IDs are kept; second-hop nodes are never contacted directly
+        const std::vector<Ipv4Address> &fingers = message.GetFingerListRsp().fingers;
+        NeighborFingers &entry = m_neighborFingers[getNodeID(sourceAddress)];
+        entry.fingerIds.clear();
+        for( uint32_t i = 0; i < fingers.size(); i++ ){
+                if( fingers[i] != m_mainAddress )
+                        entry.fingerIds.push_back(getNodeID(fingers[i]));
+        }
+        entry.lastUpdate = Simulator::Now ();
+}
+
+/********************************************************************************************/
+
+// Network size estimation. The k nodes following us cover a fraction d of
+// the ring, so N is about k / d. Only the successor is known to be adjacent,
+// so the sample starts there and runs along the peer table only while the
+// gaps stay plausible; a sparse table would otherwise stretch d and shrink N.
+// Each round folds that local sample into the running estimate and then
+// averages it push-pull with a random peer, so estimates converge across the ring.
+
+double
+GUChord::GetLocalSizeEstimate(){
+
+        if( successor == "" || successor == m_chordIdentifier )
+                return 1;
+
+        uint32_t sampled = 1;
+        double span = GetRingDistance(m_chordIdentifier, successor);
+        std::string lastId = successor;
+        std::map<std::string, ChordPeer>::iterator iter = m_peerTable.upper_bound(successor);
+        for( uint32_t i = 0; i < m_peerTable.size() && sampled < SIZE_SAMPLE_PEERS; i++ ){
+                if( iter == m_peerTable.end() )
+                        iter = m_peerTable.begin();
+                if( iter->first == m_chordIdentifier || !IsInInterval(iter->first, lastId, m_chordIdentifier) )
+                        break;
+                double gap = GetRingDistance(lastId, iter->first);
+                if( gap > SIZE_SAMPLE_GAP_RATIO * span / sampled )
+                        break;
+                span += gap;
+                lastId = iter->first;
+                sampled++;
+                iter++;
+        }
+
+        if( span <= 0 )
+                return sampled + 1;
+        return std::max(sampled / span, (double) sampled + 1);
+}
+
+double
+GUChord::GetNetworkSizeEstimate(){
+
+        return m_sizeEstimate > 0 ? m_sizeEstimate : GetLocalSizeEstimate();
+}
+
+uint32_t
+GUChord::GetLogNetworkSize(){
+
+        return (uint32_t) std::max(1.0, ceil(log(GetNetworkSizeEstimate()) / log(2.0)));
+}
+
+void
+GUChord::UpdateSizeEstimate(){
+
+        double local = GetLocalSizeEstimate();
+        if( m_sizeEstimate <= 0 )
+                m_sizeEstimate = local;
+        else
+                m_sizeEstimate = 0.75 * m_sizeEstimate + 0.25 * local;
+
+        if( !m_peerTable.empty() ){
+                UniformVariable random;
+                uint32_t index = random.GetInteger(0, m_peerTable.size() - 1);
+                std::map<std::string, ChordPeer>::iterator iter = m_peerTable.begin();
+                std::advance(iter, index);
+                SendSizeEstimateReq(iter->second.address, (uint32_t) (m_sizeEstimate + 0.5));
+        }
+
+        m_sizeEstimateTimer.Schedule (m_sizeEstimateInterval);
+}
+
+void
+GUChord::SendSizeEstimateReq(Ipv4Address destAddress, uint32_t networkSize){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending SIZE_EST_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::SIZE_EST_REQ, transactionId);
+
+      message.SetSizeEstimateReq (networkSize);
+      SendMessage (destAddress, m_appPort, message);
+    }
+}
+
+void
+GUChord::SendSizeEstimateRsp(Ipv4Address destAddress, uint32_t networkSize){
+
+        if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      //CHORD_LOG ("Sending SIZE_EST_RSP to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " transactionId: " << transactionId);
+
+      GUChordMessage message = GUChordMessage (GUChordMessage::SIZE_EST_RSP, transactionId);
+
+      message.SetSizeEstimateRsp (networkSize);
+      SendMessage (destAddress, m_appPort, message);
+    }
+}
+
+void
+GUChord::ProcessSizeEstimateReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        double theirs = message.GetSizeEstimateReq().networkSize;
+        double mine = GetNetworkSizeEstimate();
+        SendSizeEstimateRsp(sourceAddress, (uint32_t) (mine + 0.5));
+        if( theirs > 0 )
+                m_sizeEstimate = (mine + theirs) / 2;
+}
+
+void
+GUChord::ProcessSizeEstimateRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        double theirs = message.GetSizeEstimateRsp().networkSize;
+        if( theirs > 0 )
+                m_sizeEstimate = (GetNetworkSizeEstimate() + theirs) / 2;
+}
+
+/********************************************************************************************/
+
+// RINGSTATE aggregation: the requester broadcasts RING_AGG_REQ down a tree built from
+// each node's known nodes at self+2^i (each child covers the ring up to the next child),
+// and every node answers its parent once with the merged summary of its subtree. Depth
+// is O(log N) once nodes know their fingers and degrades to the successor chain without.
+
+// The first known node at or after self+2^i for every i, from the successor,
+// the finger table and the peer table; oldest is when the stalest was last heard from
+void
+GUChord::GetKnownFingers(std::map<std::string, Ipv4Address> &fingers, Time &oldest){
+
+        std::map<std::string, Ipv4Address> known;
+        std::map<std::string, Time> heard;
+        for( std::map<std::string, ChordPeer>::iterator iter = m_peerTable.begin(); iter != m_peerTable.end(); iter++ ){
+                known[iter->first] = iter->second.address;
+                heard[iter->first] = iter->second.lastSeen;
+        }
+        for( uint32_t i = 0; i < fingerTable.size(); i++ ){
+                known[fingerTable[i].getFingerID()] = fingerTable[i].getFingerAddr();
+                if( heard.find(fingerTable[i].getFingerID()) == heard.end() )
+                        heard[fingerTable[i].getFingerID()] = m_fingerUpdateTime;
+        }
+        if( successor != "" ){
+                known[successor] = succIP;
+                heard[successor] = Simulator::Now ();
+        }
+        known.erase(m_chordIdentifier);
+
+        fingers.clear();
+        oldest = Simulator::Now ();
+        if( known.empty() )
+                return;
+        for( uint32_t i = 0; i < ID_BITS; i++ ){
+                std::map<std::string, Ipv4Address>::iterator iter = known.lower_bound(AddPowerOfTwo(m_chordIdentifier, i));
+                if( iter == known.end() )
+                        iter = known.begin();
+                if( fingers.insert(*iter).second )
+                        oldest = std::min(oldest, heard[iter->first]);
+        }
+}
+
+void
+GUChord::StartRingAggregation(){
+
+        uint32_t queryId = GetNextTransactionId ();
+        GUChordMessage message = GUChordMessage (GUChordMessage::RING_AGG_REQ, queryId);
+        message.SetRingAggReq (queryId, m_ringAggTimeout.GetMilliSeconds (), m_chordIdentifier);
+        ProcessRingAggReq (message, m_mainAddress, m_appPort);
+}
+
+void
+GUChord::ProcessRingAggReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        const GUChordMessage::RingAggReq &request = message.GetRingAggReq();
+        uint32_t queryId = request.queryId;
+
+        if( m_ringAggTracker.find (queryId) != m_ringAggTracker.end () ){
+                // Already part of this tree through another parent; don't count this node twice
+                DEBUG_LOG ("Duplicate RING_AGG_REQ for query: " << queryId);
+                GUChordMessage::RingAggRsp empty;
+                empty.queryId = queryId;
+                empty.nodeCount = 0;
+                empty.minKeys = empty.maxKeys = 0;
+                empty.totalKeys = 0;
+                empty.inconsistentSuccessors = empty.nodesWithoutFingers = empty.maxFingerAgeMs = 0;
+                empty.totalFingerAgeMs = 0;
+                SendRingAggRsp (sourceAddress, empty);
+                return;
+        }
+
+        RingAggState &state = m_ringAggTracker[queryId];
+        state.isRoot = ( sourceAddress == m_mainAddress );
+        state.parentAddress = sourceAddress;
+
+        // Summary of this node alone
+        GUChordMessage::RingAggRsp &summary = state.summary;
+        uint32_t keys = m_keyCountFn.IsNull () ? 0 : m_keyCountFn ();
+        summary.queryId = queryId;
+        summary.nodeCount = 1;
+        summary.minKeys = keys;
+        summary.maxKeys = keys;
+        summary.totalKeys = keys;
+        summary.inconsistentSuccessors = ( successor != m_chordIdentifier && m_succPredecessor != m_chordIdentifier ) ? 1 : 0;
+
+        // A node whose only finger is its successor has nothing long-range to route on
+        std::map<std::string, Ipv4Address> fingers;
+        Time oldest;
+        GetKnownFingers(fingers, oldest);
+        fingers.erase(successor);
+        summary.nodesWithoutFingers = fingers.empty () ? 1 : 0;
+        summary.maxFingerAgeMs = 0;
+        summary.totalFingerAgeMs = 0;
+        if( !fingers.empty () ){
+                uint32_t age = (Simulator::Now () - oldest).GetMilliSeconds ();
+                summary.maxFingerAgeMs = age;
+                summary.totalFingerAgeMs = age;
+        }
+        if( successor != "" && successor != m_chordIdentifier )
+                fingers[successor] = succIP;
+
+        // Children: fingers inside (self, limit), in clockwise order
+        std::map<std::string, Ipv4Address> wrapped, unwrapped;
+        std::map<std::string, Ipv4Address>::iterator finger;
+        for( finger = fingers.begin(); finger != fingers.end(); finger++ ){
+                if( IsInInterval(finger->first, m_chordIdentifier, request.limitID) ){
+                        (finger->first > m_chordIdentifier ? unwrapped : wrapped)[finger->first] = finger->second;
+                }
+        }
+        std::vector<std::pair<std::string, Ipv4Address> > children (unwrapped.begin (), unwrapped.end ());
+        children.insert (children.end (), wrapped.begin (), wrapped.end ());
+
+        state.pendingChildren = children.size ();
+        if( children.empty () ){
+                FinishRingAggregation (queryId);
+                return;
+        }
+
+        // Each level takes a fixed hop off the budget to report back up the tree
+        uint32_t childTimeoutMs = std::max(request.timeoutMs, (uint32_t) 2 * RING_AGG_HOP_MS) - RING_AGG_HOP_MS;
+        for( uint32_t i = 0; i < children.size(); i++ ){
+                std::string childLimit = (i + 1 < children.size()) ? children[i + 1].first : request.limitID;
+                SendRingAggReq (children[i].second, queryId, childTimeoutMs, childLimit);
+        }
+        state.timeoutEvent = Simulator::Schedule (MilliSeconds (request.timeoutMs), &GUChord::FinishRingAggregation, this, queryId);
+}
+
+void
+GUChord::ProcessRingAggRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
+
+        const GUChordMessage::RingAggRsp &childSummary = message.GetRingAggRsp();
+
+        std::map<uint32_t, RingAggState>::iterator iter = m_ringAggTracker.find (childSummary.queryId);
+        if( iter == m_ringAggTracker.end () ){
+                DEBUG_LOG ("Late or unknown RING_AGG_RSP for query: " << childSummary.queryId);
+                return;
+        }
+
+        iter->second.summary.Merge (childSummary);
+        if( iter->second.pendingChildren > 0 && --iter->second.pendingChildren == 0 ){
+                FinishRingAggregation (childSummary.queryId);
+        }
+}
+
+void
+GUChord::FinishRingAggregation(uint32_t queryId){
+
+        std::map<uint32_t, RingAggState>::iterator iter = m_ringAggTracker.find (queryId);
+        if( iter == m_ringAggTracker.end () )
+                return;
+
+        RingAggState state = iter->second;
+        state.timeoutEvent.Cancel ();
+        m_ringAggTracker.erase (iter);
+
+        if( state.pendingChildren > 0 ){
+                DEBUG_LOG ("RING_AGG query: " << queryId << " finished with " << state.pendingChildren << " subtrees missing");
+        }
+
+        if( !state.isRoot ){
+                SendRingAggRsp (state.parentAddress, state.summary);
+                return;
+        }
+
+        std::ostringstream summaryText;
+        state.summary.Print (summaryText);
+        CHORD_LOG ("RingState Node ID: " << m_chordIdentifier << " " << summaryText.str ());
+        std::cout << "\nRing summary from Node ID: " << m_chordIdentifier << "\n" << summaryText.str () << std::endl;
+
+        if( !m_ringStateFn.IsNull () )
+                m_ringStateFn (state.summary);
+}
+
 
 /********************************************************************************************/
 
@@ -953,11 +2103,9 @@ GUChord::SendPing (Ipv4Address destAddress, std::string pingMessage)
       Ptr<PingRequest> pingRequest = Create<PingRequest> (transactionId, Simulator::Now(), destAddress, pingMessage);
       // Add to ping-tracker
       m_pingTracker.insert (std::make_pair (transactionId, pingRequest));
-      Ptr<Packet> packet = Create<Packet> ();
       GUChordMessage message = GUChordMessage (GUChordMessage::PING_REQ, transactionId);
       message.SetPingReq (pingMessage);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SendMessage (destAddress, m_appPort, message);
     }
   else
     {
@@ -968,7 +2116,7 @@ GUChord::SendPing (Ipv4Address destAddress, std::string pingMessage)
 
 
 void
-GUChord::ProcessPingReq (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort)
+GUChord::ProcessPingReq (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
 
     // Use reverse lookup for ease of debug
@@ -977,15 +2125,13 @@ GUChord::ProcessPingReq (GUChordMessage message, Ipv4Address sourceAddress, uint
     // Send Ping Response
     GUChordMessage resp = GUChordMessage (GUChordMessage::PING_RSP, message.GetTransactionId());
     resp.SetPingRsp (message.GetPingReq().pingMessage);
-    Ptr<Packet> packet = Create<Packet> ();
-    packet->AddHeader (resp);
-    m_socket->SendTo (packet, 0 , InetSocketAddress (sourceAddress, sourcePort));
+    SendMessage (sourceAddress, sourcePort, resp);
     // Send indication to application layer
     m_pingRecvFn (sourceAddress, message.GetPingReq().pingMessage);
 }
 
 void
-GUChord::ProcessPingRsp (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort)
+GUChord::ProcessPingRsp (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
   // Remove from pingTracker
   std::map<uint32_t, Ptr<PingRequest> >::iterator iter;
@@ -994,6 +2140,7 @@ GUChord::ProcessPingRsp (GUChordMessage message, Ipv4Address sourceAddress, uint
     {
       std::string fromNode = ReverseLookup (sourceAddress);
       CHORD_LOG ("Received PING_RSP, From Node: " << fromNode << ", Message: " << message.GetPingRsp().pingMessage);
+      GetLiveness ()->RecordRtt (sourceAddress, Simulator::Now () - iter->second->GetTimestamp ());
       m_pingTracker.erase (iter);
       // Send indication to application layer
       m_pingSuccessFn (sourceAddress, message.GetPingRsp().pingMessage);
@@ -1031,48 +2178,17 @@ GUChord::AuditPings ()
 uint32_t
 GUChord::GetNextTransactionId ()
 {
-  return m_currentTransactionId++;
+  return m_transport->GetNextTransactionId ();
 }
 
 void
-GUChord::StopChord ()
+GUChord::StopOverlay ()
 {
   StopApplication ();
 }
 
 void
-GUChord::SetPingSuccessCallback (Callback <void, Ipv4Address, std::string> pingSuccessFn)
-{
-  m_pingSuccessFn = pingSuccessFn;
-}
-
-
-void
-GUChord::SetPingFailureCallback (Callback <void, Ipv4Address, std::string> pingFailureFn)
-{
-  m_pingFailureFn = pingFailureFn;
-}
-
-void
-GUChord::SetPingRecvCallback (Callback <void, Ipv4Address, std::string> pingRecvFn)
-{
-  m_pingRecvFn = pingRecvFn;
-}
-
-void
-GUChord::SetChordLookupCallback (Callback <void, Ipv4Address, uint32_t, std::string, uint32_t> chordLookupFn)
-{
-  m_chordLookupFn = chordLookupFn;
-}
-
-void
-GUChord::SetChordLeaveCallback (Callback <void, Ipv4Address, uint32_t> chordLeaveFn)
-{
-  m_chordLeaveFn = chordLeaveFn;
-}
-
-void
-GUChord::SetPredecessorChangeCallback (Callback <void, Ipv4Address, std::string> predecessorChangeFn)
+GUChord::SetRingStateCallback (Callback <void, GUChordMessage::RingAggRsp> ringStateFn)
 {
-  m_predecessorChangeFn = predecessorChangeFn;
+  m_ringStateFn = ringStateFn;
 }
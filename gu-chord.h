@@ -19,7 +19,7 @@
 #ifndef GU_CHORD_H
 #define GU_CHORD_H
 
-#include "ns3/gu-application.h"
+#include "ns3/gu-overlay.h"
 #include "ns3/gu-chord-message.h"
 #include "ns3/ping-request.h"
 
@@ -32,21 +32,25 @@
 #include "ns3/socket.h"
 #include "ns3/nstime.h"
 #include "ns3/timer.h"
+#include "ns3/event-id.h"
 #include "ns3/uinteger.h"
 #include "ns3/boolean.h"
+#include "ns3/string.h"
 #include "ns3/finger.h"
 
 using namespace ns3;
 
-class GUChord : public GUApplication
+class GUChord : public GUOverlay
 {
   public:
     static TypeId GetTypeId (void);
     GUChord ();
     virtual ~GUChord ();
 
-    void SendPing (Ipv4Address destAddress, std::string pingMessage);
-    void RecvMessage (Ptr<Socket> socket);
+    void SendMessage (Ipv4Address destAddress, uint16_t destPort, GUChordMessage &message);
+    void HandleMessage (Ptr<Packet> packet, Ipv4Address sourceAddress, uint16_t sourcePort);
+    // Receive dispatch, indexed by GUChordMessage::MessageType
+    typedef void (GUChord::*MessageHandler) (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
 
     void setMaxHash();
     std::string GetNodeNumber();
@@ -58,46 +62,107 @@ class GUChord : public GUApplication
     void startSendingFixFinger();   
 
 
-    void SendJoinRequest(Ipv4Address destAddress, Ipv4Address srcAddress, std::string srcId, Ipv4Address landmarkAddress, std::string landmarkId);    //Method to send out join message to landmark node
+    void SendJoinRequest(Ipv4Address destAddress, Ipv4Address srcAddress, std::string srcId, Ipv4Address landmarkAddress, std::string landmarkId, uint8_t srcWireVersion, uint8_t hopCount);    //Method to send out join message to landmark node
     void SendJoinResponse(Ipv4Address destAddress, Ipv4Address succ, std::string newSuccessor);   //Method to send back the correct pred and succ to join requester
     void SendRingStateMessage(Ipv4Address destAddress, std::string srcNodeID);
     void SendStableReq(Ipv4Address destAddress);
+    void SendFromTemplate(Ipv4Address destAddress, GUChordMessage::MessageType messageType, uint32_t transactionId);
     void SendStableRsp(Ipv4Address destAddress, std::string predecessorId, Ipv4Address predecessorIp);
     void SendSetPred(Ipv4Address destAddress, std::string ndId, Ipv4Address ndAddr);
     void SendNotify(Ipv4Address destAddress, std::string ndId, Ipv4Address ndAddr);
     void SendLeaveRequest(Ipv4Address destAddress, Ipv4Address succ, Ipv4Address pred, std::string sucIp, std::string predIp);
-    void SendFingerReq(Ipv4Address destAddress, std::vector<std::string> testIds, std::vector<std::string> fingerEntries, std::vector<Ipv4Address> fingerIP, Ipv4Address originator);
-    void SendFingerRsp(Ipv4Address destAddress, std::vector<std::string> fingerNum, std::vector<Ipv4Address> fingerAddr);                      
-    void SendChordLookup (std::string lookupKey, uint32_t transId);
-
-    void ProcessPingReq (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessPingRsp (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessChordJoin (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);      //process message for joining network
-    void ProcessChordJoinRsp (GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);          //Process message when node in network finds the correct succ. and pred. for a join request
-    void PrintRingState(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessStableReq(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessStableRsp(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessSetPred(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessNotify(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessChordLeave(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessFingerReq(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessFingerRsp(GUChordMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void SendFingerReq(Ipv4Address destAddress, std::vector<std::string> &testIds, std::vector<std::string> &fingerEntries, std::vector<Ipv4Address> &fingerIP, Ipv4Address originator, uint8_t hopCount);
+    void SendFingerRsp(Ipv4Address destAddress, std::vector<std::string> &fingerNum, std::vector<Ipv4Address> &fingerAddr);                      
+    void SendRingAggReq(Ipv4Address destAddress, uint32_t queryId, uint32_t timeoutMs, std::string limitId);
+    void SendRingAggRsp(Ipv4Address destAddress, GUChordMessage::RingAggRsp summary);
+
+    // Ring-wide health summary, aggregated over a finger broadcast tree
+    void StartRingAggregation();
+    void FinishRingAggregation(uint32_t queryId);
+    void GetKnownFingers(std::map<std::string, Ipv4Address> &fingers, Time &oldest);
+    bool IsInInterval(std::string key, std::string start, std::string end);
+
+    // Lookup routing, preferring hops that stay inside this node's domain
+    void RouteLookup(GUChordMessage::ChordLookup lookup);
+    void ForwardLookup(Ipv4Address destAddress, GUChordMessage::ChordLookup lookup, bool ownerProbe);
+    void SendLookupResult(GUChordMessage::ChordLookup lookup, std::string ownerId, Ipv4Address ownerAddress);
+    void LearnPeer(Ipv4Address address, std::string domain);
+    void LearnPeerAddress(Ipv4Address address);
+    void ForgetPeer(Ipv4Address address);
+    uint8_t GetPeerWireVersion(Ipv4Address address);
+    void NotePeerWireVersion(Ipv4Address address, uint8_t wireVersion);
+    uint32_t GetCommonDomainDepth(std::string domain);
+    bool IsInOwnDomain(Ipv4Address address);
+
+    // Bandwidth-budgeted routing table: explore with spare budget, evict down to what it can sustain
+    void Explore();
+    void SendExploreReq(Ipv4Address destAddress, std::string targetId);
+    void SendExploreRsp(Ipv4Address destAddress, std::vector<Ipv4Address> &entries);
+    void PruneRoutingTable();
+    void ExpirePeers();
+    uint32_t GetRoutingTableCapacity();
+    double GetExploreCost();
+    double GetRingDistance(std::string from, std::string to);
+    std::string AddPowerOfTwo(std::string id, uint32_t exponent);
+
+    // Neighbor-of-neighbor routing: fingers' own finger lists give two-hop lookahead
+    std::vector<Ipv4Address> GetFingerList();
+    void RefreshNeighborFingers();
+    void SendFingerListReq(Ipv4Address destAddress);
+    void SendFingerListRsp(Ipv4Address destAddress, std::vector<Ipv4Address> &fingers);
+
+    // Network size estimation: successor density refined by gossip averaging
+    double GetNetworkSizeEstimate();
+    double GetLocalSizeEstimate();
+    uint32_t GetLogNetworkSize();
+    void UpdateSizeEstimate();
+    void SendSizeEstimateReq(Ipv4Address destAddress, uint32_t networkSize);
+    void SendSizeEstimateRsp(Ipv4Address destAddress, uint32_t networkSize);
+
+    // Forwarding on the routing header alone, for relayed messages that pass through unchanged
+    bool RelayMessage (GUChordMessage &route, Ptr<Packet> packet, uint32_t routeSize);
+    bool PassesJoinOn(const std::string &messageNodeID, const std::string &landmID);
+    bool ResolvesFingerTarget(const std::string &target);
+
+    void ProcessPingReq (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessPingRsp (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessChordJoin (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);      //process message for joining network
+    void ProcessChordJoinRsp (const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);          //Process message when node in network finds the correct succ. and pred. for a join request
+    void PrintRingState(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessStableReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessStableRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessSetPred(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessNotify(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessChordLeave(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFingerReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFingerRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessRingAggReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessRingAggRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessChordLookup(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessChordLookupRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessExploreReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessExploreRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFingerListReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFingerListRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessSizeEstimateReq(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessSizeEstimateRsp(const GUChordMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
 
     void AuditPings ();
     uint32_t GetNextTransactionId ();
-    void StopChord ();
 
     // Callback with Application Layer (add more when required)
-    void SetPingSuccessCallback (Callback <void, Ipv4Address, std::string> pingSuccessFn);
-    void SetPingFailureCallback (Callback <void, Ipv4Address, std::string> pingFailureFn);
-    void SetPingRecvCallback (Callback <void, Ipv4Address, std::string> pingRecvFn);
-
-    void SetChordLookupCallback (Callback <void, Ipv4Address, uint32_t, std::string, uint32_t> chordLookupFn);
-    void SetChordLeaveCallback (Callback <void, Ipv4Address, uint32_t> chordLeaveFn);
-    void SetPredecessorChangeCallback (Callback <void, Ipv4Address, std::string> predecessorChangeFn);
+    void SetRingStateCallback (Callback <void, GUChordMessage::RingAggRsp> ringStateFn);
 
     
 
+    // From GUOverlay
+    virtual void Lookup (std::string lookupKey, uint32_t transId);
+    virtual void Join (Ipv4Address landmarkAddress);
+    virtual void Leave ();
+    virtual bool IsResponsibleFor (std::string lookupKey);
+    virtual bool GetHandoverTarget (std::string newcomerId, Ipv4Address newcomerAddress, std::string lookupKey, Ipv4Address &target);
+    virtual void SendPing (Ipv4Address destAddress, std::string pingMessage);
+    virtual void StopOverlay ();
     // From GUApplication
     virtual void ProcessCommand (std::vector<std::string> tokens);
 
@@ -115,33 +180,81 @@ class GUChord : public GUApplication
     virtual void StartApplication (void);
     virtual void StopApplication (void);
 
-    uint32_t m_currentTransactionId;
-    Ptr<Socket> m_socket;
+    Time m_coalesceWindow;
+    uint32_t m_maxDatagramSize;
     Time m_pingTimeout;
     Time m_sendStableTimeout;
     Time m_fixFingerTimeout;
+    Time m_ringAggTimeout;
+    bool m_adaptiveRoutingTable;
+    uint32_t m_maintenanceBudget;       //bytes per second available for exploration
+    Time m_exploreInterval;
+    Time m_peerTimeout;
+    uint32_t m_minRoutingEntries;
+    double m_budgetTokens;              //unspent maintenance budget in bytes
+    Time m_budgetRefillTime;
+    bool m_neighborOfNeighbor;
+    Time m_sizeEstimateInterval;
+    bool m_scaleWithNetworkSize;
+    double m_sizeEstimate;              //current estimate of N, 0 until the first round
     
     uint16_t m_appPort;
+    uint8_t m_wireVersion;              //highest wire format this node speaks
     // Timers
     Timer m_auditPingsTimer;
     Timer m_sendStableTimer;
     Timer m_fixFingerTimer;
+    Timer m_exploreTimer;
+    Timer m_peerExpiryTimer;
+    Timer m_sizeEstimateTimer;
     // Ping tracker
     std::map<uint32_t, Ptr<PingRequest> > m_pingTracker;
+    // Serialized periodic messages, keyed by (type << 8 | wire version); only the transaction id is patched per send
+    std::map<uint16_t, std::vector<uint8_t> > m_messageTemplates;
     // Callbacks
-    Callback <void, Ipv4Address, std::string> m_pingSuccessFn;
-    Callback <void, Ipv4Address, std::string> m_pingFailureFn;
-    Callback <void, Ipv4Address, std::string> m_pingRecvFn;
+    Callback <void, GUChordMessage::RingAggRsp> m_ringStateFn;
 
-    Callback <void, Ipv4Address, uint32_t, std::string, uint32_t> m_chordLookupFn;
-    Callback <void, Ipv4Address, uint32_t> m_chordLeaveFn;
-    Callback <void, Ipv4Address, std::string> m_predecessorChangeFn;
+    // Ring aggregation in progress at this node, keyed by query id
+    struct RingAggState
+      {
+        bool isRoot;
+        Ipv4Address parentAddress;
+        uint32_t pendingChildren;
+        GUChordMessage::RingAggRsp summary;
+        EventId timeoutEvent;
+      };
+    std::map<uint32_t, RingAggState> m_ringAggTracker;
 
     Ipv4Address m_mainAddress;
     Ipv4Address succIP;
     Ipv4Address predIP;
     std::vector<std::string> fingerTestVals;
     std::vector<Finger> fingerTable;    //Finger Table
+    Time m_fingerUpdateTime;            //When fingerTable was last refreshed
+    std::string m_succPredecessor;      //Successor's predecessor, as of the last STABLE_RSP
+
+    // Hierarchical domain of this node ("site/rack"), empty for a flat ring
+    std::string m_domain;
+    std::vector<std::string> m_domainLevels;
+    uint32_t m_maxCrossDomainHops;      //0 for no limit
+    // Nodes known to this node, keyed by Chord ID
+    struct ChordPeer
+      {
+        ChordPeer () : domainKnown (false), wireVersion (WIRE_VERSION_1) {}
+        Ipv4Address address;
+        std::string domain;
+        bool domainKnown;
+        Time lastSeen;
+        uint8_t wireVersion;            //highest wire format the peer is known to speak
+      };
+    std::map<std::string, ChordPeer> m_peerTable;
+    // Finger lists of our own fingers, keyed by the finger's Chord ID
+    struct NeighborFingers
+      {
+        std::vector<std::string> fingerIds;
+        Time lastUpdate;
+      };
+    std::map<std::string, NeighborFingers> m_neighborFingers;
 };
 
 #endif
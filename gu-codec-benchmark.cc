@@ -0,0 +1,582 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Serialization micro-benchmark for GUChordMessage and GUSearchMessage.
+ *
+ *  Serializes and deserializes every message type at realistic payload
+ *  sizes and reports ns/op, bytes/op and heap allocations/op, plus the
+ *  per-hop cost of relaying a FINGERME_REQ. No nodes, sockets or
+ *  simulator events are involved, so it runs in seconds.
+ *
+ *  Copy it into scratch/ of the ns-3 tree holding this module and run
+ *      ./waf --run gu-codec-benchmark
+ *  An optional argument scales the time spent per case, in milliseconds.
+ */
+
+#include "ns3/gu-chord-message.h"
+#include "ns3/gu-search-message.h"
+#include "ns3/packet.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <time.h>
+
+using namespace ns3;
+
+#define BENCH_DEFAULT_CASE_MS 200       //time spent timing each direction of a case
+#define BENCH_MAX_ITERATIONS 1000000
+
+/* Allocation counting: every heap allocation in the process goes through here */
+
+static uint64_t g_allocations = 0;
+
+#if __cplusplus >= 201103L
+#define BENCH_THROW_BAD_ALLOC
+#else
+#define BENCH_THROW_BAD_ALLOC throw (std::bad_alloc)
+#endif
+
+void*
+operator new (size_t size) BENCH_THROW_BAD_ALLOC
+{
+  g_allocations++;
+  void *p = malloc (size > 0 ? size : 1);
+  if (p == 0)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void*
+operator new[] (size_t size) BENCH_THROW_BAD_ALLOC
+{
+  return operator new (size);
+}
+
+void
+operator delete (void *p) throw ()
+{
+  free (p);
+}
+
+void
+operator delete[] (void *p) throw ()
+{
+  free (p);
+}
+
+static uint64_t
+GetNanoseconds ()
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t g_caseNs = (uint64_t) BENCH_DEFAULT_CASE_MS * 1000000;
+
+/* Test data */
+
+static std::string
+MakeId (uint32_t seed)
+{
+  // 40 hex digits, like a SHA1 node ID or key
+  static const char digits[] = "0123456789abcdef";
+  std::string id (40, '0');
+  uint32_t state = seed * 2654435761u + 1;
+  for (uint32_t i = 0; i < id.size (); i++)
+    {
+      state = state * 1103515245u + 12345;
+      id[i] = digits[(state >> 16) & 0xf];
+    }
+  return id;
+}
+
+static Ipv4Address
+MakeAddress (uint32_t seed)
+{
+  return Ipv4Address (0x0a000001 + seed);
+}
+
+static std::set<std::string>
+MakeDocuments (uint32_t count)
+{
+  std::set<std::string> documents;
+  char name[32];
+  for (uint32_t i = 0; i < count; i++)
+    {
+      snprintf (name, sizeof (name), "document-%08u.txt", i);
+      documents.insert (documents.end (), name);
+    }
+  return documents;
+}
+
+/* Timing */
+
+struct Measurement
+  {
+    double nsPerOp;
+    double allocsPerOp;
+  };
+
+template <typename Message>
+static void
+SerializeOnce (const Message &message)
+{
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (message);
+}
+
+template <typename Message>
+static void
+DeserializeOnce (Ptr<Packet> packet, bool payloadViews);
+
+template <>
+void
+DeserializeOnce<GUChordMessage> (Ptr<Packet> packet, bool payloadViews)
+{
+  GUChordMessage message;
+  packet->PeekHeader (message);
+}
+
+template <>
+void
+DeserializeOnce<GUSearchMessage> (Ptr<Packet> packet, bool payloadViews)
+{
+  GUSearchMessage message;
+  message.SetPayloadViews (payloadViews);
+  packet->PeekHeader (message);
+}
+
+// Runs op until the case budget is spent; the first call calibrates the count
+template <typename Op>
+static Measurement
+Measure (Op op)
+{
+  uint64_t start = GetNanoseconds ();
+  op ();
+  uint64_t once = GetNanoseconds () - start;
+  uint64_t iterations = g_caseNs / (once > 0 ? once : 1);
+  iterations = std::max ((uint64_t) 1, std::min (iterations, (uint64_t) BENCH_MAX_ITERATIONS));
+
+  uint64_t allocations = g_allocations;
+  start = GetNanoseconds ();
+  for (uint64_t i = 0; i < iterations; i++)
+    {
+      op ();
+    }
+  Measurement result;
+  result.nsPerOp = (double) (GetNanoseconds () - start) / iterations;
+  result.allocsPerOp = (double) (g_allocations - allocations) / iterations;
+  return result;
+}
+
+template <typename Message>
+class SerializeOp
+{
+  public:
+    SerializeOp (const Message &message) : m_message (message) {}
+    void operator() () const { SerializeOnce (m_message); }
+  private:
+    const Message &m_message;
+};
+
+template <typename Message>
+class DeserializeOp
+{
+  public:
+    DeserializeOp (Ptr<Packet> packet, bool payloadViews) : m_packet (packet), m_payloadViews (payloadViews) {}
+    void operator() () const { DeserializeOnce<Message> (m_packet, m_payloadViews); }
+  private:
+    Ptr<Packet> m_packet;
+    bool m_payloadViews;
+};
+
+static void
+PrintHeading ()
+{
+  std::cout << std::left << std::setw (28) << "case"
+            << std::right << std::setw (10) << "bytes/op"
+            << std::setw (14) << "ser ns/op"
+            << std::setw (14) << "ser allocs"
+            << std::setw (14) << "de ns/op"
+            << std::setw (14) << "de allocs" << std::endl;
+}
+
+template <typename Message>
+static void
+RunCase (const std::string &name, const Message &message, bool payloadViews)
+{
+  Measurement serialize = Measure (SerializeOp<Message> (message));
+
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (message);
+  Measurement deserialize = Measure (DeserializeOp<Message> (packet, payloadViews));
+
+  std::cout << std::left << std::setw (28) << name
+            << std::right << std::setw (10) << packet->GetSize ()
+            << std::fixed << std::setprecision (1)
+            << std::setw (14) << serialize.nsPerOp
+            << std::setw (14) << serialize.allocsPerOp
+            << std::setw (14) << deserialize.nsPerOp
+            << std::setw (14) << deserialize.allocsPerOp << std::endl;
+}
+
+static std::string
+CaseName (std::string type, uint32_t size, uint8_t wireVersion)
+{
+  std::ostringstream name;
+  name << type;
+  if (size > 0)
+    {
+      name << "/" << size;
+    }
+  if (wireVersion > 0)
+    {
+      name << " v" << (uint32_t) wireVersion;
+    }
+  return name.str ();
+}
+
+/* Chord messages */
+
+static void
+RunChord (const std::string &type, GUChordMessage &message, uint32_t size, uint8_t wireVersion)
+{
+  message.SetSenderDomain ("site1/rack2");
+  message.SetWireVersion (wireVersion);
+  RunCase (CaseName (type, size, wireVersion), message, false);
+}
+
+static void
+RunChordMessages (uint8_t wireVersion)
+{
+  static const uint32_t fingerCounts[] = { 4, 16, 40, 160 };
+  const uint32_t fingerCountsSize = sizeof (fingerCounts) / sizeof (fingerCounts[0]);
+  uint32_t transactionId = 1;
+
+  GUChordMessage pingReq (GUChordMessage::PING_REQ, transactionId++);
+  pingReq.SetPingReq ("Ping from node 12");
+  RunChord ("PING_REQ", pingReq, 0, wireVersion);
+
+  GUChordMessage pingRsp (GUChordMessage::PING_RSP, transactionId++);
+  pingRsp.SetPingRsp ("Ping from node 12");
+  RunChord ("PING_RSP", pingRsp, 0, wireVersion);
+
+  GUChordMessage join (GUChordMessage::CHORD_JOIN, transactionId++);
+  join.SetChordJoin (MakeId (1), MakeId (2), MakeAddress (1), MakeAddress (2), WIRE_VERSION_2, 0);
+  RunChord ("CHORD_JOIN", join, 0, wireVersion);
+
+  GUChordMessage joinRsp (GUChordMessage::CHORD_JOIN_RSP, transactionId++);
+  joinRsp.SetChordJoinRsp (MakeId (3), MakeAddress (3), WIRE_VERSION_2);
+  RunChord ("CHORD_JOIN_RSP", joinRsp, 0, wireVersion);
+
+  GUChordMessage ringState (GUChordMessage::RING_STATE, transactionId++);
+  ringState.SetRingState (MakeId (4));
+  RunChord ("RING_STATE", ringState, 0, wireVersion);
+
+  GUChordMessage stableReq (GUChordMessage::STABLE_REQ, transactionId++);
+  stableReq.SetStableReq ();
+  RunChord ("STABLE_REQ", stableReq, 0, wireVersion);
+
+  GUChordMessage stableRsp (GUChordMessage::STABLE_RSP, transactionId++);
+  stableRsp.SetStableRsp (MakeId (5), MakeAddress (5));
+  RunChord ("STABLE_RSP", stableRsp, 0, wireVersion);
+
+  GUChordMessage setPred (GUChordMessage::SET_PRED, transactionId++);
+  setPred.SetSetPred (MakeId (6), MakeAddress (6));
+  RunChord ("SET_PRED", setPred, 0, wireVersion);
+
+  GUChordMessage notify (GUChordMessage::NOTIFY, transactionId++);
+  notify.SetNotify (MakeId (7), MakeAddress (7));
+  RunChord ("NOTIFY", notify, 0, wireVersion);
+
+  GUChordMessage leave (GUChordMessage::CHORD_LEAVE, transactionId++);
+  leave.SetChordLeave (MakeAddress (8), MakeAddress (9), MakeId (8), MakeId (9));
+  RunChord ("CHORD_LEAVE", leave, 0, wireVersion);
+
+  for (uint32_t n = 0; n < fingerCountsSize; n++)
+    {
+      uint32_t count = fingerCounts[n];
+      std::vector<std::string> testIds;
+      std::vector<std::string> fingerIds;
+      std::vector<Ipv4Address> fingerAddresses;
+      for (uint32_t i = 0; i < count; i++)
+        {
+          testIds.push_back (MakeId (100 + i));
+          fingerIds.push_back (MakeId (1000 + i));
+          fingerAddresses.push_back (MakeAddress (1000 + i));
+        }
+      std::vector<std::string> rspIds (fingerIds);
+      std::vector<Ipv4Address> rspAddresses (fingerAddresses);
+      std::vector<Ipv4Address> exploreEntries (fingerAddresses);
+      std::vector<Ipv4Address> fingerList (fingerAddresses);
+
+      GUChordMessage fingerReq (GUChordMessage::FINGERME_REQ, transactionId++);
+      fingerReq.SetFingerReq (testIds, fingerIds, fingerAddresses, MakeAddress (1), 0);
+      RunChord ("FINGERME_REQ", fingerReq, count, wireVersion);
+
+      GUChordMessage fingerRsp (GUChordMessage::FINGERME_RSP, transactionId++);
+      fingerRsp.SetFingerRsp (rspIds, rspAddresses);
+      RunChord ("FINGERME_RSP", fingerRsp, count, wireVersion);
+
+      GUChordMessage exploreRsp (GUChordMessage::EXPLORE_RSP, transactionId++);
+      exploreRsp.SetExploreRsp (exploreEntries);
+      RunChord ("EXPLORE_RSP", exploreRsp, count, wireVersion);
+
+      GUChordMessage fingerListRsp (GUChordMessage::FINGER_LIST_RSP, transactionId++);
+      fingerListRsp.SetFingerListRsp (fingerList);
+      RunChord ("FINGER_LIST_RSP", fingerListRsp, count, wireVersion);
+    }
+
+  GUChordMessage ringAggReq (GUChordMessage::RING_AGG_REQ, transactionId++);
+  ringAggReq.SetRingAggReq (42, 2000, MakeId (10));
+  RunChord ("RING_AGG_REQ", ringAggReq, 0, wireVersion);
+
+  GUChordMessage::RingAggRsp summary;
+  summary.queryId = 42;
+  summary.nodeCount = 1000;
+  summary.minKeys = 3;
+  summary.maxKeys = 250;
+  summary.totalKeys = 50000;
+  summary.inconsistentSuccessors = 2;
+  summary.nodesWithoutFingers = 1;
+  summary.maxFingerAgeMs = 15000;
+  summary.totalFingerAgeMs = 4000000;
+  GUChordMessage ringAggRsp (GUChordMessage::RING_AGG_RSP, transactionId++);
+  ringAggRsp.SetRingAggRsp (summary);
+  RunChord ("RING_AGG_RSP", ringAggRsp, 0, wireVersion);
+
+  GUChordMessage::ChordLookup lookup;
+  lookup.lookupKey = MakeId (11);
+  lookup.originatorAddress = MakeAddress (11);
+  lookup.originatorTransId = 77;
+  lookup.hopCount = 3;
+  lookup.crossDomainHops = 1;
+  lookup.ownerProbe = 0;
+  GUChordMessage chordLookup (GUChordMessage::CHORD_LOOKUP, transactionId++);
+  chordLookup.SetChordLookup (lookup);
+  RunChord ("CHORD_LOOKUP", chordLookup, 0, wireVersion);
+
+  GUChordMessage::ChordLookupRsp response;
+  response.lookupKey = MakeId (11);
+  response.ownerID = MakeId (12);
+  response.ownerAddress = MakeAddress (12);
+  response.originatorTransId = 77;
+  response.hopCount = 4;
+  response.crossDomainHops = 1;
+  GUChordMessage chordLookupRsp (GUChordMessage::CHORD_LOOKUP_RSP, transactionId++);
+  chordLookupRsp.SetChordLookupRsp (response);
+  RunChord ("CHORD_LOOKUP_RSP", chordLookupRsp, 0, wireVersion);
+
+  GUChordMessage exploreReq (GUChordMessage::EXPLORE_REQ, transactionId++);
+  exploreReq.SetExploreReq (MakeId (13), 8);
+  RunChord ("EXPLORE_REQ", exploreReq, 0, wireVersion);
+
+  GUChordMessage fingerListReq (GUChordMessage::FINGER_LIST_REQ, transactionId++);
+  fingerListReq.SetFingerListReq ();
+  RunChord ("FINGER_LIST_REQ", fingerListReq, 0, wireVersion);
+
+  GUChordMessage sizeEstimateReq (GUChordMessage::SIZE_EST_REQ, transactionId++);
+  sizeEstimateReq.SetSizeEstimateReq (1000);
+  RunChord ("SIZE_EST_REQ", sizeEstimateReq, 0, wireVersion);
+
+  GUChordMessage sizeEstimateRsp (GUChordMessage::SIZE_EST_RSP, transactionId++);
+  sizeEstimateRsp.SetSizeEstimateRsp (1000);
+  RunChord ("SIZE_EST_RSP", sizeEstimateRsp, 0, wireVersion);
+}
+
+/* Search messages */
+
+static void
+RunSearchMessages ()
+{
+  static const uint32_t documentCounts[] = { 1, 100, 10000, 100000 };
+  const uint32_t documentCountsSize = sizeof (documentCounts) / sizeof (documentCounts[0]);
+  uint32_t transactionId = 1;
+
+  GUSearchMessage pingReq (GUSearchMessage::PING_REQ, transactionId++);
+  pingReq.SetPingReq ("Ping from node 12");
+  RunCase (CaseName ("PING_REQ", 0, 0), pingReq, false);
+
+  GUSearchMessage pingRsp (GUSearchMessage::PING_RSP, transactionId++);
+  pingRsp.SetPingRsp ("Ping from node 12");
+  RunCase (CaseName ("PING_RSP", 0, 0), pingRsp, false);
+
+  GUSearchMessage countReq (GUSearchMessage::COUNT_REQ, transactionId++);
+  countReq.SetCountReq ("network");
+  RunCase (CaseName ("COUNT_REQ", 0, 0), countReq, false);
+
+  GUSearchMessage countRsp (GUSearchMessage::COUNT_RSP, transactionId++);
+  countRsp.SetCountRsp ("network", 100000);
+  RunCase (CaseName ("COUNT_RSP", 0, 0), countRsp, false);
+
+  for (uint32_t n = 0; n < documentCountsSize; n++)
+    {
+      uint32_t count = documentCounts[n];
+      std::set<std::string> storeDocuments = MakeDocuments (count);
+      std::set<std::string> fetchDocuments = MakeDocuments (count);
+      std::set<std::string> rspDocuments = MakeDocuments (count);
+      std::vector<std::string> searchKeys;
+      searchKeys.push_back ("chord");
+      searchKeys.push_back ("network");
+      searchKeys.push_back ("overlay");
+
+      GUSearchMessage storeReq (GUSearchMessage::STORE_REQ, transactionId++);
+      storeReq.SetStoreReq ("keyword", storeDocuments, 0, 1);
+      RunCase (CaseName ("STORE_REQ", count, 0), storeReq, false);
+      RunCase (CaseName ("STORE_REQ views", count, 0), storeReq, true);
+
+      GUSearchMessage fetchReq (GUSearchMessage::FETCH_REQ, transactionId++);
+      fetchReq.SetFetchReq (12, "keyword", searchKeys, fetchDocuments);
+      RunCase (CaseName ("FETCH_REQ", count, 0), fetchReq, false);
+      RunCase (CaseName ("FETCH_REQ views", count, 0), fetchReq, true);
+
+      GUSearchMessage fetchRsp (GUSearchMessage::FETCH_RSP, transactionId++);
+      fetchRsp.SetFetchRsp (rspDocuments, 0, 1);
+      RunCase (CaseName ("FETCH_RSP", count, 0), fetchRsp, false);
+      RunCase (CaseName ("FETCH_RSP views", count, 0), fetchRsp, true);
+    }
+
+  // A bulk segment carries one serialized message of about a chunk's size
+  std::set<std::string> chunkDocuments = MakeDocuments (50);
+  GUSearchMessage inner (GUSearchMessage::STORE_REQ, transactionId++);
+  inner.SetStoreReq ("keyword", chunkDocuments, 0, 1);
+  Ptr<Packet> innerPacket = Create<Packet> ();
+  innerPacket->AddHeader (inner);
+  GUSearchMessage bulkData (GUSearchMessage::BULK_DATA, transactionId++);
+  bulkData.SetBulkData (7, 3, innerPacket);
+  RunCase (CaseName ("BULK_DATA", innerPacket->GetSize (), 0), bulkData, false);
+
+  std::vector<uint32_t> sacked;
+  for (uint32_t i = 0; i < 32; i++)
+    {
+      sacked.push_back (10 + 2 * i);
+    }
+  GUSearchMessage bulkAck (GUSearchMessage::BULK_ACK, transactionId++);
+  bulkAck.SetBulkAck (7, 9, sacked);
+  RunCase (CaseName ("BULK_ACK", 32, 0), bulkAck, false);
+}
+
+/* Relaying FINGERME_REQ */
+
+// What a relay does on the header-only path: swap the routing header in front of the payload
+class HeaderRelayOp
+{
+  public:
+    HeaderRelayOp (Ptr<Packet> packet) : m_packet (packet) {}
+    void operator() () const
+    {
+      Ptr<Packet> packet = m_packet->Copy ();
+      GUChordMessage route;
+      route.SetRouteOnly (true);
+      uint32_t routeSize = packet->PeekHeader (route);
+      packet->RemoveAtStart (routeSize);
+      route.SetHopCount (route.GetHopCount () + 1);
+      packet->AddHeader (route);
+    }
+  private:
+    Ptr<Packet> m_packet;
+};
+
+// What it did before: decode everything, copy the lists and encode a new message
+class FullRelayOp
+{
+  public:
+    FullRelayOp (Ptr<Packet> packet) : m_packet (packet) {}
+    void operator() () const
+    {
+      GUChordMessage message;
+      m_packet->PeekHeader (message);
+      const GUChordMessage::FingerReq &request = message.GetFingerReq ();
+      std::vector<std::string> testIds = request.testIdentifiers;
+      std::vector<std::string> fingerIds = request.fingerEntries;
+      std::vector<Ipv4Address> fingerAddresses = request.fingerIps;
+      GUChordMessage forward (GUChordMessage::FINGERME_REQ, message.GetTransactionId ());
+      forward.SetFingerReq (testIds, fingerIds, fingerAddresses, request.originatorNode, request.hopCount + 1);
+      forward.SetWireVersion (message.GetWireVersion ());
+      Ptr<Packet> packet = Create<Packet> ();
+      packet->AddHeader (forward);
+    }
+  private:
+    Ptr<Packet> m_packet;
+};
+
+static void
+RunRelayMessages ()
+{
+  static const uint32_t fingerCounts[] = { 4, 16, 40, 160 };
+  std::cout << std::left << std::setw (28) << "case"
+            << std::right << std::setw (10) << "bytes/op"
+            << std::setw (14) << "header ns/op"
+            << std::setw (14) << "header allocs"
+            << std::setw (14) << "full ns/op"
+            << std::setw (14) << "full allocs" << std::endl;
+  for (uint32_t n = 0; n < sizeof (fingerCounts) / sizeof (fingerCounts[0]); n++)
+    {
+      std::vector<std::string> testIds;
+      std::vector<std::string> fingerIds;
+      std::vector<Ipv4Address> fingerAddresses;
+      for (uint32_t i = 0; i < fingerCounts[n]; i++)
+        {
+          testIds.push_back (MakeId (100 + i));
+          fingerIds.push_back (MakeId (1000 + i));
+          fingerAddresses.push_back (MakeAddress (1000 + i));
+        }
+      GUChordMessage fingerReq (GUChordMessage::FINGERME_REQ, 1);
+      fingerReq.SetFingerReq (testIds, fingerIds, fingerAddresses, MakeAddress (1), 0);
+      fingerReq.SetSenderDomain ("site1/rack2");
+      Ptr<Packet> packet = Create<Packet> ();
+      packet->AddHeader (fingerReq);
+
+      Measurement header = Measure (HeaderRelayOp (packet));
+      Measurement full = Measure (FullRelayOp (packet));
+      std::cout << std::left << std::setw (28) << CaseName ("FINGERME_REQ", fingerCounts[n], WIRE_VERSION_1)
+                << std::right << std::setw (10) << packet->GetSize ()
+                << std::fixed << std::setprecision (1)
+                << std::setw (14) << header.nsPerOp
+                << std::setw (14) << header.allocsPerOp
+                << std::setw (14) << full.nsPerOp
+                << std::setw (14) << full.allocsPerOp << std::endl;
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc > 1)
+    {
+      g_caseNs = (uint64_t) atoi (argv[1]) * 1000000;
+    }
+
+  std::cout << "GUChordMessage (/n = finger entries)" << std::endl;
+  PrintHeading ();
+  RunChordMessages (WIRE_VERSION_1);
+  RunChordMessages (WIRE_VERSION_2);
+
+  std::cout << std::endl << "GUSearchMessage (/n = documents)" << std::endl;
+  PrintHeading ();
+  RunSearchMessages ();
+
+  std::cout << std::endl << "Relay hop (/n = finger entries)" << std::endl;
+  RunRelayMessages ();
+  return 0;
+}
@@ -0,0 +1,100 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-document-dictionary.h"
+#include "ns3/assert.h"
+#include <algorithm>
+
+GUDocumentDictionary::GUDocumentDictionary ()
+{
+}
+
+uint32_t
+GUDocumentDictionary::Intern (const std::string &name)
+{
+  std::pair<IdMap::iterator, bool> inserted = m_ids.insert (std::make_pair (name, (uint32_t) m_names.size ()));
+  if (inserted.second)
+    {
+      m_names.push_back (inserted.first);
+    }
+  return inserted.first->second;
+}
+
+bool
+GUDocumentDictionary::Find (const std::string &name, uint32_t &id) const
+{
+  IdMap::const_iterator iter = m_ids.find (name);
+  if (iter == m_ids.end ())
+    {
+      return false;
+    }
+  id = iter->second;
+  return true;
+}
+
+const std::string&
+GUDocumentDictionary::GetName (uint32_t id) const
+{
+  NS_ASSERT (id < m_names.size ());
+  return m_names[id]->first;
+}
+
+uint32_t
+GUDocumentDictionary::GetSize () const
+{
+  return m_names.size ();
+}
+
+void
+GUDocumentDictionary::Materialize (const PostingList &postings, std::set<std::string> &names) const
+{
+  for (PostingList::const_iterator it = postings.begin (); it != postings.end (); it++)
+    {
+      names.insert (GetName (*it));
+    }
+}
+
+void
+GUDocumentDictionary::Insert (PostingList &postings, uint32_t id)
+{
+  // ids are assigned in increasing order, so appending is the common case
+  if (postings.empty () || postings.back () < id)
+    {
+      postings.push_back (id);
+      return;
+    }
+  PostingList::iterator pos = std::lower_bound (postings.begin (), postings.end (), id);
+  if (*pos != id)
+    {
+      postings.insert (pos, id);
+    }
+}
+
+void
+GUDocumentDictionary::Merge (PostingList &postings, PostingList &ids)
+{
+  std::sort (ids.begin (), ids.end ());
+  ids.erase (std::unique (ids.begin (), ids.end ()), ids.end ());
+  if (postings.empty ())
+    {
+      postings.swap (ids);
+      return;
+    }
+  uint32_t middle = postings.size ();
+  postings.insert (postings.end (), ids.begin (), ids.end ());
+  std::inplace_merge (postings.begin (), postings.begin () + middle, postings.end ());
+  postings.erase (std::unique (postings.begin (), postings.end ()), postings.end ());
+}
@@ -0,0 +1,77 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_DOCUMENT_DICTIONARY_H
+#define GU_DOCUMENT_DICTIONARY_H
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ *  Per-node mapping from document names to dense ids. Posting lists hold
+ *  ids rather than names, so the inverted index is a set of flat sorted
+ *  arrays and intersections never compare strings. Ids are local to the
+ *  node: names still go on the wire and are materialized only when a list
+ *  leaves the index.
+ *
+ *  Ids are handed out in first-seen order and never reused, so a key handed
+ *  to another node leaves its names interned here.
+ */
+class GUDocumentDictionary
+{
+  public:
+    // sorted ascending, no duplicates
+    typedef std::vector<uint32_t> PostingList;
+
+    GUDocumentDictionary ();
+
+    /**
+     *  \returns the id of name, assigning the next one if it is new
+     */
+    uint32_t Intern (const std::string &name);
+
+    /**
+     *  \returns false if name has never been interned on this node
+     */
+    bool Find (const std::string &name, uint32_t &id) const;
+
+    const std::string& GetName (uint32_t id) const;
+    uint32_t GetSize () const;
+
+    /**
+     *  \brief Appends the names of postings to names, which keeps them in
+     *  name order as the wire format expects
+     */
+    void Materialize (const PostingList &postings, std::set<std::string> &names) const;
+
+    static void Insert (PostingList &postings, uint32_t id);
+
+    /**
+     *  \brief Adds ids, in any order and possibly repeated, to postings
+     */
+    static void Merge (PostingList &postings, PostingList &ids);
+
+  private:
+    typedef std::map<std::string, uint32_t> IdMap;
+
+    IdMap m_ids;
+    std::vector<IdMap::const_iterator> m_names;  //by id; map nodes never move
+};
+
+#endif
@@ -0,0 +1,300 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Posting-list intersection micro-benchmark.
+ *
+ *  Intersects pairs of posting lists at the sizes a conjunctive query sees
+ *  on its hops and reports ns/op for the merge over name sets that
+ *  ProcessFetchReq used before documents were interned, std::set_intersection
+ *  over id vectors, and each GUPostingIntersection strategy. Every strategy
+ *  is checked against std::set_intersection first.
+ *
+ *  Copy it into scratch/ of the ns-3 tree holding this module and run
+ *      ./waf --run gu-intersect-benchmark
+ *  An optional argument scales the time spent per case, in milliseconds.
+ */
+
+#include "ns3/gu-posting-intersection.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+#define BENCH_DEFAULT_CASE_MS 100       //time spent timing each strategy of a case
+#define BENCH_MAX_ITERATIONS 1000000
+
+typedef GUPostingIntersection::PostingList PostingList;
+
+static uint64_t
+GetNanoseconds ()
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t g_caseNs = (uint64_t) BENCH_DEFAULT_CASE_MS * 1000000;
+
+/* Test data */
+
+// count distinct ids drawn from [0, universe), sorted
+static PostingList
+MakePostings (uint32_t count, uint32_t universe, uint32_t seed)
+{
+  PostingList postings;
+  postings.reserve (count);
+  uint32_t state = seed * 2654435761u + 1;
+  while (postings.size () < count)
+    {
+      state = state * 1103515245u + 12345;
+      postings.push_back (((uint64_t) state * universe) >> 32);
+      if (postings.size () == count)
+        {
+          std::sort (postings.begin (), postings.end ());
+          postings.erase (std::unique (postings.begin (), postings.end ()), postings.end ());
+        }
+    }
+  return postings;
+}
+
+static std::set<std::string>
+MakeNames (const PostingList &postings)
+{
+  std::set<std::string> names;
+  char name[32];
+  for (PostingList::const_iterator it = postings.begin (); it != postings.end (); it++)
+    {
+      snprintf (name, sizeof (name), "document-%08u.txt", *it);
+      names.insert (name);
+    }
+  return names;
+}
+
+/* Timing */
+
+// Runs op until the case budget is spent; the first call calibrates the count
+template <typename Op>
+static double
+Measure (Op op)
+{
+  uint64_t start = GetNanoseconds ();
+  op ();
+  uint64_t once = GetNanoseconds () - start;
+  uint64_t iterations = g_caseNs / (once > 0 ? once : 1);
+  iterations = std::max ((uint64_t) 1, std::min (iterations, (uint64_t) BENCH_MAX_ITERATIONS));
+
+  start = GetNanoseconds ();
+  for (uint64_t i = 0; i < iterations; i++)
+    {
+      op ();
+    }
+  return (double) (GetNanoseconds () - start) / iterations;
+}
+
+// The loop ProcessFetchReq ran over document names
+class NameMergeOp
+{
+  public:
+    NameMergeOp (const std::set<std::string> &a, const std::set<std::string> &b) : m_a (a), m_b (b) {}
+    void operator() () const
+    {
+      std::set<std::string> result;
+      std::set<std::string>::const_iterator i = m_a.begin ();
+      std::set<std::string>::const_iterator j = m_b.begin ();
+      while (i != m_a.end () && j != m_b.end ())
+        {
+          int cmp = i->compare (*j);
+          if (cmp == 0)
+            {
+              result.insert (result.end (), *i);
+              i++;
+              j++;
+            }
+          else if (cmp < 0)
+            {
+              i++;
+            }
+          else
+            {
+              j++;
+            }
+        }
+    }
+  private:
+    const std::set<std::string> &m_a;
+    const std::set<std::string> &m_b;
+};
+
+class StdIntersectOp
+{
+  public:
+    StdIntersectOp (const PostingList &a, const PostingList &b) : m_a (a), m_b (b) {}
+    void operator() () const
+    {
+      PostingList result;
+      std::set_intersection (m_a.begin (), m_a.end (), m_b.begin (), m_b.end (), std::back_inserter (result));
+    }
+  private:
+    const PostingList &m_a;
+    const PostingList &m_b;
+};
+
+typedef void (*IntersectFunction) (const PostingList &a, const PostingList &b, PostingList &result);
+
+class IntersectOp
+{
+  public:
+    IntersectOp (IntersectFunction intersect, const PostingList &a, const PostingList &b)
+      : m_intersect (intersect), m_a (a), m_b (b) {}
+    void operator() () const
+    {
+      PostingList result;
+      m_intersect (m_a, m_b, result);
+    }
+  private:
+    IntersectFunction m_intersect;
+    const PostingList &m_a;
+    const PostingList &m_b;
+};
+
+// Gallop wants the shorter list first
+static void
+GallopOrdered (const PostingList &a, const PostingList &b, PostingList &result)
+{
+  if (a.size () <= b.size ())
+    {
+      GUPostingIntersection::Gallop (a, b, result);
+    }
+  else
+    {
+      GUPostingIntersection::Gallop (b, a, result);
+    }
+}
+
+static bool
+Check (const char *name, IntersectFunction intersect, const PostingList &a, const PostingList &b, const PostingList &expected)
+{
+  PostingList result;
+  intersect (a, b, result);
+  if (result != expected)
+    {
+      std::cout << "MISMATCH: " << name << " returned " << result.size () << " ids, expected " << expected.size () << std::endl;
+      return false;
+    }
+  return true;
+}
+
+static const char*
+StrategyName (GUPostingIntersection::Strategy strategy)
+{
+  switch (strategy)
+    {
+      case GUPostingIntersection::GALLOP:
+        return "gallop";
+      case GUPostingIntersection::SIMD:
+        return "simd";
+      default:
+        return "merge";
+    }
+}
+
+static bool
+RunCase (uint32_t sizeA, uint32_t sizeB)
+{
+  // both lists come from the same universe, so the denser one sets the overlap
+  uint32_t universe = std::max (sizeA, sizeB) * 4;
+  PostingList a = MakePostings (sizeA, universe, 1);
+  PostingList b = MakePostings (sizeB, universe, 2);
+  PostingList expected;
+  std::set_intersection (a.begin (), a.end (), b.begin (), b.end (), std::back_inserter (expected));
+
+  bool ok = Check ("merge", GUPostingIntersection::Merge, a, b, expected)
+    && Check ("gallop", GallopOrdered, a, b, expected)
+    && Check ("simd", GUPostingIntersection::Simd, a, b, expected)
+    && Check ("auto", GUPostingIntersection::Intersect, a, b, expected);
+  if (!ok)
+    {
+      return false;
+    }
+
+  // names only for the smaller cases; building sets of 100k strings dominates the run
+  double names = -1;
+  if (sizeA <= 10000 && sizeB <= 10000)
+    {
+      std::set<std::string> namesA = MakeNames (a);
+      std::set<std::string> namesB = MakeNames (b);
+      names = Measure (NameMergeOp (namesA, namesB));
+    }
+
+  std::ostringstream name;
+  name << a.size () << " x " << b.size ();
+  std::cout << std::left << std::setw (20) << name.str ()
+            << std::right << std::setw (8) << expected.size ()
+            << std::fixed << std::setprecision (1);
+  if (names < 0)
+    {
+      std::cout << std::setw (12) << "-";
+    }
+  else
+    {
+      std::cout << std::setw (12) << names;
+    }
+  std::cout << std::setw (12) << Measure (StdIntersectOp (a, b))
+            << std::setw (12) << Measure (IntersectOp (GUPostingIntersection::Merge, a, b))
+            << std::setw (12) << Measure (IntersectOp (GallopOrdered, a, b))
+            << std::setw (12) << Measure (IntersectOp (GUPostingIntersection::Simd, a, b))
+            << std::setw (12) << Measure (IntersectOp (GUPostingIntersection::Intersect, a, b))
+            << std::setw (8) << StrategyName (GUPostingIntersection::ChooseStrategy (a.size (), b.size ()))
+            << std::endl;
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const uint32_t sizes[][2] = {
+    { 16, 16 }, { 100, 100 }, { 1000, 1000 }, { 10000, 10000 }, { 100000, 100000 },
+    { 1000, 10000 }, { 100, 10000 }, { 10, 10000 }, { 100, 100000 }, { 1000, 100000 },
+  };
+  if (argc > 1)
+    {
+      g_caseNs = (uint64_t) atoi (argv[1]) * 1000000;
+    }
+
+  std::cout << "ns/op per intersection; SIMD " << (GUPostingIntersection::HasSimd () ? "enabled" : "unavailable, falls back to merge") << std::endl;
+  std::cout << std::left << std::setw (20) << "case"
+            << std::right << std::setw (8) << "hits"
+            << std::setw (12) << "names"
+            << std::setw (12) << "std"
+            << std::setw (12) << "merge"
+            << std::setw (12) << "gallop"
+            << std::setw (12) << "simd"
+            << std::setw (12) << "auto"
+            << std::setw (8) << "picks" << std::endl;
+  for (uint32_t n = 0; n < sizeof (sizes) / sizeof (sizes[0]); n++)
+    {
+      if (!RunCase (sizes[n][0], sizes[n][1]))
+        {
+          return 1;
+        }
+    }
+  return 0;
+}
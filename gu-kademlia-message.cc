@@ -0,0 +1,404 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-kademlia-message.h"
+#include "ns3/log.h"
+#include <vector>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("GUKademliaMessage");
+NS_OBJECT_ENSURE_REGISTERED (GUKademliaMessage);
+
+GUKademliaMessage::GUKademliaMessage ()
+  : m_messageType ((MessageType) 0)
+{
+}
+
+GUKademliaMessage::~GUKademliaMessage ()
+{
+}
+
+GUKademliaMessage::GUKademliaMessage (GUKademliaMessage::MessageType messageType, uint32_t transactionId)
+{
+  m_messageType = messageType;
+  m_transactionId = transactionId;
+}
+
+TypeId
+GUKademliaMessage::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("GUKademliaMessage")
+    .SetParent<Header> ()
+    .AddConstructor<GUKademliaMessage> ()
+  ;
+  return tid;
+}
+
+TypeId
+GUKademliaMessage::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+
+uint32_t
+GUKademliaMessage::GetSerializedSize (void) const
+{
+  // size of messageType, transaction id
+  uint32_t size = sizeof (uint8_t) + sizeof (uint32_t);
+  switch (m_messageType)
+    {
+      case PING_REQ:
+        size += m_payload.Get<PingReq> ().GetSerializedSize ();
+        break;
+      case PING_RSP:
+        size += m_payload.Get<PingRsp> ().GetSerializedSize ();
+        break;
+      case FIND_NODE_REQ:
+        size += m_payload.Get<FindNodeReq> ().GetSerializedSize ();
+        break;
+      case FIND_NODE_RSP:
+        size += m_payload.Get<FindNodeRsp> ().GetSerializedSize ();
+        break;
+      default:
+        NS_ASSERT (false);
+    }
+  return size;
+}
+
+void
+GUKademliaMessage::Print (std::ostream &os) const
+{
+  os << "\n****GUKademliaMessage Dump****\n" ;
+  os << "messageType: " << m_messageType << "\n";
+  os << "transactionId: " << m_transactionId << "\n";
+  os << "PAYLOAD:: \n";
+
+  switch (m_messageType)
+    {
+      case PING_REQ:
+        m_payload.Get<PingReq> ().Print (os);
+        break;
+      case PING_RSP:
+        m_payload.Get<PingRsp> ().Print (os);
+        break;
+      case FIND_NODE_REQ:
+        m_payload.Get<FindNodeReq> ().Print (os);
+        break;
+      case FIND_NODE_RSP:
+        m_payload.Get<FindNodeRsp> ().Print (os);
+        break;
+      default:
+        break;
+    }
+  os << "\n****END OF MESSAGE****\n";
+}
+
+void
+GUKademliaMessage::Serialize (Buffer::Iterator start) const
+{
+  Buffer::Iterator i = start;
+  i.WriteU8 (m_messageType);
+  i.WriteHtonU32 (m_transactionId);
+
+  switch (m_messageType)
+    {
+      case PING_REQ:
+        m_payload.Get<PingReq> ().Serialize (i);
+        break;
+      case PING_RSP:
+        m_payload.Get<PingRsp> ().Serialize (i);
+        break;
+      case FIND_NODE_REQ:
+        m_payload.Get<FindNodeReq> ().Serialize (i);
+        break;
+      case FIND_NODE_RSP:
+        m_payload.Get<FindNodeRsp> ().Serialize (i);
+        break;
+      default:
+        NS_ASSERT (false);
+    }
+}
+
+uint32_t
+GUKademliaMessage::Deserialize (Buffer::Iterator start)
+{
+  uint32_t size;
+  Buffer::Iterator i = start;
+  m_messageType = (MessageType) i.ReadU8 ();
+  m_transactionId = i.ReadNtohU32 ();
+
+  size = sizeof (uint8_t) + sizeof (uint32_t);
+
+  switch (m_messageType)
+    {
+      case PING_REQ:
+        size += m_payload.Reset<PingReq> ().Deserialize (i);
+        break;
+      case PING_RSP:
+        size += m_payload.Reset<PingRsp> ().Deserialize (i);
+        break;
+      case FIND_NODE_REQ:
+        size += m_payload.Reset<FindNodeReq> ().Deserialize (i);
+        break;
+      case FIND_NODE_RSP:
+        size += m_payload.Reset<FindNodeRsp> ().Deserialize (i);
+        break;
+      default:
+        NS_ASSERT (false);
+    }
+  return size;
+}
+
+/* PING_REQ */
+
+uint32_t
+GUKademliaMessage::PingReq::GetSerializedSize (void) const
+{
+  uint32_t size;
+  size = sizeof(uint16_t) + pingMessage.length();
+  return size;
+}
+
+void
+GUKademliaMessage::PingReq::Print (std::ostream &os) const
+{
+  os << "PingReq:: Message: " << pingMessage << "\n";
+}
+
+void
+GUKademliaMessage::PingReq::Serialize (Buffer::Iterator &start) const
+{
+  start.WriteU16 (pingMessage.length ());
+  start.Write ((uint8_t *) (const_cast<char*> (pingMessage.c_str())), pingMessage.length());
+}
+
+uint32_t
+GUKademliaMessage::PingReq::Deserialize (Buffer::Iterator &start)
+{
+  ReadWireString (start, pingMessage);
+  return PingReq::GetSerializedSize ();
+}
+
+void
+GUKademliaMessage::SetPingReq (std::string pingMessage)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = PING_REQ;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == PING_REQ);
+    }
+  PingReq &payload = m_payload.GetOrCreate<PingReq> ();
+  payload.pingMessage.swap (pingMessage);
+}
+
+const GUKademliaMessage::PingReq&
+GUKademliaMessage::GetPingReq () const
+{
+  return m_payload.Get<PingReq> ();
+}
+
+/* PING_RSP */
+
+uint32_t
+GUKademliaMessage::PingRsp::GetSerializedSize (void) const
+{
+  uint32_t size;
+  size = sizeof(uint16_t) + pingMessage.length();
+  return size;
+}
+
+void
+GUKademliaMessage::PingRsp::Print (std::ostream &os) const
+{
+  os << "PingRsp:: Message: " << pingMessage << "\n";
+}
+
+void
+GUKademliaMessage::PingRsp::Serialize (Buffer::Iterator &start) const
+{
+  start.WriteU16 (pingMessage.length ());
+  start.Write ((uint8_t *) (const_cast<char*> (pingMessage.c_str())), pingMessage.length());
+}
+
+uint32_t
+GUKademliaMessage::PingRsp::Deserialize (Buffer::Iterator &start)
+{
+  ReadWireString (start, pingMessage);
+  return PingRsp::GetSerializedSize ();
+}
+
+void
+GUKademliaMessage::SetPingRsp (std::string pingMessage)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = PING_RSP;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == PING_RSP);
+    }
+  PingRsp &payload = m_payload.GetOrCreate<PingRsp> ();
+  payload.pingMessage.swap (pingMessage);
+}
+
+const GUKademliaMessage::PingRsp&
+GUKademliaMessage::GetPingRsp () const
+{
+  return m_payload.Get<PingRsp> ();
+}
+
+/* FIND_NODE_REQ */
+
+uint32_t
+GUKademliaMessage::FindNodeReq::GetSerializedSize (void) const
+{
+  uint32_t size;
+  size = WIRE_ID_SIZE;
+  return size;
+}
+
+void
+GUKademliaMessage::FindNodeReq::Print (std::ostream &os) const
+{
+  os << "FindNodeReq:: target: " << targetID << "\n";
+}
+
+void
+GUKademliaMessage::FindNodeReq::Serialize (Buffer::Iterator &start) const
+{
+  WriteWireId (start, targetID);
+}
+
+uint32_t
+GUKademliaMessage::FindNodeReq::Deserialize (Buffer::Iterator &start)
+{
+  ReadWireId (start, targetID);
+  return FindNodeReq::GetSerializedSize ();
+}
+
+void
+GUKademliaMessage::SetFindNodeReq (std::string targetId)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = FIND_NODE_REQ;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == FIND_NODE_REQ);
+    }
+  FindNodeReq &payload = m_payload.GetOrCreate<FindNodeReq> ();
+  payload.targetID.swap (targetId);
+}
+
+const GUKademliaMessage::FindNodeReq&
+GUKademliaMessage::GetFindNodeReq () const
+{
+  return m_payload.Get<FindNodeReq> ();
+}
+
+/* FIND_NODE_RSP */
+
+uint32_t
+GUKademliaMessage::FindNodeRsp::GetSerializedSize (void) const
+{
+  uint32_t size;
+  size = sizeof(uint8_t) + contacts.size() * IPV4_ADDRESS_SIZE;
+  return size;
+}
+
+void
+GUKademliaMessage::FindNodeRsp::Print (std::ostream &os) const
+{
+  os << "FindNodeRsp:: contacts: " << contacts.size() << "\n";
+}
+
+void
+GUKademliaMessage::FindNodeRsp::Serialize (Buffer::Iterator &start) const
+{
+  start.WriteU8 (contacts.size());
+  for (std::vector<Ipv4Address>::const_iterator it = contacts.begin(); it != contacts.end(); it++) {
+    start.WriteHtonU32 ((*it).Get ());
+  }
+}
+
+uint32_t
+GUKademliaMessage::FindNodeRsp::Deserialize (Buffer::Iterator &start)
+{
+  uint8_t count = start.ReadU8 ();
+  for (uint8_t i = 0; i < count; i++) {
+    contacts.push_back (Ipv4Address (start.ReadNtohU32 ()));
+  }
+  return FindNodeRsp::GetSerializedSize ();
+}
+
+void
+GUKademliaMessage::SetFindNodeRsp (std::vector<Ipv4Address> &contacts)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = FIND_NODE_RSP;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == FIND_NODE_RSP);
+    }
+  NS_ASSERT (contacts.size () <= 255);
+  FindNodeRsp &payload = m_payload.GetOrCreate<FindNodeRsp> ();
+  payload.contacts.swap (contacts);
+}
+
+const GUKademliaMessage::FindNodeRsp&
+GUKademliaMessage::GetFindNodeRsp () const
+{
+  return m_payload.Get<FindNodeRsp> ();
+}
+
+/***************************************************************/
+
+void
+GUKademliaMessage::SetMessageType (MessageType messageType)
+{
+  if (messageType != m_messageType)
+    {
+      m_payload.Clear ();
+    }
+  m_messageType = messageType;
+}
+
+GUKademliaMessage::MessageType
+GUKademliaMessage::GetMessageType () const
+{
+  return m_messageType;
+}
+
+void
+GUKademliaMessage::SetTransactionId (uint32_t transactionId)
+{
+  m_transactionId = transactionId;
+}
+
+uint32_t
+GUKademliaMessage::GetTransactionId (void) const
+{
+  return m_transactionId;
+}
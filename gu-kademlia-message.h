@@ -0,0 +1,171 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_KADEMLIA_MESSAGE_H
+#define GU_KADEMLIA_MESSAGE_H
+
+#include "ns3/header.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/packet.h"
+#include "ns3/object.h"
+#include "ns3/gu-tagged-payload.h"
+#include "ns3/gu-payload-view.h"
+#include <vector>
+
+using namespace ns3;
+
+#define IPV4_ADDRESS_SIZE 4
+
+class GUKademliaMessage : public Header
+{
+  public:
+    GUKademliaMessage ();
+    virtual ~GUKademliaMessage ();
+
+
+    enum MessageType
+      {
+        PING_REQ = 1,
+        PING_RSP = 2,
+        FIND_NODE_REQ = 3,
+        FIND_NODE_RSP = 4,
+      };
+
+    GUKademliaMessage (GUKademliaMessage::MessageType messageType, uint32_t transactionId);
+
+    /**
+    *  \brief Sets message type
+    *  \param messageType message type
+    */
+    void SetMessageType (MessageType messageType);
+
+    /**
+     *  \returns message type
+     */
+    MessageType GetMessageType () const;
+
+    /**
+     *  \brief Sets Transaction Id
+     *  \param transactionId Transaction Id of the request
+     */
+    void SetTransactionId (uint32_t transactionId);
+
+    /**
+     *  \returns Transaction Id
+     */
+    uint32_t GetTransactionId () const;
+
+  private:
+    /**
+     *  \cond
+     */
+    MessageType m_messageType;
+    uint32_t m_transactionId;
+    /**
+     *  \endcond
+     */
+  public:
+    static TypeId GetTypeId (void);
+    virtual TypeId GetInstanceTypeId (void) const;
+    void Print (std::ostream &os) const;
+    uint32_t GetSerializedSize (void) const;
+    void Serialize (Buffer::Iterator start) const;
+    uint32_t Deserialize (Buffer::Iterator start);
+
+
+    struct PingReq
+      {
+        void Print (std::ostream &os) const;
+        uint32_t GetSerializedSize (void) const;
+        void Serialize (Buffer::Iterator &start) const;
+        uint32_t Deserialize (Buffer::Iterator &start);
+        // Payload
+        std::string pingMessage;
+      };
+
+    struct PingRsp
+      {
+        void Print (std::ostream &os) const;
+        uint32_t GetSerializedSize (void) const;
+        void Serialize (Buffer::Iterator &start) const;
+        uint32_t Deserialize (Buffer::Iterator &start);
+        // Payload
+        std::string pingMessage;
+      };
+
+    struct FindNodeReq
+      {
+        void Print (std::ostream &os) const;
+        uint32_t GetSerializedSize (void) const;
+        void Serialize (Buffer::Iterator &start) const;
+        uint32_t Deserialize (Buffer::Iterator &start);
+        // Payload
+        std::string targetID;
+      };
+
+    struct FindNodeRsp
+      {
+        void Print (std::ostream &os) const;
+        uint32_t GetSerializedSize (void) const;
+        void Serialize (Buffer::Iterator &start) const;
+        uint32_t Deserialize (Buffer::Iterator &start);
+        // Payload: closest contacts known to the sender, IDs are derived from the addresses
+        std::vector<Ipv4Address> contacts;
+      };
+
+  private:
+    TaggedPayload m_payload;
+
+  public:
+    /**
+     *  \returns PingReq Struct
+     */
+    const PingReq& GetPingReq () const;
+
+    /**
+     *  \brief Sets PingReq message params
+     *  \param message Payload String
+     */
+    void SetPingReq (std::string message);
+
+    /**
+     * \returns PingRsp Struct
+     */
+    const PingRsp& GetPingRsp () const;
+
+    /**
+     *  \brief Sets PingRsp message params
+     *  \param message Payload String
+     */
+    void SetPingRsp (std::string message);
+
+    const FindNodeReq& GetFindNodeReq () const;
+
+    void SetFindNodeReq (std::string targetId);
+
+    const FindNodeRsp& GetFindNodeRsp () const;
+
+    void SetFindNodeRsp (std::vector<Ipv4Address> &contacts);
+
+}; // class GUKademliaMessage
+
+static inline std::ostream& operator<< (std::ostream& os, const GUKademliaMessage& message)
+{
+  message.Print (os);
+  return os;
+}
+
+#endif
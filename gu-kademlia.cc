@@ -0,0 +1,865 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gu-kademlia.h"
+
+#include "ns3/random-variable.h"
+#include "ns3/inet-socket-address.h"
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+using namespace ns3;
+
+NS_OBJECT_ENSURE_REGISTERED (GUKademlia);
+
+TypeId
+GUKademlia::GetTypeId ()
+{
+  static TypeId tid = TypeId ("GUKademlia")
+    .SetParent<GUOverlay> ()
+    .AddConstructor<GUKademlia> ()
+    .AddAttribute ("AppPort",
+                   "Listening port for Application",
+                   UintegerValue (10001),
+                   MakeUintegerAccessor (&GUKademlia::m_appPort),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("PingTimeout",
+                   "Timeout value for PING_REQ in milliseconds",
+                   TimeValue (MilliSeconds (2000)),
+                   MakeTimeAccessor (&GUKademlia::m_pingTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("RpcTimeout",
+                   "Time a FIND_NODE_REQ or bucket probe may go unanswered before the contact is dropped, in milliseconds",
+                   TimeValue (MilliSeconds (1000)),
+                   MakeTimeAccessor (&GUKademlia::m_rpcTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("RefreshInterval",
+                   "Buckets not looked up within this interval are refreshed, in milliseconds",
+                   TimeValue (MilliSeconds (60000)),
+                   MakeTimeAccessor (&GUKademlia::m_refreshInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("BucketSize",
+                   "Contacts per k-bucket (k), also the number of closest nodes a lookup converges on",
+                   UintegerValue (20),
+                   MakeUintegerAccessor (&GUKademlia::m_bucketSize),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("Alpha",
+                   "FIND_NODE requests a lookup keeps in flight",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&GUKademlia::m_alpha),
+                   MakeUintegerChecker<uint32_t> (1))
+    ;
+  return tid;
+}
+
+GUKademlia::GUKademlia ()
+  : m_auditPingsTimer (Timer::CANCEL_ON_DESTROY),
+    m_refreshTimer (Timer::CANCEL_ON_DESTROY)
+{
+  SeedManager::SetSeed (time (NULL));
+}
+
+GUKademlia::~GUKademlia ()
+{
+
+}
+
+void
+GUKademlia::DoDispose ()
+{
+  StopApplication ();
+  GUApplication::DoDispose ();
+}
+
+void
+GUKademlia::StartApplication (void)
+{
+  AttachTransport (m_appPort, MakeCallback (&GUKademlia::HandleMessage, this));
+
+  std::stringstream nodeNumber;
+  nodeNumber << GetNode ()->GetId ();
+  m_mainAddress = ResolveNodeIpAddress (nodeNumber.str ());
+  m_nodeId = ComputeNodeId (m_mainAddress);
+
+  m_buckets.assign (KADEMLIA_ID_BITS, std::list<KademliaContact> ());
+  m_bucketLastLookup.assign (KADEMLIA_ID_BITS, Simulator::Now ());
+
+  // Configure timers
+  m_auditPingsTimer.SetFunction (&GUKademlia::AuditPings, this);
+  m_refreshTimer.SetFunction (&GUKademlia::RefreshBuckets, this);
+  // Start timers
+  m_auditPingsTimer.Schedule (m_pingTimeout);
+  m_refreshTimer.Schedule (m_refreshInterval);
+}
+
+void
+GUKademlia::StopApplication (void)
+{
+  DetachTransport ();
+
+  // Cancel timers
+  m_auditPingsTimer.Cancel ();
+  m_refreshTimer.Cancel ();
+
+  std::map<uint32_t, PendingFindNode>::iterator rpcIter;
+  for (rpcIter = m_findNodeTracker.begin (); rpcIter != m_findNodeTracker.end (); rpcIter++)
+    {
+      rpcIter->second.timeoutEvent.Cancel ();
+    }
+  std::map<uint32_t, BucketProbe>::iterator probeIter;
+  for (probeIter = m_bucketProbeTracker.begin (); probeIter != m_bucketProbeTracker.end (); probeIter++)
+    {
+      probeIter->second.timeoutEvent.Cancel ();
+    }
+
+  m_pingTracker.clear ();
+  m_findNodeTracker.clear ();
+  m_bucketProbeTracker.clear ();
+  m_lookupTracker.clear ();
+  m_buckets.clear ();
+}
+
+void
+GUKademlia::ProcessCommand (std::vector<std::string> tokens)
+{
+  std::vector<std::string>::iterator iterator = tokens.begin();
+  std::string command = *iterator;
+
+  if (command == "JOIN")
+    {
+      if (tokens.size() < 2)
+        {
+          ERROR_LOG ("Insufficient KADEMLIA params...");
+          return;
+        }
+      iterator++;
+      Ipv4Address landmarkAddress = ResolveNodeIpAddress (*iterator);
+      Join (landmarkAddress);
+    }
+  else if (command == "LEAVE")
+    {
+      Leave ();
+    }
+  else if (command == "ROUTES")
+    {
+      uint32_t contacts = 0;
+      for (uint32_t i = 0; i < m_buckets.size (); i++)
+        {
+          if (m_buckets[i].empty ())
+            {
+              continue;
+            }
+          contacts += m_buckets[i].size ();
+          CHORD_LOG ("Bucket[" << i << "]: " << m_buckets[i].size () << " contacts");
+        }
+      CHORD_LOG ("Network Node: " << ReverseLookup (m_mainAddress) << " Node ID: " << m_nodeId << " Contacts: " << contacts);
+    }
+}
+
+/********************************************************************************************/
+
+// IDs are the 40 hex digit SHA1 strings GUChord uses, so both overlays agree on the key space
+
+std::string
+GUKademlia::ComputeNodeId (Ipv4Address address)
+{
+  uint8_t seperateBytes[5];
+  char value[32];
+
+  address.Serialize (seperateBytes);
+  uint32_t totalVal = seperateBytes[0] + seperateBytes[1] + seperateBytes[2] + seperateBytes[3];
+  sprintf (value, "%d", totalVal);
+
+  unsigned char digest[SHA_DIGEST_LENGTH];
+  std::string input = (std::string) value;
+  SHA1 ((unsigned char*) input.c_str (), input.size (), digest);
+
+  char mdString[SHA_DIGEST_LENGTH*2+1];
+  for (int i = 0; i < SHA_DIGEST_LENGTH; i++)
+    {
+      sprintf (&mdString[i*2], "%02x", (unsigned int) digest[i]);
+    }
+  return (std::string) mdString;
+}
+
+std::string
+GUKademlia::XorDistance (std::string id1, std::string id2)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  std::string distance (id1.length (), '0');
+  for (uint32_t i = 0; i < id1.length () && i < id2.length (); i++)
+    {
+      uint32_t a = (id1[i] >= 'a') ? (id1[i] - 'a' + 10) : (id1[i] - '0');
+      uint32_t b = (id2[i] >= 'a') ? (id2[i] - 'a' + 10) : (id2[i] - '0');
+      distance[i] = hexDigits[a ^ b];
+    }
+  return distance;
+}
+
+int32_t
+GUKademlia::GetBucketIndex (std::string id)
+{
+  std::string distance = XorDistance (m_nodeId, id);
+  for (uint32_t i = 0; i < distance.length (); i++)
+    {
+      uint32_t digit = (distance[i] >= 'a') ? (distance[i] - 'a' + 10) : (distance[i] - '0');
+      if (digit == 0)
+        {
+          continue;
+        }
+      int32_t highBit = 3;
+      while (!(digit & (1 << highBit)))
+        {
+          highBit--;
+        }
+      return (distance.length () - 1 - i) * 4 + highBit;
+    }
+  // our own ID
+  return -1;
+}
+
+std::string
+GUKademlia::GetRandomIdInBucket (uint32_t index)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  UniformVariable random;
+  // distance with bit 'index' set, random below it and clear above
+  std::string distance (m_nodeId.length (), '0');
+  for (uint32_t i = 0; i < distance.length (); i++)
+    {
+      uint32_t digit = 0;
+      for (int32_t bit = 3; bit >= 0; bit--)
+        {
+          uint32_t position = (distance.length () - 1 - i) * 4 + bit;
+          if (position == index || (position < index && random.GetInteger (0, 1)))
+            {
+              digit |= (1 << bit);
+            }
+        }
+      distance[i] = hexDigits[digit];
+    }
+  return XorDistance (m_nodeId, distance);
+}
+
+/********************************************************************************************/
+
+// Routing table. Every message refreshes its sender; a newcomer to a full
+// bucket only replaces the least recently seen contact if that contact fails
+// to answer a ping, so long-lived nodes are preferred.
+
+void
+GUKademlia::UpdateContact (Ipv4Address address)
+{
+  if (address == m_mainAddress || address == Ipv4Address::GetAny () || m_buckets.empty ())
+    {
+      return;
+    }
+
+  std::string id = ComputeNodeId (address);
+  int32_t index = GetBucketIndex (id);
+  if (index < 0)
+    {
+      return;
+    }
+
+  std::list<KademliaContact> &bucket = m_buckets[index];
+  std::list<KademliaContact>::iterator iter;
+  for (iter = bucket.begin (); iter != bucket.end (); iter++)
+    {
+      if (iter->id == id)
+        {
+          // move to the most recently seen end
+          bucket.splice (bucket.end (), bucket, iter);
+          return;
+        }
+    }
+
+  if (bucket.size () < m_bucketSize)
+    {
+      KademliaContact contact;
+      contact.id = id;
+      contact.address = address;
+      bucket.push_back (contact);
+      // the newcomer may now be closer than us to some of our keys
+      if (!m_ownershipChangeFn.IsNull ())
+        {
+          m_ownershipChangeFn (address, id);
+        }
+      return;
+    }
+
+  // Bucket full: a least recently seen contact that any layer heard from lately is alive
+  if (GetLiveness ()->HeardWithin (bucket.front ().address, m_pingTimeout))
+    {
+      bucket.splice (bucket.end (), bucket, bucket.begin ());
+      return;
+    }
+
+  // Otherwise probe it, once
+  std::map<uint32_t, BucketProbe>::iterator probeIter;
+  for (probeIter = m_bucketProbeTracker.begin (); probeIter != m_bucketProbeTracker.end (); probeIter++)
+    {
+      if (probeIter->second.staleId == bucket.front ().id)
+        {
+          return;
+        }
+    }
+
+  uint32_t transactionId = GetNextTransactionId ();
+  BucketProbe probe;
+  probe.staleId = bucket.front ().id;
+  probe.candidateAddress = address;
+  probe.timeoutEvent = Simulator::Schedule (m_rpcTimeout, &GUKademlia::HandleBucketProbeTimeout, this, transactionId);
+  m_bucketProbeTracker[transactionId] = probe;
+
+  GUKademliaMessage message = GUKademliaMessage (GUKademliaMessage::PING_REQ, transactionId);
+  message.SetPingReq ("KBUCKET");
+  SendMessage (bucket.front ().address, message);
+}
+
+void
+GUKademlia::RemoveContact (std::string id)
+{
+  int32_t index = GetBucketIndex (id);
+  if (index < 0 || m_buckets.empty ())
+    {
+      return;
+    }
+
+  std::list<KademliaContact> &bucket = m_buckets[index];
+  std::list<KademliaContact>::iterator iter;
+  for (iter = bucket.begin (); iter != bucket.end (); iter++)
+    {
+      if (iter->id == id)
+        {
+          bucket.erase (iter);
+          return;
+        }
+    }
+}
+
+void
+GUKademlia::HandleBucketProbeTimeout (uint32_t transactionId)
+{
+  std::map<uint32_t, BucketProbe>::iterator iter = m_bucketProbeTracker.find (transactionId);
+  if (iter == m_bucketProbeTracker.end ())
+    {
+      return;
+    }
+  BucketProbe probe = iter->second;
+  m_bucketProbeTracker.erase (iter);
+
+  DEBUG_LOG ("Bucket probe expired, replacing contact: " << probe.staleId);
+  RemoveContact (probe.staleId);
+  UpdateContact (probe.candidateAddress);
+}
+
+std::vector<Ipv4Address>
+GUKademlia::GetClosestContacts (std::string targetId, uint32_t count, Ipv4Address excludeAddress)
+{
+  std::map<std::string, Ipv4Address> byDistance;
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      std::list<KademliaContact>::iterator iter;
+      for (iter = m_buckets[i].begin (); iter != m_buckets[i].end (); iter++)
+        {
+          if (iter->address != excludeAddress)
+            {
+              byDistance[XorDistance (iter->id, targetId)] = iter->address;
+            }
+        }
+    }
+
+  std::vector<Ipv4Address> contacts;
+  std::map<std::string, Ipv4Address>::iterator iter;
+  for (iter = byDistance.begin (); iter != byDistance.end () && contacts.size () < count; iter++)
+    {
+      contacts.push_back (iter->second);
+    }
+  return contacts;
+}
+
+void
+GUKademlia::RefreshBuckets ()
+{
+  // Buckets below the lowest occupied one are empty by construction; refresh the rest if idle
+  int32_t lowest = -1;
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      if (!m_buckets[i].empty ())
+        {
+          lowest = i;
+          break;
+        }
+    }
+
+  if (lowest >= 0)
+    {
+      for (uint32_t i = lowest; i < m_buckets.size (); i++)
+        {
+          if (m_bucketLastLookup[i] + m_refreshInterval <= Simulator::Now ())
+            {
+              StartNodeLookup (GetRandomIdInBucket (i), 0, false);
+            }
+        }
+    }
+
+  m_refreshTimer.Schedule (m_refreshInterval);
+}
+
+/********************************************************************************************/
+
+// Iterative lookup. The shortlist is ordered by XOR distance to the target and
+// starts with our own closest contacts plus ourselves. At most Alpha of the
+// closest BucketSize unqueried nodes are asked at a time; the lookup ends once
+// every one of the BucketSize closest live nodes has answered, and the closest
+// of them owns the key.
+
+void
+GUKademlia::StartNodeLookup (std::string targetId, uint32_t transId, bool notify)
+{
+  int32_t index = GetBucketIndex (targetId);
+  if (index >= 0 && !m_bucketLastLookup.empty ())
+    {
+      m_bucketLastLookup[index] = Simulator::Now ();
+    }
+
+  uint32_t lookupId = GetNextTransactionId ();
+  NodeLookup &lookup = m_lookupTracker[lookupId];
+  lookup.targetId = targetId;
+  lookup.transId = transId;
+  lookup.notify = notify;
+  lookup.inFlight = 0;
+  lookup.messagesSent = 0;
+
+  LookupCandidate self;
+  self.id = m_nodeId;
+  self.address = m_mainAddress;
+  self.state = CANDIDATE_RESPONDED;
+  lookup.shortlist[XorDistance (m_nodeId, targetId)] = self;
+
+  std::vector<Ipv4Address> contacts = GetClosestContacts (targetId, m_bucketSize, Ipv4Address::GetAny ());
+  for (uint32_t i = 0; i < contacts.size (); i++)
+    {
+      LookupCandidate candidate;
+      candidate.id = ComputeNodeId (contacts[i]);
+      candidate.address = contacts[i];
+      candidate.state = CANDIDATE_NEW;
+      lookup.shortlist[XorDistance (candidate.id, targetId)] = candidate;
+    }
+
+  StepNodeLookup (lookupId);
+}
+
+void
+GUKademlia::StepNodeLookup (uint32_t lookupId)
+{
+  std::map<uint32_t, NodeLookup>::iterator lookupIter = m_lookupTracker.find (lookupId);
+  if (lookupIter == m_lookupTracker.end ())
+    {
+      return;
+    }
+  NodeLookup &lookup = lookupIter->second;
+
+  uint32_t considered = 0;
+  bool unfinished = false;
+  std::map<std::string, LookupCandidate>::iterator iter;
+  for (iter = lookup.shortlist.begin (); iter != lookup.shortlist.end () && considered < m_bucketSize; iter++)
+    {
+      LookupCandidate &candidate = iter->second;
+      if (candidate.state == CANDIDATE_FAILED)
+        {
+          continue;
+        }
+      considered++;
+
+      if (candidate.state == CANDIDATE_NEW && lookup.inFlight < m_alpha)
+        {
+          uint32_t transactionId = GetNextTransactionId ();
+          PendingFindNode pending;
+          pending.lookupId = lookupId;
+          pending.distance = iter->first;
+          pending.timeoutEvent = Simulator::Schedule (m_rpcTimeout, &GUKademlia::HandleFindNodeTimeout, this, transactionId);
+          m_findNodeTracker[transactionId] = pending;
+
+          GUKademliaMessage message = GUKademliaMessage (GUKademliaMessage::FIND_NODE_REQ, transactionId);
+          message.SetFindNodeReq (lookup.targetId);
+          SendMessage (candidate.address, message);
+
+          candidate.state = CANDIDATE_QUERIED;
+          lookup.inFlight++;
+          lookup.messagesSent++;
+        }
+      if (candidate.state != CANDIDATE_RESPONDED)
+        {
+          unfinished = true;
+        }
+    }
+
+  if (!unfinished)
+    {
+      FinishNodeLookup (lookupId);
+    }
+}
+
+void
+GUKademlia::FinishNodeLookup (uint32_t lookupId)
+{
+  std::map<uint32_t, NodeLookup>::iterator lookupIter = m_lookupTracker.find (lookupId);
+  if (lookupIter == m_lookupTracker.end ())
+    {
+      return;
+    }
+  NodeLookup lookup = lookupIter->second;
+  m_lookupTracker.erase (lookupIter);
+
+  // closest node that answered; we are in the shortlist ourselves, so there always is one
+  std::map<std::string, LookupCandidate>::iterator iter;
+  for (iter = lookup.shortlist.begin (); iter != lookup.shortlist.end (); iter++)
+    {
+      if (iter->second.state == CANDIDATE_RESPONDED)
+        {
+          break;
+        }
+    }
+  if (iter == lookup.shortlist.end () || !lookup.notify)
+    {
+      return;
+    }
+
+  LookupCandidate owner = iter->second;
+  CHORD_LOG ("LookupResult< key: " << lookup.targetId << ", owner: " << ReverseLookup (owner.address) << ", messages: " << lookup.messagesSent << " >");
+
+  uint32_t ownerNum;
+  std::istringstream sin (ReverseLookup (owner.address));
+  sin >> ownerNum;
+
+  if (!m_lookupFn.IsNull ())
+    {
+      m_lookupFn (owner.address, ownerNum, owner.id, lookup.transId);
+    }
+}
+
+void
+GUKademlia::HandleFindNodeTimeout (uint32_t transactionId)
+{
+  std::map<uint32_t, PendingFindNode>::iterator iter = m_findNodeTracker.find (transactionId);
+  if (iter == m_findNodeTracker.end ())
+    {
+      return;
+    }
+  PendingFindNode pending = iter->second;
+  m_findNodeTracker.erase (iter);
+
+  std::map<uint32_t, NodeLookup>::iterator lookupIter = m_lookupTracker.find (pending.lookupId);
+  if (lookupIter == m_lookupTracker.end ())
+    {
+      return;
+    }
+  LookupCandidate &candidate = lookupIter->second.shortlist[pending.distance];
+  DEBUG_LOG ("FIND_NODE_REQ expired, dropping contact: " << ReverseLookup (candidate.address));
+  candidate.state = CANDIDATE_FAILED;
+  lookupIter->second.inFlight--;
+  RemoveContact (candidate.id);
+
+  StepNodeLookup (pending.lookupId);
+}
+
+void
+GUKademlia::ProcessFindNodeReq (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
+{
+  std::vector<Ipv4Address> contacts = GetClosestContacts (message.GetFindNodeReq ().targetID, m_bucketSize, sourceAddress);
+
+  GUKademliaMessage resp = GUKademliaMessage (GUKademliaMessage::FIND_NODE_RSP, message.GetTransactionId ());
+  resp.SetFindNodeRsp (contacts);
+  SendMessage (sourceAddress, resp);
+}
+
+void
+GUKademlia::ProcessFindNodeRsp (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
+{
+  std::map<uint32_t, PendingFindNode>::iterator iter = m_findNodeTracker.find (message.GetTransactionId ());
+  if (iter == m_findNodeTracker.end ())
+    {
+      DEBUG_LOG ("Received late or invalid FIND_NODE_RSP!");
+      return;
+    }
+  PendingFindNode pending = iter->second;
+  pending.timeoutEvent.Cancel ();
+  m_findNodeTracker.erase (iter);
+
+  std::map<uint32_t, NodeLookup>::iterator lookupIter = m_lookupTracker.find (pending.lookupId);
+  if (lookupIter == m_lookupTracker.end ())
+    {
+      return;
+    }
+  NodeLookup &lookup = lookupIter->second;
+  lookup.shortlist[pending.distance].state = CANDIDATE_RESPONDED;
+  lookup.inFlight--;
+
+  const std::vector<Ipv4Address> &contacts = message.GetFindNodeRsp ().contacts;
+  for (uint32_t i = 0; i < contacts.size (); i++)
+    {
+      if (contacts[i] == m_mainAddress)
+        {
+          continue;
+        }
+      std::string id = ComputeNodeId (contacts[i]);
+      std::string distance = XorDistance (id, lookup.targetId);
+      if (lookup.shortlist.find (distance) == lookup.shortlist.end ())
+        {
+          LookupCandidate candidate;
+          candidate.id = id;
+          candidate.address = contacts[i];
+          candidate.state = CANDIDATE_NEW;
+          lookup.shortlist[distance] = candidate;
+        }
+    }
+
+  StepNodeLookup (pending.lookupId);
+}
+
+/********************************************************************************************/
+
+void
+GUKademlia::Lookup (std::string lookupKey, uint32_t transId)
+{
+  StartNodeLookup (lookupKey, transId, true);
+}
+
+void
+GUKademlia::Join (Ipv4Address landmarkAddress)
+{
+  if (landmarkAddress == m_mainAddress)
+    {
+      CHORD_LOG ("Network Node: " << ReverseLookup (m_mainAddress) << " started a Kademlia overlay");
+      return;
+    }
+  // Learn the landmark, then look ourselves up to fill the buckets near us
+  UpdateContact (landmarkAddress);
+  StartNodeLookup (m_nodeId, 0, false);
+}
+
+void
+GUKademlia::Leave ()
+{
+  // Kademlia has no leave protocol; hand our keys to the closest contact and stop answering
+  std::vector<Ipv4Address> closest = GetClosestContacts (m_nodeId, 1, Ipv4Address::GetAny ());
+  if (!closest.empty () && !m_leaveFn.IsNull ())
+    {
+      uint32_t nodeNum;
+      std::istringstream sin (ReverseLookup (closest[0]));
+      sin >> nodeNum;
+      m_leaveFn (closest[0], nodeNum);
+    }
+  StopApplication ();
+}
+
+bool
+GUKademlia::IsResponsibleFor (std::string lookupKey)
+{
+  std::string ownDistance = XorDistance (m_nodeId, lookupKey);
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      std::list<KademliaContact>::iterator iter;
+      for (iter = m_buckets[i].begin (); iter != m_buckets[i].end (); iter++)
+        {
+          if (XorDistance (iter->id, lookupKey) < ownDistance)
+            {
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+bool
+GUKademlia::GetHandoverTarget (std::string newcomerId, Ipv4Address newcomerAddress, std::string lookupKey, Ipv4Address &target)
+{
+  // Only a newcomer closer than us can displace a key; others leave it where it is
+  std::string ownDistance = XorDistance (m_nodeId, lookupKey);
+  std::string closestDistance = XorDistance (newcomerId, lookupKey);
+  if (!(closestDistance < ownDistance))
+    {
+      return false;
+    }
+  // it belongs at the closest contact we know, which need not be the newcomer
+  target = newcomerAddress;
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      std::list<KademliaContact>::iterator iter;
+      for (iter = m_buckets[i].begin (); iter != m_buckets[i].end (); iter++)
+        {
+          std::string distance = XorDistance (iter->id, lookupKey);
+          if (distance < closestDistance)
+            {
+              closestDistance = distance;
+              target = iter->address;
+            }
+        }
+    }
+  return true;
+}
+
+void
+GUKademlia::StopOverlay ()
+{
+  StopApplication ();
+}
+
+/********************************************************************************************/
+
+void
+GUKademlia::SendMessage (Ipv4Address destAddress, const GUKademliaMessage &message)
+{
+  if (!m_transport->IsOpen ())
+    {
+      return;
+    }
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (message);
+  m_transport->Send (GUTransport::OVERLAY_LAYER, packet, destAddress, m_transport->GetPort ());
+}
+
+void
+GUKademlia::HandleMessage (Ptr<Packet> packet, Ipv4Address sourceAddress, uint16_t sourcePort)
+{
+  GUKademliaMessage message;
+  packet->RemoveHeader (message);
+
+  UpdateContact (sourceAddress);
+
+  static const MessageHandler handlers[] =
+    {
+      0,
+      &GUKademlia::ProcessPingReq,     // PING_REQ
+      &GUKademlia::ProcessPingRsp,     // PING_RSP
+      &GUKademlia::ProcessFindNodeReq, // FIND_NODE_REQ
+      &GUKademlia::ProcessFindNodeRsp, // FIND_NODE_RSP
+    };
+  // fails to compile if a message type is added without a handler
+  typedef char HandlerTableIsComplete[(sizeof (handlers) / sizeof (handlers[0]) == GUKademliaMessage::FIND_NODE_RSP + 1) ? 1 : -1];
+  (void) sizeof (HandlerTableIsComplete);
+
+  uint32_t messageType = message.GetMessageType ();
+  if (messageType == 0 || messageType >= sizeof (handlers) / sizeof (handlers[0]))
+    {
+      ERROR_LOG ("Unknown Message Type!");
+      return;
+    }
+  (this->*handlers[messageType]) (message, sourceAddress, sourcePort);
+}
+
+void
+GUKademlia::SendPing (Ipv4Address destAddress, std::string pingMessage)
+{
+  if (destAddress != Ipv4Address::GetAny ())
+    {
+      uint32_t transactionId = GetNextTransactionId ();
+      CHORD_LOG ("Sending PING_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " Message: " << pingMessage << " transactionId: " << transactionId);
+      Ptr<PingRequest> pingRequest = Create<PingRequest> (transactionId, Simulator::Now(), destAddress, pingMessage);
+      // Add to ping-tracker
+      m_pingTracker.insert (std::make_pair (transactionId, pingRequest));
+      GUKademliaMessage message = GUKademliaMessage (GUKademliaMessage::PING_REQ, transactionId);
+      message.SetPingReq (pingMessage);
+      SendMessage (destAddress, message);
+    }
+  else
+    {
+      // Report failure
+      m_pingFailureFn (destAddress, pingMessage);
+    }
+}
+
+void
+GUKademlia::ProcessPingReq (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
+{
+  // Send Ping Response
+  GUKademliaMessage resp = GUKademliaMessage (GUKademliaMessage::PING_RSP, message.GetTransactionId());
+  resp.SetPingRsp (message.GetPingReq().pingMessage);
+  SendMessage (sourceAddress, resp);
+
+  // Bucket probes are internal to the routing table
+  if (message.GetPingReq().pingMessage != "KBUCKET")
+    {
+      CHORD_LOG ("Received PING_REQ, From Node: " << ReverseLookup (sourceAddress) << ", Message: " << message.GetPingReq().pingMessage);
+      // Send indication to application layer
+      m_pingRecvFn (sourceAddress, message.GetPingReq().pingMessage);
+    }
+}
+
+void
+GUKademlia::ProcessPingRsp (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
+{
+  // A probed contact is alive: HandleMessage already moved it to the tail, drop the newcomer
+  std::map<uint32_t, BucketProbe>::iterator probeIter = m_bucketProbeTracker.find (message.GetTransactionId ());
+  if (probeIter != m_bucketProbeTracker.end ())
+    {
+      probeIter->second.timeoutEvent.Cancel ();
+      m_bucketProbeTracker.erase (probeIter);
+      return;
+    }
+
+  // Remove from pingTracker
+  std::map<uint32_t, Ptr<PingRequest> >::iterator iter;
+  iter = m_pingTracker.find (message.GetTransactionId ());
+  if (iter != m_pingTracker.end ())
+    {
+      std::string fromNode = ReverseLookup (sourceAddress);
+      CHORD_LOG ("Received PING_RSP, From Node: " << fromNode << ", Message: " << message.GetPingRsp().pingMessage);
+      GetLiveness ()->RecordRtt (sourceAddress, Simulator::Now () - iter->second->GetTimestamp ());
+      m_pingTracker.erase (iter);
+      // Send indication to application layer
+      m_pingSuccessFn (sourceAddress, message.GetPingRsp().pingMessage);
+    }
+  else
+    {
+      DEBUG_LOG ("Received invalid PING_RSP!");
+    }
+}
+
+void
+GUKademlia::AuditPings ()
+{
+  std::map<uint32_t, Ptr<PingRequest> >::iterator iter;
+  for (iter = m_pingTracker.begin () ; iter != m_pingTracker.end();)
+    {
+      Ptr<PingRequest> pingRequest = iter->second;
+      if (pingRequest->GetTimestamp().GetMilliSeconds() + m_pingTimeout.GetMilliSeconds() <= Simulator::Now().GetMilliSeconds())
+        {
+          DEBUG_LOG ("Ping expired. Message: " << pingRequest->GetPingMessage () << " Timestamp: " << pingRequest->GetTimestamp().GetMilliSeconds () << " CurrentTime: " << Simulator::Now().GetMilliSeconds ());
+          // Remove stale entries
+          m_pingTracker.erase (iter++);
+          // Send indication to application layer
+          m_pingFailureFn (pingRequest->GetDestinationAddress(), pingRequest->GetPingMessage ());
+        }
+      else
+        {
+          ++iter;
+        }
+    }
+  // Rechedule timer
+  m_auditPingsTimer.Schedule (m_pingTimeout);
+}
+
+uint32_t
+GUKademlia::GetNextTransactionId ()
+{
+  return m_transport->GetNextTransactionId ();
+}
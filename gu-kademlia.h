@@ -0,0 +1,164 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_KADEMLIA_H
+#define GU_KADEMLIA_H
+
+#include "ns3/gu-overlay.h"
+#include "ns3/gu-kademlia-message.h"
+#include "ns3/ping-request.h"
+
+#include "ns3/ipv4-address.h"
+#include <map>
+#include <list>
+#include <vector>
+#include <string>
+#include "ns3/socket.h"
+#include "ns3/nstime.h"
+#include "ns3/timer.h"
+#include "ns3/event-id.h"
+#include "ns3/uinteger.h"
+
+using namespace ns3;
+
+#define KADEMLIA_ID_BITS 160
+
+// Kademlia backend for GUSearch. A key is owned by the live node whose ID is
+// closest to it in XOR distance; lookups are iterative, with up to Alpha
+// FIND_NODE requests in flight, over k-buckets of BucketSize contacts.
+class GUKademlia : public GUOverlay
+{
+  public:
+    static TypeId GetTypeId (void);
+    GUKademlia ();
+    virtual ~GUKademlia ();
+
+    void SendMessage (Ipv4Address destAddress, const GUKademliaMessage &message);
+    void HandleMessage (Ptr<Packet> packet, Ipv4Address sourceAddress, uint16_t sourcePort);
+    // Receive dispatch, indexed by GUKademliaMessage::MessageType
+    typedef void (GUKademlia::*MessageHandler) (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessPingReq (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessPingRsp (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFindNodeReq (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFindNodeRsp (const GUKademliaMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+
+    // ID space
+    std::string ComputeNodeId (Ipv4Address address);
+    std::string XorDistance (std::string id1, std::string id2);
+    int32_t GetBucketIndex (std::string id);
+    std::string GetRandomIdInBucket (uint32_t index);
+
+    // Routing table
+    void UpdateContact (Ipv4Address address);
+    void RemoveContact (std::string id);
+    std::vector<Ipv4Address> GetClosestContacts (std::string targetId, uint32_t count, Ipv4Address excludeAddress);
+    void HandleBucketProbeTimeout (uint32_t transactionId);
+    void RefreshBuckets ();
+
+    // Iterative lookups
+    void StartNodeLookup (std::string targetId, uint32_t transId, bool notify);
+    void StepNodeLookup (uint32_t lookupId);
+    void FinishNodeLookup (uint32_t lookupId);
+    void HandleFindNodeTimeout (uint32_t transactionId);
+
+    void AuditPings ();
+    uint32_t GetNextTransactionId ();
+
+    // From GUOverlay
+    virtual void Lookup (std::string lookupKey, uint32_t transId);
+    virtual void Join (Ipv4Address landmarkAddress);
+    virtual void Leave ();
+    virtual bool IsResponsibleFor (std::string lookupKey);
+    virtual bool GetHandoverTarget (std::string newcomerId, Ipv4Address newcomerAddress, std::string lookupKey, Ipv4Address &target);
+    virtual void SendPing (Ipv4Address destAddress, std::string pingMessage);
+    virtual void StopOverlay ();
+    // From GUApplication
+    virtual void ProcessCommand (std::vector<std::string> tokens);
+
+  protected:
+    virtual void DoDispose ();
+
+  private:
+    virtual void StartApplication (void);
+    virtual void StopApplication (void);
+
+    uint16_t m_appPort;
+    Time m_pingTimeout;
+    Time m_rpcTimeout;
+    Time m_refreshInterval;
+    uint32_t m_bucketSize;              //k
+    uint32_t m_alpha;                   //lookup parallelism
+
+    Ipv4Address m_mainAddress;
+    std::string m_nodeId;
+
+    // Timers
+    Timer m_auditPingsTimer;
+    Timer m_refreshTimer;
+    // Ping tracker
+    std::map<uint32_t, Ptr<PingRequest> > m_pingTracker;
+
+    // k-buckets: bucket i holds contacts at XOR distance [2^i, 2^(i+1)), least recently seen first
+    struct KademliaContact
+      {
+        std::string id;
+        Ipv4Address address;
+      };
+    std::vector<std::list<KademliaContact> > m_buckets;
+    std::vector<Time> m_bucketLastLookup;
+    // Full bucket: least recently seen contact is pinged before the newcomer may replace it
+    struct BucketProbe
+      {
+        std::string staleId;
+        Ipv4Address candidateAddress;
+        EventId timeoutEvent;
+      };
+    std::map<uint32_t, BucketProbe> m_bucketProbeTracker;
+
+    enum CandidateState
+      {
+        CANDIDATE_NEW,
+        CANDIDATE_QUERIED,
+        CANDIDATE_RESPONDED,
+        CANDIDATE_FAILED,
+      };
+    struct LookupCandidate
+      {
+        std::string id;
+        Ipv4Address address;
+        CandidateState state;
+      };
+    struct NodeLookup
+      {
+        std::string targetId;
+        uint32_t transId;               //reported back through the lookup callback
+        bool notify;                    //false for bucket refreshes and joins
+        uint32_t inFlight;
+        uint32_t messagesSent;
+        // keyed by XOR distance to targetId, so iteration runs closest first
+        std::map<std::string, LookupCandidate> shortlist;
+      };
+    std::map<uint32_t, NodeLookup> m_lookupTracker;
+    struct PendingFindNode
+      {
+        uint32_t lookupId;
+        std::string distance;
+        EventId timeoutEvent;
+      };
+    std::map<uint32_t, PendingFindNode> m_findNodeTracker;
+};
+
+#endif
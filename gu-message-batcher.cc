@@ -0,0 +1,236 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-message-batcher.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("GUMessageBatcher");
+NS_OBJECT_ENSURE_REGISTERED (GUBatchHeader);
+
+/* GUBatchHeader */
+
+TypeId
+GUBatchHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("GUBatchHeader")
+    .SetParent<Header> ()
+    .AddConstructor<GUBatchHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+GUBatchHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+void
+GUBatchHeader::Print (std::ostream &os) const
+{
+  os << "GUBatchHeader:: messages: " << messageLengths.size () << "\n";
+}
+
+uint32_t
+GUBatchHeader::GetSerializedSize (uint32_t messageCount)
+{
+  // message count, then a layer tag and length per message
+  return sizeof (uint16_t) + messageCount * (sizeof (uint8_t) + sizeof (uint16_t));
+}
+
+uint32_t
+GUBatchHeader::GetSerializedSize (void) const
+{
+  return GetSerializedSize (messageLengths.size ());
+}
+
+void
+GUBatchHeader::Serialize (Buffer::Iterator start) const
+{
+  Buffer::Iterator i = start;
+  i.WriteU16 (messageLengths.size ());
+  for (uint32_t n = 0; n < messageLengths.size (); n++)
+    {
+      i.WriteU8 (messageLayers[n]);
+      i.WriteU16 (messageLengths[n]);
+    }
+}
+
+uint32_t
+GUBatchHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  uint16_t count = i.ReadU16 ();
+  messageLayers.resize (count);
+  messageLengths.resize (count);
+  for (uint16_t n = 0; n < count; n++)
+    {
+      messageLayers[n] = i.ReadU8 ();
+      messageLengths[n] = i.ReadU16 ();
+    }
+  return GetSerializedSize ();
+}
+
+/* GUMessageBatcher */
+
+GUMessageBatcher::GUMessageBatcher ()
+  : m_window (MilliSeconds (0)),
+    m_maxDatagramSize (1400)
+{
+}
+
+GUMessageBatcher::~GUMessageBatcher ()
+{
+  Cancel ();
+}
+
+void
+GUMessageBatcher::SetSocket (Ptr<Socket> socket)
+{
+  m_socket = socket;
+}
+
+void
+GUMessageBatcher::SetWindow (Time window)
+{
+  m_window = window;
+}
+
+void
+GUMessageBatcher::SetMaxDatagramSize (uint32_t maxDatagramSize)
+{
+  m_maxDatagramSize = maxDatagramSize;
+}
+
+void
+GUMessageBatcher::Send (Ptr<Packet> message, uint8_t layer, Ipv4Address destAddress, uint16_t destPort)
+{
+  NS_ASSERT (message->GetSize () <= 0xffff);
+  Destination destination (destAddress, destPort);
+  std::map<Destination, Batch>::iterator iter = m_batches.find (destination);
+  if (iter == m_batches.end ())
+    {
+      Batch empty;
+      empty.size = GUBatchHeader::GetSerializedSize (0);
+      iter = m_batches.insert (std::make_pair (destination, empty)).first;
+    }
+  Batch &batch = iter->second;
+
+  uint32_t added = GUBatchHeader::GetSerializedSize (1) - GUBatchHeader::GetSerializedSize (0) + message->GetSize ();
+  if (!batch.messages.empty () && batch.size + added > m_maxDatagramSize)
+    {
+      SendBatch (destination, batch);
+    }
+  batch.messages.push_back (message);
+  batch.layers.push_back (layer);
+  batch.size += added;
+
+  // An oversized message still goes out, just on its own
+  if (batch.size >= m_maxDatagramSize)
+    {
+      SendBatch (destination, batch);
+      m_batches.erase (iter);
+      return;
+    }
+  if (!m_flushEvent.IsRunning ())
+    {
+      m_flushEvent = Simulator::Schedule (m_window, &GUMessageBatcher::Flush, this);
+    }
+}
+
+void
+GUMessageBatcher::Flush ()
+{
+  m_flushEvent.Cancel ();
+  for (std::map<Destination, Batch>::iterator iter = m_batches.begin (); iter != m_batches.end (); iter++)
+    {
+      if (!iter->second.messages.empty ())
+        {
+          SendBatch (iter->first, iter->second);
+        }
+    }
+  // Only destinations written to since the last flush are kept, so a flush
+  // costs the peers of one window rather than every peer ever sent to
+  m_batches.clear ();
+}
+
+void
+GUMessageBatcher::Cancel ()
+{
+  m_flushEvent.Cancel ();
+  m_batches.clear ();
+}
+
+void
+GUMessageBatcher::SendBatch (const Destination &destination, Batch &batch)
+{
+  GUBatchHeader header;
+  Ptr<Packet> datagram = Create<Packet> ();
+  header.messageLayers = batch.layers;
+  for (std::vector<Ptr<Packet> >::const_iterator it = batch.messages.begin (); it != batch.messages.end (); it++)
+    {
+      header.messageLengths.push_back ((*it)->GetSize ());
+      datagram->AddAtEnd (*it);
+    }
+  datagram->AddHeader (header);
+  if (m_socket)
+    {
+      m_socket->SendTo (datagram, 0, InetSocketAddress (destination.first, destination.second));
+    }
+  batch.messages.clear ();
+  batch.layers.clear ();
+  batch.size = GUBatchHeader::GetSerializedSize (0);
+}
+
+bool
+GUMessageBatcher::Unpack (Ptr<Packet> datagram, std::vector<Ptr<Packet> > &messages, std::vector<uint8_t> &layers)
+{
+  messages.clear ();
+  layers.clear ();
+  if (datagram->GetSize () < GUBatchHeader::GetSerializedSize (0))
+    {
+      return false;
+    }
+  // The entries must all be there before the header reads them; ReadU16 is little-endian
+  uint8_t countBytes[2];
+  datagram->CopyData (countBytes, sizeof (countBytes));
+  uint16_t count = countBytes[0] | (countBytes[1] << 8);
+  if (datagram->GetSize () < GUBatchHeader::GetSerializedSize (count))
+    {
+      return false;
+    }
+  GUBatchHeader header;
+  datagram->RemoveHeader (header);
+  layers = header.messageLayers;
+
+  uint32_t offset = 0;
+  for (std::vector<uint16_t>::const_iterator it = header.messageLengths.begin (); it != header.messageLengths.end (); it++)
+    {
+      if (offset + *it > datagram->GetSize ())
+        {
+          messages.clear ();
+          layers.clear ();
+          return false;
+        }
+      messages.push_back (datagram->CreateFragment (offset, *it));
+      offset += *it;
+    }
+  return true;
+}
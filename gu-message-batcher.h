@@ -0,0 +1,108 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_MESSAGE_BATCHER_H
+#define GU_MESSAGE_BATCHER_H
+
+#include "ns3/header.h"
+#include "ns3/packet.h"
+#include "ns3/socket.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include <map>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ *  Framing in front of every datagram a GUMessageBatcher sends: the number
+ *  of messages, then the layer tag and length of each, followed by the
+ *  messages themselves.
+ */
+class GUBatchHeader : public Header
+{
+  public:
+    static TypeId GetTypeId (void);
+    virtual TypeId GetInstanceTypeId (void) const;
+    void Print (std::ostream &os) const;
+    uint32_t GetSerializedSize (void) const;
+    void Serialize (Buffer::Iterator start) const;
+    uint32_t Deserialize (Buffer::Iterator start);
+
+    static uint32_t GetSerializedSize (uint32_t messageCount);
+
+    std::vector<uint8_t> messageLayers;
+    std::vector<uint16_t> messageLengths;
+};
+
+/**
+ *  Outbound coalescing for a UDP socket. Messages to the same destination
+ *  queued within the window are packed into one datagram, which is sent
+ *  early once it would grow past the maximum datagram size. A zero window
+ *  still coalesces everything sent within the same simulator event.
+ */
+class GUMessageBatcher
+{
+  public:
+    GUMessageBatcher ();
+    ~GUMessageBatcher ();
+
+    void SetSocket (Ptr<Socket> socket);
+    void SetWindow (Time window);
+    void SetMaxDatagramSize (uint32_t maxDatagramSize);
+
+    /**
+     *  \brief Queues one serialized message of the given layer for destAddress:destPort
+     */
+    void Send (Ptr<Packet> message, uint8_t layer, Ipv4Address destAddress, uint16_t destPort);
+
+    /**
+     *  \brief Sends everything queued
+     */
+    void Flush ();
+
+    /**
+     *  \brief Drops everything queued, e.g. when the socket is closed
+     */
+    void Cancel ();
+
+    /**
+     *  \brief Splits a received datagram back into the messages it carries
+     *  and the layer each belongs to
+     *  \returns false if the framing is malformed
+     */
+    static bool Unpack (Ptr<Packet> datagram, std::vector<Ptr<Packet> > &messages, std::vector<uint8_t> &layers);
+
+  private:
+    typedef std::pair<Ipv4Address, uint16_t> Destination;
+    struct Batch
+      {
+        std::vector<Ptr<Packet> > messages;
+        std::vector<uint8_t> layers;
+        uint32_t size;                  //datagram size, framing included
+      };
+
+    void SendBatch (const Destination &destination, Batch &batch);
+
+    Ptr<Socket> m_socket;
+    Time m_window;
+    uint32_t m_maxDatagramSize;
+    std::map<Destination, Batch> m_batches;
+    EventId m_flushEvent;
+};
+
+#endif
@@ -0,0 +1,113 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gu-overlay.h"
+
+using namespace ns3;
+
+TypeId
+GUOverlay::GetTypeId ()
+{
+  static TypeId tid = TypeId ("GUOverlay")
+    .SetParent<GUApplication> ()
+    ;
+  return tid;
+}
+
+GUOverlay::GUOverlay ()
+  : m_transport (Create<GUTransport> ()),
+    m_ownsTransport (true)
+{
+}
+
+GUOverlay::~GUOverlay ()
+{
+}
+
+void
+GUOverlay::SetPingSuccessCallback (Callback <void, Ipv4Address, std::string> pingSuccessFn)
+{
+  m_pingSuccessFn = pingSuccessFn;
+}
+
+void
+GUOverlay::SetPingFailureCallback (Callback <void, Ipv4Address, std::string> pingFailureFn)
+{
+  m_pingFailureFn = pingFailureFn;
+}
+
+void
+GUOverlay::SetPingRecvCallback (Callback <void, Ipv4Address, std::string> pingRecvFn)
+{
+  m_pingRecvFn = pingRecvFn;
+}
+
+void
+GUOverlay::SetLookupCallback (Callback <void, Ipv4Address, uint32_t, std::string, uint32_t> lookupFn)
+{
+  m_lookupFn = lookupFn;
+}
+
+void
+GUOverlay::SetLeaveCallback (Callback <void, Ipv4Address, uint32_t> leaveFn)
+{
+  m_leaveFn = leaveFn;
+}
+
+void
+GUOverlay::SetOwnershipChangeCallback (Callback <void, Ipv4Address, std::string> ownershipChangeFn)
+{
+  m_ownershipChangeFn = ownershipChangeFn;
+}
+
+void
+GUOverlay::SetKeyCountCallback (Callback <uint32_t> keyCountFn)
+{
+  m_keyCountFn = keyCountFn;
+}
+
+void
+GUOverlay::SetTransport (Ptr<GUTransport> transport)
+{
+  m_transport = transport;
+  m_ownsTransport = false;
+}
+
+Ptr<GUPeerLiveness>
+GUOverlay::GetLiveness () const
+{
+  return m_transport->GetLiveness ();
+}
+
+void
+GUOverlay::AttachTransport (uint16_t port, GUTransport::ReceiveCallback receive)
+{
+  if (m_ownsTransport)
+    {
+      m_transport->Open (GetNode (), port);
+    }
+  m_transport->SetReceiveCallback (GUTransport::OVERLAY_LAYER, receive);
+}
+
+void
+GUOverlay::DetachTransport ()
+{
+  m_transport->SetReceiveCallback (GUTransport::OVERLAY_LAYER, GUTransport::ReceiveCallback ());
+  if (m_ownsTransport)
+    {
+      m_transport->Close ();
+    }
+}
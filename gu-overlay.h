@@ -0,0 +1,86 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_OVERLAY_H
+#define GU_OVERLAY_H
+
+#include "ns3/gu-application.h"
+#include "ns3/gu-transport.h"
+
+#include "ns3/ipv4-address.h"
+#include <string>
+#include "ns3/callback.h"
+
+using namespace ns3;
+
+// Key-based routing layer underneath GUSearch. Keys and node IDs are 40-digit
+// hex SHA1 strings; each backend decides which node owns a key.
+class GUOverlay : public GUApplication
+{
+  public:
+    static TypeId GetTypeId (void);
+    GUOverlay ();
+    virtual ~GUOverlay ();
+
+    // Find the node owning lookupKey; the answer arrives through the lookup callback tagged with transId
+    virtual void Lookup (std::string lookupKey, uint32_t transId) = 0;
+    // Join through landmarkAddress; joining through ourselves starts a new overlay
+    virtual void Join (Ipv4Address landmarkAddress) = 0;
+    virtual void Leave () = 0;
+    // True if this node currently owns lookupKey
+    virtual bool IsResponsibleFor (std::string lookupKey) = 0;
+    // Where a key of ours goes once newcomerId has joined; false if it stays here
+    virtual bool GetHandoverTarget (std::string newcomerId, Ipv4Address newcomerAddress, std::string lookupKey, Ipv4Address &target) = 0;
+    virtual void SendPing (Ipv4Address destAddress, std::string pingMessage) = 0;
+    virtual void StopOverlay () = 0;
+
+    // Callbacks with Application Layer
+    void SetPingSuccessCallback (Callback <void, Ipv4Address, std::string> pingSuccessFn);
+    void SetPingFailureCallback (Callback <void, Ipv4Address, std::string> pingFailureFn);
+    void SetPingRecvCallback (Callback <void, Ipv4Address, std::string> pingRecvFn);
+
+    // (source, owner node number, owner ID, transId)
+    void SetLookupCallback (Callback <void, Ipv4Address, uint32_t, std::string, uint32_t> lookupFn);
+    // (node taking over, its node number): fired when this node leaves, keys should be handed over
+    void SetLeaveCallback (Callback <void, Ipv4Address, uint32_t> leaveFn);
+    // (new node, its ID): fired when a node takes over part of our key space
+    void SetOwnershipChangeCallback (Callback <void, Ipv4Address, std::string> ownershipChangeFn);
+    void SetKeyCountCallback (Callback <uint32_t> keyCountFn);
+
+    // Run on the application's endpoint instead of a socket of our own; set before Start
+    void SetTransport (Ptr<GUTransport> transport);
+    // Liveness table the overlay records peers in; with a private endpoint, share it with the application's
+    Ptr<GUPeerLiveness> GetLiveness () const;
+
+  protected:
+    // Registers the overlay's receive handler, opening the private endpoint on port unless one was set
+    void AttachTransport (uint16_t port, GUTransport::ReceiveCallback receive);
+    void DetachTransport ();
+
+    Ptr<GUTransport> m_transport;
+    bool m_ownsTransport;
+
+    Callback <void, Ipv4Address, std::string> m_pingSuccessFn;
+    Callback <void, Ipv4Address, std::string> m_pingFailureFn;
+    Callback <void, Ipv4Address, std::string> m_pingRecvFn;
+
+    Callback <void, Ipv4Address, uint32_t, std::string, uint32_t> m_lookupFn;
+    Callback <void, Ipv4Address, uint32_t> m_leaveFn;
+    Callback <void, Ipv4Address, std::string> m_ownershipChangeFn;
+    Callback <uint32_t> m_keyCountFn;
+};
+
+#endif
@@ -0,0 +1,306 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-payload-view.h"
+#include "ns3/assert.h"
+#include <string.h>
+
+using namespace ns3;
+
+uint32_t
+ReadWireString (Buffer::Iterator &start, std::string &value)
+{
+  uint16_t length = start.ReadU16 ();
+  value.resize (length);
+  if (length > 0)
+    {
+      start.Read ((uint8_t*) &value[0], length);
+    }
+  return sizeof (uint16_t) + length;
+}
+
+uint32_t
+GetVarintSize (uint32_t value)
+{
+  uint32_t size = 1;
+  while (value >= 0x80)
+    {
+      value >>= 7;
+      size++;
+    }
+  return size;
+}
+
+void
+WriteVarint (Buffer::Iterator &start, uint32_t value)
+{
+  while (value >= 0x80)
+    {
+      start.WriteU8 ((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+  start.WriteU8 (value);
+}
+
+uint32_t
+ReadVarint (Buffer::Iterator &start, uint32_t &value)
+{
+  uint32_t size = 0;
+  uint32_t shift = 0;
+  uint8_t byte;
+  value = 0;
+  do
+    {
+      byte = start.ReadU8 ();
+      value |= (uint32_t) (byte & 0x7f) << shift;
+      shift += 7;
+      size++;
+    }
+  while ((byte & 0x80) && shift < 35);
+  return size;
+}
+
+uint32_t
+GetWireCountSize (uint8_t wireVersion, uint32_t fixedSize, uint32_t value)
+{
+  if (wireVersion >= WIRE_VERSION_2)
+    {
+      return GetVarintSize (value);
+    }
+  return fixedSize;
+}
+
+void
+WriteWireCount (Buffer::Iterator &start, uint8_t wireVersion, uint32_t fixedSize, uint32_t value)
+{
+  if (wireVersion >= WIRE_VERSION_2)
+    {
+      WriteVarint (start, value);
+      return;
+    }
+  switch (fixedSize)
+    {
+      case 1:
+        start.WriteU8 (value);
+        break;
+      case 2:
+        start.WriteU16 (value);
+        break;
+      default:
+        NS_ASSERT (fixedSize == 4);
+        start.WriteHtonU32 (value);
+        break;
+    }
+}
+
+uint32_t
+ReadWireCount (Buffer::Iterator &start, uint8_t wireVersion, uint32_t fixedSize, uint32_t &value)
+{
+  if (wireVersion >= WIRE_VERSION_2)
+    {
+      return ReadVarint (start, value);
+    }
+  switch (fixedSize)
+    {
+      case 1:
+        value = start.ReadU8 ();
+        break;
+      case 2:
+        value = start.ReadU16 ();
+        break;
+      default:
+        NS_ASSERT (fixedSize == 4);
+        value = start.ReadNtohU32 ();
+        break;
+    }
+  return fixedSize;
+}
+
+uint32_t
+GetWireStringSize (uint8_t wireVersion, const std::string &value)
+{
+  return GetWireCountSize (wireVersion, sizeof (uint16_t), value.length ()) + value.length ();
+}
+
+void
+WriteWireString (Buffer::Iterator &start, uint8_t wireVersion, const std::string &value)
+{
+  WriteWireCount (start, wireVersion, sizeof (uint16_t), value.length ());
+  start.Write ((const uint8_t*) value.data (), value.length ());
+}
+
+uint32_t
+ReadWireString (Buffer::Iterator &start, uint8_t wireVersion, std::string &value)
+{
+  uint32_t length;
+  uint32_t size = ReadWireCount (start, wireVersion, sizeof (uint16_t), length);
+  value.resize (length);
+  if (length > 0)
+    {
+      start.Read ((uint8_t*) &value[0], length);
+    }
+  return size + length;
+}
+
+static uint8_t
+HexDigitValue (char digit)
+{
+  if (digit >= 'a' && digit <= 'f')
+    {
+      return digit - 'a' + 10;
+    }
+  if (digit >= 'A' && digit <= 'F')
+    {
+      return digit - 'A' + 10;
+    }
+  NS_ASSERT (digit >= '0' && digit <= '9');
+  return digit - '0';
+}
+
+void
+WriteWireId (Buffer::Iterator &start, const std::string &id)
+{
+  uint8_t raw[WIRE_ID_SIZE];
+  memset (raw, 0, WIRE_ID_SIZE);
+  if (!id.empty ())
+    {
+      NS_ASSERT (id.length () == 2 * WIRE_ID_SIZE);
+      for (uint32_t i = 0; i < WIRE_ID_SIZE; i++)
+        {
+          raw[i] = (HexDigitValue (id[2 * i]) << 4) | HexDigitValue (id[2 * i + 1]);
+        }
+    }
+  start.Write (raw, WIRE_ID_SIZE);
+}
+
+uint32_t
+ReadWireId (Buffer::Iterator &start, std::string &id)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  uint8_t raw[WIRE_ID_SIZE];
+  start.Read (raw, WIRE_ID_SIZE);
+
+  bool isSet = false;
+  id.resize (2 * WIRE_ID_SIZE);
+  for (uint32_t i = 0; i < WIRE_ID_SIZE; i++)
+    {
+      isSet = isSet || raw[i] != 0;
+      id[2 * i] = hexDigits[raw[i] >> 4];
+      id[2 * i + 1] = hexDigits[raw[i] & 0x0f];
+    }
+  if (!isSet)
+    {
+      id.clear ();
+    }
+  return WIRE_ID_SIZE;
+}
+
+uint32_t
+ReadWireStringViews (Buffer::Iterator &start, uint32_t count, StringViewList &views)
+{
+  Ptr<PayloadArena> arena = Create<PayloadArena> ();
+  uint32_t size = 0;
+  views.clear ();
+  views.reserve (count);
+  for (uint32_t i = 0; i < count; i++)
+    {
+      uint16_t length = start.ReadU16 ();
+      uint32_t offset = arena->bytes.size ();
+      arena->bytes.resize (offset + length);
+      if (length > 0)
+        {
+          start.Read ((uint8_t*) &arena->bytes[offset], length);
+        }
+      views.push_back (StringView (arena, offset, length));
+      size += sizeof (uint16_t) + length;
+    }
+  return size;
+}
+
+StringView::StringView ()
+  : m_offset (0),
+    m_length (0)
+{
+}
+
+StringView::StringView (Ptr<PayloadArena> arena, uint32_t offset, uint32_t length)
+  : m_arena (arena),
+    m_offset (offset),
+    m_length (length)
+{
+}
+
+const char*
+StringView::data () const
+{
+  // the arena may have grown while the list was read, so resolve lazily
+  return m_length == 0 ? "" : m_arena->bytes.data () + m_offset;
+}
+
+uint32_t
+StringView::size () const
+{
+  return m_length;
+}
+
+bool
+StringView::empty () const
+{
+  return m_length == 0;
+}
+
+std::string
+StringView::str () const
+{
+  return std::string (data (), m_length);
+}
+
+int
+StringView::compare (const std::string &other) const
+{
+  uint32_t common = m_length < other.length () ? m_length : other.length ();
+  int result = memcmp (data (), other.data (), common);
+  if (result != 0)
+    {
+      return result;
+    }
+  if (m_length == other.length ())
+    {
+      return 0;
+    }
+  return m_length < other.length () ? -1 : 1;
+}
+
+bool
+StringView::operator== (const std::string &other) const
+{
+  return compare (other) == 0;
+}
+
+bool
+StringView::operator< (const StringView &other) const
+{
+  uint32_t common = m_length < other.m_length ? m_length : other.m_length;
+  int result = memcmp (data (), other.data (), common);
+  return result < 0 || (result == 0 && m_length < other.m_length);
+}
+
+std::ostream&
+operator<< (std::ostream& os, const StringView& view)
+{
+  os.write (view.data (), view.size ());
+  return os;
+}
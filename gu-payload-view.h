@@ -0,0 +1,127 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_PAYLOAD_VIEW_H
+#define GU_PAYLOAD_VIEW_H
+
+#include "ns3/buffer.h"
+#include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace ns3;
+
+/**
+ *  \brief Reads a u16 length-prefixed string straight into value's storage
+ *  \returns bytes consumed, prefix included
+ */
+uint32_t ReadWireString (Buffer::Iterator &start, std::string &value);
+
+// Wire format versions. v1 writes counts and lengths at a fixed width; v2
+// writes them as LEB128 varints, so small values take a single byte.
+#define WIRE_VERSION_1 1
+#define WIRE_VERSION_2 2
+
+uint32_t GetVarintSize (uint32_t value);
+void WriteVarint (Buffer::Iterator &start, uint32_t value);
+/**
+ *  \returns bytes consumed
+ */
+uint32_t ReadVarint (Buffer::Iterator &start, uint32_t &value);
+
+/**
+ *  Count or length field: fixedSize (1, 2 or 4) bytes in v1, a varint in v2
+ */
+uint32_t GetWireCountSize (uint8_t wireVersion, uint32_t fixedSize, uint32_t value);
+void WriteWireCount (Buffer::Iterator &start, uint8_t wireVersion, uint32_t fixedSize, uint32_t value);
+/**
+ *  \returns bytes consumed
+ */
+uint32_t ReadWireCount (Buffer::Iterator &start, uint8_t wireVersion, uint32_t fixedSize, uint32_t &value);
+
+/**
+ *  Length-prefixed string: u16 length in v1, varint length in v2
+ */
+uint32_t GetWireStringSize (uint8_t wireVersion, const std::string &value);
+void WriteWireString (Buffer::Iterator &start, uint8_t wireVersion, const std::string &value);
+/**
+ *  \returns bytes consumed, prefix included
+ */
+uint32_t ReadWireString (Buffer::Iterator &start, uint8_t wireVersion, std::string &value);
+
+// Node IDs and keys are 40 hex digits in memory but travel as their raw
+// 20-byte SHA1 value. An empty ID ("not set") is sent as all zero bytes.
+#define WIRE_ID_SIZE 20
+
+/**
+ *  \brief Writes a 40 hex digit ID as WIRE_ID_SIZE raw bytes
+ */
+void WriteWireId (Buffer::Iterator &start, const std::string &id);
+
+/**
+ *  \brief Reads WIRE_ID_SIZE raw bytes back into a 40 hex digit ID
+ *  \returns bytes consumed
+ */
+uint32_t ReadWireId (Buffer::Iterator &start, std::string &id);
+
+/**
+ *  Bytes copied once out of a received packet. Every StringView taken from
+ *  a message shares its arena, which lives as long as the last view.
+ */
+class PayloadArena : public SimpleRefCount<PayloadArena>
+{
+  public:
+    std::string bytes;
+};
+
+/**
+ *  Read-only string inside a PayloadArena. Copying a view never copies the
+ *  characters; str () makes the owned copy a handler needs to keep them.
+ */
+class StringView
+{
+  public:
+    StringView ();
+    StringView (Ptr<PayloadArena> arena, uint32_t offset, uint32_t length);
+
+    const char* data () const;
+    uint32_t size () const;
+    bool empty () const;
+    std::string str () const;
+    int compare (const std::string &other) const;
+
+    bool operator== (const std::string &other) const;
+    bool operator< (const StringView &other) const;
+
+  private:
+    Ptr<PayloadArena> m_arena;
+    uint32_t m_offset;
+    uint32_t m_length;
+};
+
+typedef std::vector<StringView> StringViewList;
+
+/**
+ *  \brief Reads count u16 length-prefixed strings into a single new arena
+ *  \returns bytes consumed
+ */
+uint32_t ReadWireStringViews (Buffer::Iterator &start, uint32_t count, StringViewList &views);
+
+std::ostream& operator<< (std::ostream& os, const StringView& view);
+
+#endif
@@ -0,0 +1,70 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-peer-liveness.h"
+#include "ns3/simulator.h"
+
+using namespace ns3;
+
+GUPeerLiveness::GUPeerLiveness ()
+{
+}
+
+void
+GUPeerLiveness::RecordHeard (Ipv4Address address)
+{
+  m_peers[address].lastHeard = Simulator::Now ();
+}
+
+void
+GUPeerLiveness::RecordRtt (Ipv4Address address, Time sample)
+{
+  Peer &peer = m_peers[address];
+  peer.lastHeard = Simulator::Now ();
+  if (!peer.hasRtt)
+    {
+      peer.srtt = sample;
+      peer.hasRtt = true;
+    }
+  else
+    {
+      // same 1/8 gain as the bulk transport's estimator
+      peer.srtt = NanoSeconds ((7 * peer.srtt.GetNanoSeconds () + sample.GetNanoSeconds ()) / 8);
+    }
+}
+
+bool
+GUPeerLiveness::HeardWithin (Ipv4Address address, Time window) const
+{
+  std::map<Ipv4Address, Peer>::const_iterator iter = m_peers.find (address);
+  if (iter == m_peers.end ())
+    {
+      return false;
+    }
+  return iter->second.lastHeard + window >= Simulator::Now ();
+}
+
+bool
+GUPeerLiveness::GetRtt (Ipv4Address address, Time &rtt) const
+{
+  std::map<Ipv4Address, Peer>::const_iterator iter = m_peers.find (address);
+  if (iter == m_peers.end () || !iter->second.hasRtt)
+    {
+      return false;
+    }
+  rtt = iter->second.srtt;
+  return true;
+}
@@ -0,0 +1,65 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_PEER_LIVENESS_H
+#define GU_PEER_LIVENESS_H
+
+#include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+#include "ns3/simple-ref-count.h"
+#include <map>
+
+using namespace ns3;
+
+/**
+ *  What a node knows about its peers' liveness, shared by every layer on
+ *  the node. The transport records each peer it receives a datagram from,
+ *  at any layer, so a recent message counts as proof of life without a
+ *  dedicated probe. Layers that time their own request/response pairs feed
+ *  in RTT samples.
+ */
+class GUPeerLiveness : public SimpleRefCount<GUPeerLiveness>
+{
+  public:
+    GUPeerLiveness ();
+
+    void RecordHeard (Ipv4Address address);
+    void RecordRtt (Ipv4Address address, Time sample);
+
+    /**
+     *  \returns true if a message from address arrived within the last window
+     */
+    bool HeardWithin (Ipv4Address address, Time window) const;
+
+    /**
+     *  \brief Smoothed RTT to address
+     *  \returns false if no sample has been recorded yet
+     */
+    bool GetRtt (Ipv4Address address, Time &rtt) const;
+
+  private:
+    struct Peer
+      {
+        Peer () : hasRtt (false) {}
+        Time lastHeard;
+        bool hasRtt;
+        Time srtt;
+      };
+
+    std::map<Ipv4Address, Peer> m_peers;
+};
+
+#endif
@@ -0,0 +1,182 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-posting-intersection.h"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define INTERSECT_GALLOP_RATIO 32       //size ratio at which searching beats scanning the long list
+#define INTERSECT_SIMD_MIN_SIZE 16      //shorter list below this spends more time in the scalar tail
+
+GUPostingIntersection::Strategy
+GUPostingIntersection::ChooseStrategy (uint32_t sizeA, uint32_t sizeB)
+{
+  uint32_t small = std::min (sizeA, sizeB);
+  uint32_t large = std::max (sizeA, sizeB);
+  if ((uint64_t) small * INTERSECT_GALLOP_RATIO <= large)
+    {
+      return GALLOP;
+    }
+  if (HasSimd () && small >= INTERSECT_SIMD_MIN_SIZE)
+    {
+      return SIMD;
+    }
+  return MERGE;
+}
+
+bool
+GUPostingIntersection::HasSimd ()
+{
+#ifdef __SSE2__
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+GUPostingIntersection::Intersect (const PostingList &a, const PostingList &b, PostingList &result)
+{
+  if (a.empty () || b.empty ())
+    {
+      return;
+    }
+  result.reserve (result.size () + std::min (a.size (), b.size ()));
+  switch (ChooseStrategy (a.size (), b.size ()))
+    {
+      case GALLOP:
+        if (a.size () < b.size ())
+          {
+            Gallop (a, b, result);
+          }
+        else
+          {
+            Gallop (b, a, result);
+          }
+        break;
+      case SIMD:
+        Simd (a, b, result);
+        break;
+      default:
+        Merge (a, b, result);
+        break;
+    }
+}
+
+static void
+MergeRange (const uint32_t *a, const uint32_t *aEnd, const uint32_t *b, const uint32_t *bEnd, GUPostingIntersection::PostingList &result)
+{
+  while (a != aEnd && b != bEnd)
+    {
+      if (*a < *b)
+        {
+          a++;
+        }
+      else if (*b < *a)
+        {
+          b++;
+        }
+      else
+        {
+          result.push_back (*a);
+          a++;
+          b++;
+        }
+    }
+}
+
+void
+GUPostingIntersection::Merge (const PostingList &a, const PostingList &b, PostingList &result)
+{
+  if (a.empty () || b.empty ())
+    {
+      return;
+    }
+  MergeRange (&a[0], &a[0] + a.size (), &b[0], &b[0] + b.size (), result);
+}
+
+void
+GUPostingIntersection::Gallop (const PostingList &small, const PostingList &large, PostingList &result)
+{
+  PostingList::const_iterator low = large.begin ();
+  for (PostingList::const_iterator it = small.begin (); it != small.end () && low != large.end (); it++)
+    {
+      // double the step until it passes the target, then search the last step
+      uint32_t step = 1;
+      PostingList::const_iterator high = low;
+      while ((uint32_t) (large.end () - high) > step && *(high + step) < *it)
+        {
+          high += step;
+          step *= 2;
+        }
+      PostingList::const_iterator limit = (uint32_t) (large.end () - high) > step ? high + step + 1 : large.end ();
+      low = std::lower_bound (high, limit, *it);
+      if (low != large.end () && *low == *it)
+        {
+          result.push_back (*it);
+          low++;
+        }
+    }
+}
+
+void
+GUPostingIntersection::Simd (const PostingList &a, const PostingList &b, PostingList &result)
+{
+  if (a.empty () || b.empty ())
+    {
+      return;
+    }
+  const uint32_t *i = &a[0];
+  const uint32_t *iEnd = i + a.size ();
+  const uint32_t *j = &b[0];
+  const uint32_t *jEnd = j + b.size ();
+#ifdef __SSE2__
+  // Compare a block of four from each list against all four rotations of
+  // the other; whichever block ends lower cannot match anything further on
+  while (iEnd - i >= 4 && jEnd - j >= 4)
+    {
+      __m128i va = _mm_loadu_si128 ((const __m128i *) i);
+      __m128i vb = _mm_loadu_si128 ((const __m128i *) j);
+      __m128i match = _mm_or_si128 (
+        _mm_or_si128 (_mm_cmpeq_epi32 (va, vb),
+                      _mm_cmpeq_epi32 (va, _mm_shuffle_epi32 (vb, _MM_SHUFFLE (0, 3, 2, 1)))),
+        _mm_or_si128 (_mm_cmpeq_epi32 (va, _mm_shuffle_epi32 (vb, _MM_SHUFFLE (1, 0, 3, 2))),
+                      _mm_cmpeq_epi32 (va, _mm_shuffle_epi32 (vb, _MM_SHUFFLE (2, 1, 0, 3)))));
+      int mask = _mm_movemask_ps (_mm_castsi128_ps (match));
+      for (uint32_t k = 0; mask != 0; k++, mask >>= 1)
+        {
+          if (mask & 1)
+            {
+              result.push_back (i[k]);
+            }
+        }
+      uint32_t aLast = i[3];
+      uint32_t bLast = j[3];
+      if (aLast <= bLast)
+        {
+          i += 4;
+        }
+      if (bLast <= aLast)
+        {
+          j += 4;
+        }
+    }
+#endif
+  MergeRange (i, iEnd, j, jEnd, result);
+}
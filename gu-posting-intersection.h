@@ -0,0 +1,56 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_POSTING_INTERSECTION_H
+#define GU_POSTING_INTERSECTION_H
+
+#include "ns3/gu-document-dictionary.h"
+
+/**
+ *  Intersection of sorted posting lists. Intersect picks a strategy from
+ *  the two list sizes: galloping when one list is much shorter than the
+ *  other, a block-wise SIMD compare when both are long and SSE2 is
+ *  available, and a plain merge otherwise. The individual strategies are
+ *  public so the benchmark can compare them.
+ *
+ *  All of them append to result, which keeps it sorted and free of
+ *  duplicates when the inputs are.
+ */
+class GUPostingIntersection
+{
+  public:
+    typedef GUDocumentDictionary::PostingList PostingList;
+
+    enum Strategy
+      {
+        MERGE,
+        GALLOP,
+        SIMD,
+      };
+
+    static Strategy ChooseStrategy (uint32_t sizeA, uint32_t sizeB);
+    static bool HasSimd ();
+
+    static void Intersect (const PostingList &a, const PostingList &b, PostingList &result);
+
+    static void Merge (const PostingList &a, const PostingList &b, PostingList &result);
+    // Searches each element of small forward through large
+    static void Gallop (const PostingList &small, const PostingList &large, PostingList &result);
+    // Falls back to Merge without SSE2
+    static void Simd (const PostingList &a, const PostingList &b, PostingList &result);
+};
+
+#endif
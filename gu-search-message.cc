@@ -22,7 +22,12 @@ using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("GUSearchMessage");
 NS_OBJECT_ENSURE_REGISTERED (GUSearchMessage);
 
+// The search layer always uses the fixed-width wire format
+#define SEARCH_WIRE_VERSION WIRE_VERSION_1
+
 GUSearchMessage::GUSearchMessage ()
+  : m_messageType ((MessageType) 0),
+    m_payloadViews (false)
 {
 }
 
@@ -34,6 +39,7 @@ GUSearchMessage::GUSearchMessage (GUSearchMessage::MessageType messageType, uint
 {
   m_messageType = messageType;
   m_transactionId = transactionId;
+  m_payloadViews = false;
 }
 
 TypeId 
@@ -52,7 +58,6 @@ GUSearchMessage::GetInstanceTypeId (void) const
   return GetTypeId ();
 }
 
-
 uint32_t
 GUSearchMessage::GetSerializedSize (void) const
 {
@@ -60,21 +65,12 @@ GUSearchMessage::GetSerializedSize (void) const
   uint32_t size = sizeof (uint8_t) + sizeof (uint32_t);
   switch (m_messageType)
     {
-      case PING_REQ:
-        size += m_message.pingReq.GetSerializedSize ();
-        break;
-      case PING_RSP:
-        size += m_message.pingRsp.GetSerializedSize ();
-        break;
-      case STORE_REQ:
-        size += m_message.storeReq.GetSerializedSize ();
-        break;  
-      case FETCH_REQ:
-        size += m_message.fetchReq.GetSerializedSize ();
-        break;
-      case FETCH_RSP:
-        size += m_message.fetchRsp.GetSerializedSize ();
+#define GU_SEARCH_SIZE_CASE(type, Payload) \
+      case type: \
+        size += m_payload.Get<Payload> ().GetSerializedSize (SEARCH_WIRE_VERSION); \
         break;
+      GU_SEARCH_PAYLOADS (GU_SEARCH_SIZE_CASE)
+#undef GU_SEARCH_SIZE_CASE
       default:
         NS_ASSERT (false);
     }
@@ -91,23 +87,14 @@ GUSearchMessage::Print (std::ostream &os) const
   
   switch (m_messageType)
     {
-      case PING_REQ:
-        m_message.pingReq.Print (os);
-        break;
-      case PING_RSP:
-        m_message.pingRsp.Print (os);
-        break;
-      case STORE_REQ:
-        m_message.storeReq.Print (os);
-        break;  
-      case FETCH_REQ:
-        m_message.fetchReq.Print (os);
+#define GU_SEARCH_PRINT_CASE(type, Payload) \
+      case type: \
+        m_payload.Get<Payload> ().Print (os); \
         break;
-      case FETCH_RSP:
-        m_message.fetchRsp.Print (os);
-        break;        
+      GU_SEARCH_PAYLOADS (GU_SEARCH_PRINT_CASE)
+#undef GU_SEARCH_PRINT_CASE
       default:
-        break;  
+        break;
     }
   os << "\n****END OF MESSAGE****\n";
 }
@@ -121,23 +108,14 @@ GUSearchMessage::Serialize (Buffer::Iterator start) const
 
   switch (m_messageType)
     {
-      case PING_REQ:
-        m_message.pingReq.Serialize (i);
-        break;
-      case PING_RSP:
-        m_message.pingRsp.Serialize (i);
-        break;
-      case STORE_REQ:
-        m_message.storeReq.Serialize (i);
-        break;  
-      case FETCH_REQ:
-        m_message.fetchReq.Serialize (i);
+#define GU_SEARCH_SERIALIZE_CASE(type, Payload) \
+      case type: \
+        m_payload.Get<Payload> ().Serialize (i, SEARCH_WIRE_VERSION); \
         break;
-      case FETCH_RSP:
-        m_message.fetchRsp.Serialize (i);
-        break;         
+      GU_SEARCH_PAYLOADS (GU_SEARCH_SERIALIZE_CASE)
+#undef GU_SEARCH_SERIALIZE_CASE
       default:
-        NS_ASSERT (false);   
+        NS_ASSERT (false);
     }
 }
 
@@ -153,21 +131,12 @@ GUSearchMessage::Deserialize (Buffer::Iterator start)
 
   switch (m_messageType)
     {
-      case PING_REQ:
-        size += m_message.pingReq.Deserialize (i);
-        break;
-      case PING_RSP:
-        size += m_message.pingRsp.Deserialize (i);
-        break;
-      case STORE_REQ:
-        size += m_message.storeReq.Deserialize (i);
-        break;  
-      case FETCH_REQ:
-        size += m_message.fetchReq.Deserialize (i);
-        break;
-      case FETCH_RSP:
-        size += m_message.fetchRsp.Deserialize (i);
+#define GU_SEARCH_DESERIALIZE_CASE(type, Payload) \
+      case type: \
+        size += m_payload.Reset<Payload> ().Deserialize (i, SEARCH_WIRE_VERSION, m_payloadViews); \
         break;
+      GU_SEARCH_PAYLOADS (GU_SEARCH_DESERIALIZE_CASE)
+#undef GU_SEARCH_DESERIALIZE_CASE
       default:
         NS_ASSERT (false);
     }
@@ -176,38 +145,12 @@ GUSearchMessage::Deserialize (Buffer::Iterator start)
 
 /* PING_REQ */
 
-uint32_t 
-GUSearchMessage::PingReq::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t) + pingMessage.length();
-  return size;
-}
-
 void
 GUSearchMessage::PingReq::Print (std::ostream &os) const
 {
   os << "PingReq:: Message: " << pingMessage << "\n";
 }
 
-void
-GUSearchMessage::PingReq::Serialize (Buffer::Iterator &start) const
-{
-  start.WriteU16 (pingMessage.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (pingMessage.c_str())), pingMessage.length());
-}
-
-uint32_t
-GUSearchMessage::PingReq::Deserialize (Buffer::Iterator &start)
-{  
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  pingMessage = std::string (str, length);
-  free (str);
-  return PingReq::GetSerializedSize ();
-}
-
 void
 GUSearchMessage::SetPingReq (std::string pingMessage)
 {
@@ -219,49 +162,24 @@ GUSearchMessage::SetPingReq (std::string pingMessage)
     {
       NS_ASSERT (m_messageType == PING_REQ);
     }
-  m_message.pingReq.pingMessage = pingMessage;
+  PingReq &payload = m_payload.GetOrCreate<PingReq> ();
+  payload.pingMessage.swap (pingMessage);
 }
 
-GUSearchMessage::PingReq
-GUSearchMessage::GetPingReq ()
+const GUSearchMessage::PingReq&
+GUSearchMessage::GetPingReq () const
 {
-  return m_message.pingReq;
+  return m_payload.Get<PingReq> ();
 }
 
 /* PING_RSP */
 
-uint32_t 
-GUSearchMessage::PingRsp::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t) + pingMessage.length();
-  return size;
-}
-
 void
 GUSearchMessage::PingRsp::Print (std::ostream &os) const
 {
   os << "PingReq:: Message: " << pingMessage << "\n";
 }
 
-void
-GUSearchMessage::PingRsp::Serialize (Buffer::Iterator &start) const
-{
-  start.WriteU16 (pingMessage.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (pingMessage.c_str())), pingMessage.length());
-}
-
-uint32_t
-GUSearchMessage::PingRsp::Deserialize (Buffer::Iterator &start)
-{  
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  pingMessage = std::string (str, length);
-  free (str);
-  return PingRsp::GetSerializedSize ();
-}
-
 void
 GUSearchMessage::SetPingRsp (std::string pingMessage)
 {
@@ -273,79 +191,33 @@ GUSearchMessage::SetPingRsp (std::string pingMessage)
     {
       NS_ASSERT (m_messageType == PING_RSP);
     }
-  m_message.pingRsp.pingMessage = pingMessage;
+  PingRsp &payload = m_payload.GetOrCreate<PingRsp> ();
+  payload.pingMessage.swap (pingMessage);
 }
 
-GUSearchMessage::PingRsp
-GUSearchMessage::GetPingRsp ()
+const GUSearchMessage::PingRsp&
+GUSearchMessage::GetPingRsp () const
 {
-  return m_message.pingRsp;
+  return m_payload.Get<PingRsp> ();
 }
 
 /* STORE_REQ */
-uint32_t 
-GUSearchMessage::StoreReq::GetSerializedSize (void) const
-{
-  uint32_t size;
-  size = sizeof(uint16_t) + key.length();
-  size += sizeof(uint32_t);
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
-  return size;
-}
 
 void
 GUSearchMessage::StoreReq::Print (std::ostream &os) const
 {
-  os << "StoreReq:: Key: " << key << " Documents: " ; 
+  os << "StoreReq:: Key: " << key << " Chunk: " << chunkIndex + 1 << "/" << chunkCount << " Documents: " ; 
   for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
     os << *it << ", ";
   }
-  os << "\n";
-}
-
-void
-GUSearchMessage::StoreReq::Serialize (Buffer::Iterator &start) const
-{
-  //Print(std::cout);
-  start.WriteU16 (key.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (key.c_str())), key.length());
-  
-  start.WriteHtonU32(documents.size());
-  
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    start.WriteU16 ((*it).length());
-    start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
-  }
-}
-
-uint32_t
-GUSearchMessage::StoreReq::Deserialize (Buffer::Iterator &start)
-{  
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  key = std::string (str, length);
-  free (str);
-  
-  uint32_t dlen = start.ReadNtohU32();
-  for (uint32_t i = 0; i < dlen; i++) {
-    uint16_t length = start.ReadU16 ();
-    char* str = (char*) malloc (length);
-    start.Read ((uint8_t*)str, length);
-    documents.insert(std::string (str, length));
-    free (str);
+  for (StringViewList::const_iterator it = documentViews.begin(); it != documentViews.end(); it++) {
+    os << *it << ", ";
   }
-  
-  //Print(std::cout);
-  
-  return StoreReq::GetSerializedSize ();
+  os << "\n";
 }
 
 void
-GUSearchMessage::SetStoreReq (std::string key, std::set<std::string> documents)
+GUSearchMessage::SetStoreReq (std::string key, std::set<std::string> &documents, uint32_t chunkIndex, uint32_t chunkCount)
 {
   if (m_messageType == 0)
     {
@@ -355,38 +227,21 @@ GUSearchMessage::SetStoreReq (std::string key, std::set<std::string> documents)
     {
       NS_ASSERT (m_messageType == STORE_REQ);
     }
-  m_message.storeReq.key = key;
-  m_message.storeReq.documents = documents;
+  StoreReq &payload = m_payload.GetOrCreate<StoreReq> ();
+  payload.key.swap (key);
+  payload.chunkIndex = chunkIndex;
+  payload.chunkCount = chunkCount;
+  payload.documents.swap (documents);
 }
 
-GUSearchMessage::StoreReq
-GUSearchMessage::GetStoreReq ()
+const GUSearchMessage::StoreReq&
+GUSearchMessage::GetStoreReq () const
 {
-  return m_message.storeReq;
+  return m_payload.Get<StoreReq> ();
 }
 
 
 /* FETCH_REQ */
-uint32_t 
-GUSearchMessage::FetchReq::GetSerializedSize (void) const
-{
-  uint32_t size = 0;
-  size += sizeof(uint32_t);
-  size += sizeof(uint16_t) + key.length();
-  
-  size += sizeof(uint32_t);
-  for (std::set<std::string>::iterator it = searchKeys.begin(); it != searchKeys.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
-  
-  size += sizeof(uint32_t);
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
-  return size;
-}
 
 void
 GUSearchMessage::FetchReq::Print (std::ostream &os) const
@@ -395,70 +250,32 @@ GUSearchMessage::FetchReq::Print (std::ostream &os) const
   for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
     os << *it << ", ";
   }
-  os << " Search Keys: ";
-  for (std::set<std::string>::iterator it = searchKeys.begin(); it != searchKeys.end(); it++) {
+  for (StringViewList::const_iterator it = documentViews.begin(); it != documentViews.end(); it++) {
     os << *it << ", ";
   }
-  os << "\n";
-}
-
-void
-GUSearchMessage::FetchReq::Serialize (Buffer::Iterator &start) const
-{
-  start.WriteHtonU32(originatorNum);
-  
-  start.WriteU16 (key.length ());
-  start.Write ((uint8_t *) (const_cast<char*> (key.c_str())), key.length());
-  
-  start.WriteHtonU32(searchKeys.size());
-  
-  for (std::set<std::string>::iterator it = searchKeys.begin(); it != searchKeys.end(); it++) {
-    start.WriteU16 ((*it).length());
-    start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
+  os << " Search Keys: ";
+  for (std::vector<std::string>::const_iterator it = searchKeys.begin(); it != searchKeys.end(); it++) {
+    os << *it << ", ";
   }
-  
-  start.WriteHtonU32(documents.size());
-  
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    start.WriteU16 ((*it).length());
-    start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
+  os << " Filter: " << filter.size () << " bytes, " << (uint32_t) filterHashes << " hashes";
+  os << " Verify Keys: ";
+  for (std::vector<std::string>::const_iterator it = verifyKeys.begin(); it != verifyKeys.end(); it++) {
+    os << *it << ", ";
   }
-}
-
-uint32_t
-GUSearchMessage::FetchReq::Deserialize (Buffer::Iterator &start)
-{  
-  originatorNum = start.ReadNtohU32();
-  
-  uint16_t length = start.ReadU16 ();
-  char* str = (char*) malloc (length);
-  start.Read ((uint8_t*)str, length);
-  key = std::string (str, length);
-  free (str);
-  
-  uint32_t dlen = start.ReadNtohU32();
-  for (uint32_t i = 0; i < dlen; i++) {
-    uint16_t length = start.ReadU16 ();
-    char* str = (char*) malloc (length);
-    start.Read ((uint8_t*)str, length);
-    searchKeys.insert(std::string (str, length));
-    free (str);
+  if (verifying) {
+    os << " (verification pass)";
   }
-  
-  dlen = start.ReadNtohU32();
-  for (uint32_t i = 0; i < dlen; i++) {
-    uint16_t length = start.ReadU16 ();
-    char* str = (char*) malloc (length);
-    start.Read ((uint8_t*)str, length);
-    documents.insert(std::string (str, length));
-    free (str);
+  if (!gatherOwners.empty()) {
+    os << " Gather Owners: ";
+    for (std::vector<uint32_t>::const_iterator it = gatherOwners.begin(); it != gatherOwners.end(); it++) {
+      os << *it << ", ";
+    }
   }
-  
-  return FetchReq::GetSerializedSize ();
+  os << "\n";
 }
 
 void
-GUSearchMessage::SetFetchReq (uint32_t originatorNum, std::string key, std::set<std::string> searchKeys, std::set<std::string> documents)
+GUSearchMessage::SetFetchReq (uint32_t originatorNum, std::string key, std::vector<std::string> &searchKeys, std::set<std::string> &documents)
 {
   if (m_messageType == 0)
     {
@@ -468,87 +285,214 @@ GUSearchMessage::SetFetchReq (uint32_t originatorNum, std::string key, std::set<
     {
       NS_ASSERT (m_messageType == FETCH_REQ);
     }
-  m_message.fetchReq.originatorNum = originatorNum ;
-  m_message.fetchReq.key = key;
-  m_message.fetchReq.searchKeys = searchKeys;
-  m_message.fetchReq.documents = documents;
+  FetchReq &payload = m_payload.GetOrCreate<FetchReq> ();
+  payload.originatorNum = originatorNum;
+  payload.key.swap (key);
+  payload.searchKeys.swap (searchKeys);
+  payload.documents.swap (documents);
+  payload.filterHashes = 0;
+  payload.filter.clear ();
+  payload.verifyKeys.clear ();
+  payload.verifying = 0;
+  payload.gatherOwners.clear ();
 }
 
-GUSearchMessage::FetchReq
-GUSearchMessage::GetFetchReq ()
+void
+GUSearchMessage::SetFetchFilter (uint8_t filterHashes, std::string &filter, std::vector<std::string> &verifyKeys, bool verifying)
 {
-  return m_message.fetchReq;
+  NS_ASSERT (m_messageType == FETCH_REQ);
+  NS_ASSERT (verifyKeys.size () <= 255);
+  FetchReq &payload = m_payload.GetOrCreate<FetchReq> ();
+  payload.filterHashes = filterHashes;
+  payload.filter.swap (filter);
+  payload.verifyKeys.swap (verifyKeys);
+  payload.verifying = verifying;
 }
 
-/* FETCH_RSP */
-uint32_t 
-GUSearchMessage::FetchRsp::GetSerializedSize (void) const
+void
+GUSearchMessage::SetFetchGather (std::vector<uint32_t> &gatherOwners)
 {
-  uint32_t size = 0;
-  size += sizeof(uint32_t);
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    size += sizeof(uint16_t);
-    size += (*it).length();
-  }
-  return size;
+  NS_ASSERT (m_messageType == FETCH_REQ);
+  NS_ASSERT (gatherOwners.size () <= 255);
+  FetchReq &payload = m_payload.GetOrCreate<FetchReq> ();
+  NS_ASSERT (gatherOwners.size () == payload.searchKeys.size ());
+  payload.gatherOwners.swap (gatherOwners);
 }
 
+const GUSearchMessage::FetchReq&
+GUSearchMessage::GetFetchReq () const
+{
+  return m_payload.Get<FetchReq> ();
+}
+
+/* FETCH_RSP */
+
 void
 GUSearchMessage::FetchRsp::Print (std::ostream &os) const
 {
-  os << "FetchRsp:: Documents: " ; 
+  os << "FetchRsp:: Chunk: " << chunkIndex + 1 << "/" << chunkCount << " Documents: " ; 
   for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
     os << *it << ", ";
   }
+  for (StringViewList::const_iterator it = documentViews.begin(); it != documentViews.end(); it++) {
+    os << *it << ", ";
+  }
   os << "\n";
 }
 
 void
-GUSearchMessage::FetchRsp::Serialize (Buffer::Iterator &start) const
-{ 
-  start.WriteHtonU32(documents.size());
-  
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    start.WriteU16 ((*it).length());
-    start.Write ((uint8_t *) (const_cast<char*> ((*it).c_str())), (*it).length());
-  }
+GUSearchMessage::SetFetchRsp (std::set<std::string> &documents, uint32_t chunkIndex, uint32_t chunkCount)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = FETCH_RSP;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == FETCH_RSP);
+    }
+  FetchRsp &payload = m_payload.GetOrCreate<FetchRsp> ();
+  payload.chunkIndex = chunkIndex;
+  payload.chunkCount = chunkCount;
+  payload.documents.swap (documents);
 }
 
-uint32_t
-GUSearchMessage::FetchRsp::Deserialize (Buffer::Iterator &start)
-{  
-  uint32_t dlen = start.ReadNtohU32();
-  for (uint32_t  i = 0; i < dlen; i++) {
-    uint16_t length = start.ReadU16 ();
-    char* str = (char*) malloc (length);
-    start.Read ((uint8_t*)str, length);
-    documents.insert(std::string (str, length));
-    free (str);
-  }
-  
-  return FetchRsp::GetSerializedSize ();
+const GUSearchMessage::FetchRsp&
+GUSearchMessage::GetFetchRsp () const
+{
+  return m_payload.Get<FetchRsp> ();
+}
+/* BULK_DATA */
+
+void
+GUSearchMessage::BulkData::Print (std::ostream &os) const
+{
+  os << "BulkData:: Flow: " << flowId << " Sequence: " << sequence << " Bytes: " << message.length() << "\n";
 }
 
 void
-GUSearchMessage::SetFetchRsp (std::set<std::string> documents)
+GUSearchMessage::SetBulkData (uint32_t flowId, uint32_t sequence, Ptr<Packet> message)
 {
   if (m_messageType == 0)
     {
-      m_messageType = FETCH_RSP;
+      m_messageType = BULK_DATA;
     }
   else
     {
-      NS_ASSERT (m_messageType == FETCH_RSP);
+      NS_ASSERT (m_messageType == BULK_DATA);
+    }
+  BulkData &payload = m_payload.GetOrCreate<BulkData> ();
+  payload.flowId = flowId;
+  payload.sequence = sequence;
+  payload.message.resize (message->GetSize ());
+  if (!payload.message.empty ())
+    {
+      message->CopyData ((uint8_t *) &payload.message[0], payload.message.size ());
+    }
+}
+
+const GUSearchMessage::BulkData&
+GUSearchMessage::GetBulkData () const
+{
+  return m_payload.Get<BulkData> ();
+}
+
+/* BULK_ACK */
+
+void
+GUSearchMessage::BulkAck::Print (std::ostream &os) const
+{
+  os << "BulkAck:: Flow: " << flowId << " CumulativeAck: " << cumulativeAck << " Sacked: " << sackedSequences.size() << "\n";
+}
+
+void
+GUSearchMessage::SetBulkAck (uint32_t flowId, uint32_t cumulativeAck, std::vector<uint32_t> &sackedSequences)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = BULK_ACK;
     }
-  m_message.fetchRsp.documents = documents;
+  else
+    {
+      NS_ASSERT (m_messageType == BULK_ACK);
+    }
+  NS_ASSERT (sackedSequences.size () <= 255);
+  BulkAck &payload = m_payload.GetOrCreate<BulkAck> ();
+  payload.flowId = flowId;
+  payload.cumulativeAck = cumulativeAck;
+  payload.sackedSequences.swap (sackedSequences);
 }
 
-GUSearchMessage::FetchRsp
-GUSearchMessage::GetFetchRsp ()
+const GUSearchMessage::BulkAck&
+GUSearchMessage::GetBulkAck () const
 {
-  return m_message.fetchRsp;
+  return m_payload.Get<BulkAck> ();
 }
 
+/* COUNT_REQ */
+
+void
+GUSearchMessage::CountReq::Print (std::ostream &os) const
+{
+  os << "CountReq:: Key: " << key << "\n";
+}
+
+void
+GUSearchMessage::SetCountReq (std::string key)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = COUNT_REQ;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == COUNT_REQ);
+    }
+  CountReq &payload = m_payload.GetOrCreate<CountReq> ();
+  payload.key.swap (key);
+}
+
+const GUSearchMessage::CountReq&
+GUSearchMessage::GetCountReq () const
+{
+  return m_payload.Get<CountReq> ();
+}
+
+/* COUNT_RSP */
+
+void
+GUSearchMessage::CountRsp::Print (std::ostream &os) const
+{
+  os << "CountRsp:: Key: " << key << " Count: " << count << "\n";
+}
+
+void
+GUSearchMessage::SetCountRsp (std::string key, uint32_t count)
+{
+  if (m_messageType == 0)
+    {
+      m_messageType = COUNT_RSP;
+    }
+  else
+    {
+      NS_ASSERT (m_messageType == COUNT_RSP);
+    }
+  CountRsp &payload = m_payload.GetOrCreate<CountRsp> ();
+  payload.key.swap (key);
+  payload.count = count;
+}
+
+const GUSearchMessage::CountRsp&
+GUSearchMessage::GetCountRsp () const
+{
+  return m_payload.Get<CountRsp> ();
+}
+
+uint32_t
+GUSearchMessage::GetDocumentSize (const std::string &document)
+{
+  return sizeof(uint16_t) + document.length();
+}
 
 //
 //
@@ -557,6 +501,10 @@ GUSearchMessage::GetFetchRsp ()
 void
 GUSearchMessage::SetMessageType (MessageType messageType)
 {
+  if (messageType != m_messageType)
+    {
+      m_payload.Clear ();
+    }
   m_messageType = messageType;
 }
 
@@ -578,3 +526,8 @@ GUSearchMessage::GetTransactionId (void) const
   return m_transactionId;
 }
 
+void
+GUSearchMessage::SetPayloadViews (bool payloadViews)
+{
+  m_payloadViews = payloadViews;
+}
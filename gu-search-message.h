@@ -21,12 +21,29 @@
 #include "ns3/ipv4-address.h"
 #include "ns3/packet.h"
 #include "ns3/object.h"
+#include "ns3/gu-tagged-payload.h"
+#include "ns3/gu-payload-view.h"
+#include "ns3/gu-wire-codec.h"
 #include <set>
+#include <vector>
 
 using namespace ns3;
 
 #define IPV4_ADDRESS_SIZE 4
 
+// Payload struct carried by each message type. The codec switches in
+// gu-search-message.cc are generated from this list.
+#define GU_SEARCH_PAYLOADS(X) \
+  X (PING_REQ, PingReq) \
+  X (PING_RSP, PingRsp) \
+  X (STORE_REQ, StoreReq) \
+  X (FETCH_REQ, FetchReq) \
+  X (FETCH_RSP, FetchRsp) \
+  X (BULK_DATA, BulkData) \
+  X (BULK_ACK, BulkAck) \
+  X (COUNT_REQ, CountReq) \
+  X (COUNT_RSP, CountRsp)
+
 class GUSearchMessage : public Header
 {
   public:
@@ -41,6 +58,10 @@ class GUSearchMessage : public Header
         STORE_REQ = 3,
         FETCH_REQ = 4,
         FETCH_RSP = 5,
+        BULK_DATA = 6,
+        BULK_ACK = 7,
+        COUNT_REQ = 8,
+        COUNT_RSP = 9,
         // Define extra message types when needed       
       };
 
@@ -68,12 +89,20 @@ class GUSearchMessage : public Header
      */
     uint32_t GetTransactionId () const;
 
+    /**
+     *  \brief Deserialize document lists as StringViews into documentViews
+     *  instead of owned sets. Such a message is receive-only.
+     *  \param payloadViews true to enable
+     */
+    void SetPayloadViews (bool payloadViews);
+
   private:
     /**
      *  \cond
      */
     MessageType m_messageType;
     uint32_t m_transactionId;
+    bool m_payloadViews;
     /**
      *  \endcond
      */
@@ -89,71 +118,191 @@ class GUSearchMessage : public Header
     struct PingReq
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
         std::string pingMessage;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (pingMessage);
+        }
       };
 
     struct PingRsp
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
         std::string pingMessage;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (pingMessage);
+        }
       };
 
     struct StoreReq
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
         std::string key;
+        // Position of this message in a document list split across several
+        uint32_t chunkIndex;
+        uint32_t chunkCount;
         std::set<std::string> documents;
+        // Filled instead of documents when payloadViews is set
+        StringViewList documentViews;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (key);
+          codec.U32 (chunkIndex);
+          codec.U32 (chunkCount);
+          codec.StringSet (documents, documentViews);
+        }
       };
     struct FetchReq
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
         uint32_t originatorNum;
         std::string key;
-        std::set<std::string> searchKeys;
+        // Terms still to visit, in the order the planner chose
+        std::vector<std::string> searchKeys;
         std::set<std::string> documents;
+        // Filled instead of documents when payloadViews is set
+        StringViewList documentViews;
+        // Candidates as a GUBloomFilter instead of documents when filterHashes > 0
+        uint8_t filterHashes;
+        std::string filter;
+        // Terms applied only through a filter; their lists are checked again at the end
+        std::vector<std::string> verifyKeys;
+        uint8_t verifying;              //searchKeys are a verification pass; no filters
+        // Owners of searchKeys, in order: the receiver queries them all at once and intersects the answers
+        std::vector<uint32_t> gatherOwners;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.U32 (originatorNum);
+          codec.String (key);
+          codec.StringList (searchKeys, sizeof (uint32_t));
+          codec.StringSet (documents, documentViews);
+          codec.U8 (filterHashes);
+          codec.Blob (filter);
+          codec.StringList (verifyKeys, sizeof (uint8_t));
+          codec.U8 (verifying);
+          codec.U32List (gatherOwners, sizeof (uint8_t));
+        }
       };
 
     struct FetchRsp
       {
         void Print (std::ostream &os) const;
-        uint32_t GetSerializedSize (void) const;
-        void Serialize (Buffer::Iterator &start) const;
-        uint32_t Deserialize (Buffer::Iterator &start);
+        WIRE_CODEC_METHODS
         // Payload
+        // Position of this message in a document list split across several
+        uint32_t chunkIndex;
+        uint32_t chunkCount;
         std::set<std::string> documents;
+        // Filled instead of documents when payloadViews is set
+        StringViewList documentViews;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.U32 (chunkIndex);
+          codec.U32 (chunkCount);
+          codec.StringSet (documents, documentViews);
+        }
       };  
 
-  private:
-    struct
+    // A serialized message carried by the reliable bulk transport
+    struct BulkData
       {
-        PingReq pingReq;
-        PingRsp pingRsp;
-        StoreReq storeReq;
-        FetchReq fetchReq;
-        FetchRsp fetchRsp;
-      } m_message;
+        void Print (std::ostream &os) const;
+        WIRE_CODEC_METHODS
+        // Payload
+        uint32_t flowId;
+        uint32_t sequence;
+        std::string message;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.U32 (flowId);
+          codec.U32 (sequence);
+          codec.Blob (message);
+        }
+      };
+
+    struct BulkAck
+      {
+        void Print (std::ostream &os) const;
+        WIRE_CODEC_METHODS
+        // Payload
+        uint32_t flowId;
+        uint32_t cumulativeAck;
+        std::vector<uint32_t> sackedSequences;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.U32 (flowId);
+          codec.U32 (cumulativeAck);
+          codec.U32List (sackedSequences, sizeof (uint8_t));
+        }
+      };
+
+    // Posting-list size of a term, asked of its owner by the query planner
+    struct CountReq
+      {
+        void Print (std::ostream &os) const;
+        WIRE_CODEC_METHODS
+        // Payload
+        std::string key;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (key);
+        }
+      };
+
+    struct CountRsp
+      {
+        void Print (std::ostream &os) const;
+        WIRE_CODEC_METHODS
+        // Payload
+        std::string key;
+        uint32_t count;
+
+        template <typename Codec>
+        void Fields (Codec &codec)
+        {
+          codec.String (key);
+          codec.U32 (count);
+        }
+      };
+
+    /**
+     *  \returns Size of a document as one entry of a serialized list
+     */
+    static uint32_t GetDocumentSize (const std::string &document);
+
+  private:
+    TaggedPayload m_payload;
     
   public:
     /**
      *  \returns PingReq Struct
      */
-    PingReq GetPingReq ();
+    const PingReq& GetPingReq () const;
 
     /**
      *  \brief Sets PingReq message params
@@ -165,7 +314,7 @@ class GUSearchMessage : public Header
     /**
      * \returns PingRsp Struct
      */
-    PingRsp GetPingRsp ();
+    const PingRsp& GetPingRsp () const;
     /**
      *  \brief Sets PingRsp message params
      *  \param message Payload String
@@ -176,34 +325,67 @@ class GUSearchMessage : public Header
     /**
      *  \returns StoreReq Struct
      */
-    StoreReq GetStoreReq ();
+    const StoreReq& GetStoreReq () const;
 
     /**
      *  \brief Sets StoreReq message params
      *  \param key 
+     *  \param documents swapped into the message; left empty
+     *  \param chunkIndex, chunkCount position of documents in the full list
      */
-    void SetStoreReq (std::string key, std::set<std::string> documents);
+    void SetStoreReq (std::string key, std::set<std::string> &documents, uint32_t chunkIndex, uint32_t chunkCount);
     
     /**
      *  \returns PingReq Struct
      */
-    FetchReq GetFetchReq ();
+    const FetchReq& GetFetchReq () const;
 
     /**
      *  \brief Sets FetchReq message params
-     *  \param message Payload String
+     *  \param searchKeys, documents swapped into the message; left empty
      */
 
-    void SetFetchReq (uint32_t originatorNum, std::string key, std::set<std::string> searchKeys, std::set<std::string> documents);
+    void SetFetchReq (uint32_t originatorNum, std::string key, std::vector<std::string> &searchKeys, std::set<std::string> &documents);
+    /**
+     *  \brief Sets the FetchReq candidate filter; call after SetFetchReq
+     *  \param filter, verifyKeys swapped into the message; left empty
+     */
+    void SetFetchFilter (uint8_t filterHashes, std::string &filter, std::vector<std::string> &verifyKeys, bool verifying);
+    /**
+     *  \brief Asks the receiver to gather the remaining terms in parallel; call after SetFetchReq
+     *  \param gatherOwners node number of each search key's owner; swapped into the message
+     */
+    void SetFetchGather (std::vector<uint32_t> &gatherOwners);
     /**
      * \returns PingRsp Struct
      */
-    FetchRsp GetFetchRsp ();
+    const FetchRsp& GetFetchRsp () const;
     /**
      *  \brief Sets FetchRsp message params
-     *  \param message Payload String
+     *  \param documents swapped into the message; left empty
+     *  \param chunkIndex, chunkCount position of documents in the full list
      */
-    void SetFetchRsp (std::set<std::string> documents);
+    void SetFetchRsp (std::set<std::string> &documents, uint32_t chunkIndex, uint32_t chunkCount);
+
+    const BulkData& GetBulkData () const;
+    /**
+     *  \brief Sets BulkData message params
+     *  \param message the carried message, serialized
+     */
+    void SetBulkData (uint32_t flowId, uint32_t sequence, Ptr<Packet> message);
+
+    const BulkAck& GetBulkAck () const;
+    /**
+     *  \brief Sets BulkAck message params
+     *  \param sackedSequences swapped into the message; left empty
+     */
+    void SetBulkAck (uint32_t flowId, uint32_t cumulativeAck, std::vector<uint32_t> &sackedSequences);
+
+    const CountReq& GetCountReq () const;
+    void SetCountReq (std::string key);
+
+    const CountRsp& GetCountRsp () const;
+    void SetCountRsp (std::string key, uint32_t count);
 
 }; // class GUSearchMessage
 
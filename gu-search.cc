@@ -18,17 +18,23 @@
 
 
 #include "gu-search.h"
+#include "ns3/gu-posting-intersection.h"
+#include "ns3/gu-bloom-filter.h"
 #include <fstream>
 #include <cstdio>
 #include <iostream>
 #include <sstream>
 #include <ios>
 #include <iomanip>
+#include <algorithm>
 #include "ns3/random-variable.h"
 #include "ns3/inet-socket-address.h"
 
 using namespace ns3;
 
+#define TERM_COUNT_UNKNOWN 0xffffffff   //sorts a term whose owner has not answered last
+#define GATHER_TOMBSTONE_TIMEOUTS 4     //gather timeouts an expired gather still claims late answers
+
 TypeId
 GUSearch::GetTypeId ()
 {
@@ -50,6 +56,76 @@ GUSearch::GetTypeId ()
                    TimeValue (MilliSeconds (2000)),
                    MakeTimeAccessor (&GUSearch::m_pingTimeout),
                    MakeTimeChecker ())
+    .AddAttribute ("Domain",
+                   "Hierarchical location of this node passed to the Chord layer (e.g. \"site1/rack2\")",
+                   StringValue (""),
+                   MakeStringAccessor (&GUSearch::m_domain),
+                   MakeStringChecker ())
+    .AddAttribute ("Overlay",
+                   "TypeId name of the overlay routing keys for the search layer (GUChord or GUKademlia)",
+                   StringValue ("GUChord"),
+                   MakeStringAccessor (&GUSearch::m_overlayType),
+                   MakeStringChecker ())
+    .AddAttribute ("CoalesceWindow",
+                   "Time messages to the same destination are held to share a datagram, in milliseconds. 0 coalesces within one event only",
+                   TimeValue (MilliSeconds (0)),
+                   MakeTimeAccessor (&GUSearch::m_coalesceWindow),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxDatagramSize",
+                   "Coalesced datagrams are sent early once they reach this many bytes",
+                   UintegerValue (1400),
+                   MakeUintegerAccessor (&GUSearch::m_maxDatagramSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("MaxChunkSize",
+                   "STORE_REQ and FETCH_RSP messages larger than this many bytes are split into chunks",
+                   UintegerValue (1200),
+                   MakeUintegerAccessor (&GUSearch::m_maxChunkSize),
+                   MakeUintegerChecker<uint32_t> (64))
+    .AddAttribute ("StreamTimeout",
+                   "Partially received FETCH_RSP chunk streams are dropped after this long without a chunk, in milliseconds",
+                   TimeValue (MilliSeconds (10000)),
+                   MakeTimeAccessor (&GUSearch::m_streamTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("ReliableBulk",
+                   "Send key handoff and multi-chunk FETCH_RSP through the acknowledged, windowed bulk transport",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&GUSearch::m_reliableBulk),
+                   MakeBooleanChecker ())
+    .AddAttribute ("SharedSocket",
+                   "Run the overlay on the search layer's socket, tagging each message with its layer. Otherwise the overlay opens its own socket on ChordPort",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&GUSearch::m_sharedSocket),
+                   MakeBooleanChecker ())
+    .AddAttribute ("PlanTimeout",
+                   "How long a search waits for posting-list sizes before ordering its terms with what it has, in milliseconds",
+                   TimeValue (MilliSeconds (1000)),
+                   MakeTimeAccessor (&GUSearch::m_planTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("TermStatsTimeout",
+                   "How long a posting-list size learned from a term's owner is used for planning, in milliseconds",
+                   TimeValue (MilliSeconds (60000)),
+                   MakeTimeAccessor (&GUSearch::m_termStatsTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("ScatterGather",
+                   "Have the owner of a search's smallest list query all other term owners in parallel and intersect their answers, instead of passing the running result along a chain",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&GUSearch::m_scatterGather),
+                   MakeBooleanChecker ())
+    .AddAttribute ("GatherTimeout",
+                   "How long a scatter-gather waits for term owners before answering the originator with no documents, in milliseconds",
+                   TimeValue (MilliSeconds (5000)),
+                   MakeTimeAccessor (&GUSearch::m_gatherTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("CandidateFilter",
+                   "Ship intermediate search results as a Bloom filter when it is smaller than the document list. False positives are removed by a verification pass before results return",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&GUSearch::m_candidateFilter),
+                   MakeBooleanChecker ())
+    .AddAttribute ("FilterFalsePositiveRate",
+                   "False-positive rate the candidate filter is sized for",
+                   DoubleValue (0.01),
+                   MakeDoubleAccessor (&GUSearch::m_filterFalsePositiveRate),
+                   MakeDoubleChecker<double> (0.0001, 0.5))
     ;
   return tid;
 }
@@ -57,11 +133,9 @@ GUSearch::GetTypeId ()
 GUSearch::GUSearch ()
   : m_auditPingsTimer (Timer::CANCEL_ON_DESTROY)
 {
-  m_chord = NULL;
-  RandomVariable random;
+  m_overlay = NULL;
   SeedManager::SetSeed (time (NULL));
-  random = UniformVariable (0x00000000, 0xFFFFFFFF);
-  m_currentTransactionId = random.GetInteger ();
+  m_transport = Create<GUTransport> ();
 }
 
 GUSearch::~GUSearch ()
@@ -79,44 +153,59 @@ GUSearch::DoDispose ()
 void
 GUSearch::StartApplication (void)
 {
-  // Create and Configure GUChord
+  // Create and Configure the overlay
   ObjectFactory factory;
-  factory.SetTypeId (GUChord::GetTypeId ());
-  factory.Set ("AppPort", UintegerValue (m_chordPort));
-  m_chord = factory.Create<GUChord> ();
-  m_chord->SetNode (GetNode ());
-  m_chord->SetNodeAddressMap (m_nodeAddressMap);
-  m_chord->SetAddressNodeMap (m_addressNodeMap);
-  m_chord->SetModuleName ("CHORD");
+  factory.SetTypeId (TypeId::LookupByName (m_overlayType));
+  factory.Set ("AppPort", UintegerValue (m_sharedSocket ? m_appPort : m_chordPort));
+  if (m_overlayType == "GUChord")
+    {
+      factory.Set ("Domain", StringValue (m_domain));
+    }
+  m_overlay = factory.Create<GUOverlay> ();
+  m_overlay->SetNode (GetNode ());
+  m_overlay->SetNodeAddressMap (m_nodeAddressMap);
+  m_overlay->SetAddressNodeMap (m_addressNodeMap);
+  m_overlay->SetModuleName ("CHORD");
   std::string nodeId = GetNodeId ();
-  m_chord->SetNodeId (nodeId);
-  m_chord->SetLocalAddress(m_local);
+  m_overlay->SetNodeId (nodeId);
+  m_overlay->SetLocalAddress(m_local);
 
   if (GUApplication::IsRealStack ())
   {
-    m_chord->SetRealStack (true);
+    m_overlay->SetRealStack (true);
   } 
 
-  // Configure Callbacks with Chord
-  m_chord->SetPingSuccessCallback (MakeCallback (&GUSearch::HandleChordPingSuccess, this)); 
-  m_chord->SetPingFailureCallback (MakeCallback (&GUSearch::HandleChordPingFailure, this));
-  m_chord->SetPingRecvCallback (MakeCallback (&GUSearch::HandleChordPingRecv, this));
+  // Configure Callbacks with the overlay
+  m_overlay->SetPingSuccessCallback (MakeCallback (&GUSearch::HandleChordPingSuccess, this)); 
+  m_overlay->SetPingFailureCallback (MakeCallback (&GUSearch::HandleChordPingFailure, this));
+  m_overlay->SetPingRecvCallback (MakeCallback (&GUSearch::HandleChordPingRecv, this));
  
-  m_chord->SetChordLookupCallback (MakeCallback (&GUSearch::HandleChordLookupCallback, this));
-  m_chord->SetChordLeaveCallback (MakeCallback (&GUSearch::HandleChordLeaveRequest, this));
-  m_chord->SetPredecessorChangeCallback (MakeCallback (&GUSearch::HandlePredecessorChangeCallback, this));
+  m_overlay->SetLookupCallback (MakeCallback (&GUSearch::HandleLookupCallback, this));
+  m_overlay->SetLeaveCallback (MakeCallback (&GUSearch::HandleLeaveCallback, this));
+  m_overlay->SetOwnershipChangeCallback (MakeCallback (&GUSearch::HandleOwnershipChangeCallback, this));
+  m_overlay->SetKeyCountCallback (MakeCallback (&GUSearch::GetKeyCount, this));
   
-  // Start Chord
-  m_chord->SetStartTime (Simulator::Now());
-  m_chord->Start ();
-  if (m_socket == 0)
-    { 
-      TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
-      m_socket = Socket::CreateSocket (GetNode (), tid);
-      InetSocketAddress local = InetSocketAddress (Ipv4Address::GetAny(), m_appPort);
-      m_socket->Bind (local);
-      m_socket->SetRecvCallback (MakeCallback (&GUSearch::RecvMessage, this));
-    }  
+  // Open the endpoint first so a shared overlay can send as soon as it starts
+  m_transport->SetWindow (m_coalesceWindow);
+  m_transport->SetMaxDatagramSize (m_maxDatagramSize);
+  m_transport->Open (GetNode (), m_appPort);
+  m_transport->SetReceiveCallback (GUTransport::SEARCH_LAYER, MakeCallback (&GUSearch::HandleMessage, this));
+  if (m_sharedSocket)
+    {
+      m_overlay->SetTransport (m_transport);
+    }
+  else
+    {
+      // Separate sockets still answer liveness from one table
+      m_transport->SetLiveness (m_overlay->GetLiveness ());
+    }
+
+  // Start the overlay
+  m_overlay->SetStartTime (Simulator::Now());
+  m_overlay->Start ();
+  m_bulkTransport.SetSendDataCallback (MakeCallback (&GUSearch::SendBulkData, this));
+  m_bulkTransport.SetSendAckCallback (MakeCallback (&GUSearch::SendBulkAck, this));
+  m_bulkTransport.SetFailureCallback (MakeCallback (&GUSearch::HandleBulkFailure, this));
   
   // Configure timers
   m_auditPingsTimer.SetFunction (&GUSearch::AuditPings, this);
@@ -127,19 +216,27 @@ GUSearch::StartApplication (void)
 void
 GUSearch::StopApplication (void)
 {
-  //Stop chord
-  m_chord->StopChord ();
+  //Stop overlay
+  m_overlay->StopOverlay ();
   // Close socket
-  if (m_socket)
-    {
-      m_socket->Close ();
-      m_socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
-      m_socket = 0;
-    }
+  m_bulkTransport.Cancel ();
+  m_transport->SetReceiveCallback (GUTransport::SEARCH_LAYER, GUTransport::ReceiveCallback ());
+  m_transport->Close ();
 
   // Cancel timers
   m_auditPingsTimer.Cancel ();
-  m_pingTracker.clear ();
+  m_fetchRspStreams.clear ();
+  for (std::map<uint32_t, SearchPlan>::iterator plan = m_searchPlans.begin (); plan != m_searchPlans.end (); plan++)
+    {
+      plan->second.timeout.Cancel ();
+    }
+  m_searchPlans.clear ();
+  for (std::map<uint32_t, Gather>::iterator gather = m_gathers.begin (); gather != m_gathers.end (); gather++)
+    {
+      gather->second.timeout.Cancel ();
+    }
+  m_gathers.clear ();
+  m_gatherRequests.clear ();
 }
 
 void
@@ -147,11 +244,11 @@ GUSearch::ProcessCommand (std::vector<std::string> tokens)
 {
   std::vector<std::string>::iterator iterator = tokens.begin();
   std::string command = *iterator;
-  if (command == "CHORD")
+  if (command == "CHORD" || command == "OVERLAY")
     { 
-      // Send to Chord Sub-Layer
+      // Send to overlay Sub-Layer
       tokens.erase (iterator);
-      m_chord->ProcessCommand (tokens);
+      m_overlay->ProcessCommand (tokens);
     } 
   if (command == "PING")
     {
@@ -246,16 +343,159 @@ GUSearch::SendSearchRequest(uint32_t viaNodeNum, uint32_t requestingNodeNum,
   SEARCH_LOG("Search< " << ss.str() << ">");
   
   
-  searchReqMsg.SetFetchReq (requestingNodeNum, "", searchKeys, existingDocuments);
+  // the first node plans the order, so the keys go out as given
+  std::vector<std::string> keys (searchKeys.begin(), searchKeys.end());
+  searchReqMsg.SetFetchReq (requestingNodeNum, "", keys, existingDocuments);
   packet->AddHeader (searchReqMsg);
-  m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+  m_transport->Send (GUTransport::SEARCH_LAYER, packet, destAddress, m_appPort);
+}
+
+void
+GUSearch::SendSearchMessage (Ipv4Address destAddress, GUSearchMessage &message, bool bulk)
+{
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (message);
+  if (bulk && m_reliableBulk)
+    {
+      m_bulkTransport.Send (destAddress, packet);
+    }
+  else
+    {
+      m_transport->Send (GUTransport::SEARCH_LAYER, packet, destAddress, m_appPort);
+    }
+}
+
+void
+GUSearch::HandleBulkFailure (Ipv4Address destAddress, std::vector<Ptr<Packet> > messages)
+{
+  // Handed-off postings come back to this node, which hands them on again at
+  // the next ownership change; merging is idempotent if some did arrive
+  for (std::vector<Ptr<Packet> >::iterator it = messages.begin (); it != messages.end (); it++)
+    {
+      GUSearchMessage message;
+      message.SetPayloadViews (true);
+      Ptr<Packet> packet = (*it)->Copy ();
+      packet->RemoveHeader (message);
+      if (message.GetMessageType () == GUSearchMessage::STORE_REQ)
+        {
+          const GUSearchMessage::StoreReq &storeReq = message.GetStoreReq ();
+          DEBUG_LOG ("Bulk flow to " << ReverseLookup (destAddress) << " failed; keeping key " << storeReq.key);
+          GUDocumentDictionary::PostingList ids;
+          for (StringViewList::const_iterator d = storeReq.documentViews.begin (); d != storeReq.documentViews.end (); d++)
+            {
+              ids.push_back (m_dictionary.Intern (d->str ()));
+            }
+          GUDocumentDictionary::Merge (m_documents[storeReq.key], ids);
+        }
+      else
+        {
+          DEBUG_LOG ("Bulk flow to " << ReverseLookup (destAddress) << " failed; dropping message type " << (uint32_t) message.GetMessageType ());
+        }
+    }
+}
+
+void
+GUSearch::SendBulkData (Ipv4Address destAddress, uint32_t flowId, uint32_t sequence, Ptr<Packet> message)
+{
+  GUSearchMessage bulkData = GUSearchMessage (GUSearchMessage::BULK_DATA, GetNextTransactionId ());
+  bulkData.SetBulkData (flowId, sequence, message);
+  SendSearchMessage (destAddress, bulkData, false);
+}
+
+void
+GUSearch::SendBulkAck (Ipv4Address destAddress, uint32_t flowId, uint32_t cumulativeAck, std::vector<uint32_t> sackedSequences)
+{
+  GUSearchMessage bulkAck = GUSearchMessage (GUSearchMessage::BULK_ACK, GetNextTransactionId ());
+  bulkAck.SetBulkAck (flowId, cumulativeAck, sackedSequences);
+  SendSearchMessage (destAddress, bulkAck, false);
+}
+
+void
+GUSearch::SendStoreReq (Ipv4Address destAddress, uint32_t transactionId, std::string key, std::set<std::string> &documents, bool bulk)
+{
+  // size of a STORE_REQ for this key without any documents
+  std::set<std::string> none;
+  GUSearchMessage emptyReq = GUSearchMessage (GUSearchMessage::STORE_REQ, transactionId);
+  emptyReq.SetStoreReq (key, none, 0, 1);
+
+  std::vector<std::set<std::string> > chunks;
+  SplitDocuments (documents, emptyReq.GetSerializedSize (), chunks);
+  for (uint32_t i = 0; i < chunks.size (); i++)
+    {
+      GUSearchMessage storeReq = GUSearchMessage (GUSearchMessage::STORE_REQ, transactionId);
+      storeReq.SetStoreReq (key, chunks[i], i, chunks.size ());
+      SendSearchMessage (destAddress, storeReq, bulk);
+    }
+}
+
+void
+GUSearch::SendFetchRsp (Ipv4Address destAddress, uint32_t transactionId, std::set<std::string> &documents)
+{
+  std::set<std::string> none;
+  GUSearchMessage emptyRsp = GUSearchMessage (GUSearchMessage::FETCH_RSP, transactionId);
+  emptyRsp.SetFetchRsp (none, 0, 1);
+
+  std::vector<std::set<std::string> > chunks;
+  SplitDocuments (documents, emptyRsp.GetSerializedSize (), chunks);
+  for (uint32_t i = 0; i < chunks.size (); i++)
+    {
+      // a single-chunk result is no bigger than a control message
+      GUSearchMessage fetchRsp = GUSearchMessage (GUSearchMessage::FETCH_RSP, transactionId);
+      fetchRsp.SetFetchRsp (chunks[i], i, chunks.size ());
+      SendSearchMessage (destAddress, fetchRsp, chunks.size () > 1);
+    }
+}
+
+void
+GUSearch::SendStoreReq (Ipv4Address destAddress, uint32_t transactionId, std::string key, const GUDocumentDictionary::PostingList &postings, bool bulk)
+{
+  std::set<std::string> documents;
+  m_dictionary.Materialize (postings, documents);
+  SendStoreReq (destAddress, transactionId, key, documents, bulk);
+}
+
+void
+GUSearch::SendFetchRsp (Ipv4Address destAddress, uint32_t transactionId, const GUDocumentDictionary::PostingList &postings)
+{
+  std::set<std::string> documents;
+  m_dictionary.Materialize (postings, documents);
+  SendFetchRsp (destAddress, transactionId, documents);
+}
+
+void
+GUSearch::SplitDocuments (std::set<std::string> &documents, uint32_t overhead, std::vector<std::set<std::string> > &chunks)
+{
+  // Cut the sorted list into runs that keep each message within m_maxChunkSize;
+  // there is always at least one chunk, so an empty list still gets a reply
+  uint32_t budget = m_maxChunkSize > overhead ? m_maxChunkSize - overhead : 0;
+  uint32_t size = 0;
+  chunks.clear ();
+  std::set<std::string>::iterator first = documents.begin ();
+  for (std::set<std::string>::iterator it = documents.begin (); it != documents.end (); it++)
+    {
+      uint32_t documentSize = GUSearchMessage::GetDocumentSize (*it);
+      if (it != first && size + documentSize > budget)
+        {
+          chunks.push_back (std::set<std::string> (first, it));
+          first = it;
+          size = 0;
+        }
+      size += documentSize;
+    }
+  if (chunks.empty ())
+    {
+      chunks.resize (1);
+      chunks[0].swap (documents);
+      return;
+    }
+  chunks.push_back (std::set<std::string> (first, documents.end ()));
+  documents.clear ();
 }
 
 void
 GUSearch::PublishList() {
   //print all the index
-  std::map<std::string,std::set<std::string> >::iterator key_it;
-  std::set<std::string>::iterator doc_it;
+  std::map<std::string,GUDocumentDictionary::PostingList>::iterator key_it;
   
   for(key_it = m_index.begin(); key_it != m_index.end(); key_it++){
     
@@ -280,14 +520,15 @@ GUSearch::PublishList() {
     kli.operationType = STORE;
     m_keyRequestTracker[transId] = kli;
     
-    std::set<std::string> results = m_index[key];
+    std::set<std::string> results;
+    m_dictionary.Materialize(key_it->second, results);
     std::stringstream ss;
     for(std::set<std::string>::iterator i = results.begin(); i != results.end(); i++){  
       ss << *i << " ";
     }
     SEARCH_LOG("Publish< " << key << ", " << ss.str() << ">");
     
-    m_chord->SendChordLookup(lookupKey, transId);
+    m_overlay->Lookup(lookupKey, transId);
     
   }
 }
@@ -320,25 +561,21 @@ GUSearch::CreateInvertedList(std::string filename){
           key_term = temp;
         }
         //Add document to key_term index
-        std::set<std::string> existing_docs (m_index[key_term]);
-        existing_docs.insert(document);
-        m_index[key_term] = existing_docs;
-        
-        std::set<std::string>::iterator it;
+        GUDocumentDictionary::Insert(m_index[key_term], m_dictionary.Intern(document));
       }
     }
     file.close();
   }
   
   //print all the index
-  typedef std::set<std::string> SET;
-  std::map<std::string,SET>::iterator key_it;
+  std::map<std::string,GUDocumentDictionary::PostingList>::iterator key_it;
   std::set<std::string>::iterator doc_it;
   
   for(key_it = m_index.begin(); key_it != m_index.end(); key_it++){
     
     std::string key = key_it->first;
-    std::set<std::string> tempSet = key_it->second;
+    std::set<std::string> tempSet;
+    m_dictionary.Materialize(key_it->second, tempSet);
     
     std::cout<< key << ": ";
     for(doc_it = tempSet.begin(); doc_it != tempSet.end(); doc_it++){
@@ -354,68 +591,54 @@ GUSearch::CreateInvertedList(std::string filename){
 void
 GUSearch::SendPing (std::string nodeId, std::string pingMessage)
 {
-  // Send Ping Via-Chord layer 
-  SEARCH_LOG ("Sending Ping via Chord Layer to node: " << nodeId << " Message: " << pingMessage);
   Ipv4Address destAddress = ResolveNodeIpAddress(nodeId);
-  m_chord->SendPing (destAddress, pingMessage);
-}
-
-void
-GUSearch::SendGUSearchPing (Ipv4Address destAddress, std::string pingMessage)
-{
-  if (destAddress != Ipv4Address::GetAny ())
+  // Traffic from the node at either layer within a ping timeout already answers the question
+  if (destAddress != Ipv4Address::GetAny () && m_transport->GetLiveness ()->HeardWithin (destAddress, m_pingTimeout))
     {
-      uint32_t transactionId = GetNextTransactionId ();
-      SEARCH_LOG ("Sending PING_REQ to Node: " << ReverseLookup(destAddress) << " IP: " << destAddress << " Message: " << pingMessage << " transactionId: " << transactionId);
-      Ptr<PingRequest> pingRequest = Create<PingRequest> (transactionId, Simulator::Now(), destAddress, pingMessage);
-      // Add to ping-tracker
-      m_pingTracker.insert (std::make_pair (transactionId, pingRequest));
-      Ptr<Packet> packet = Create<Packet> ();
-      GUSearchMessage message = GUSearchMessage (GUSearchMessage::PING_REQ, transactionId);
-      message.SetPingReq (pingMessage);
-      packet->AddHeader (message);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (destAddress, m_appPort));
+      SEARCH_LOG ("Ping Success from recent traffic! Destination nodeId: " << nodeId << " IP: " << destAddress << " Message: " << pingMessage);
+      return;
     }
-
-
+  // Send Ping Via-Chord layer 
+  SEARCH_LOG ("Sending Ping via Chord Layer to node: " << nodeId << " Message: " << pingMessage);
+  m_overlay->SendPing (destAddress, pingMessage);
 }
 
 void
-GUSearch::RecvMessage (Ptr<Socket> socket)
+GUSearch::HandleMessage (Ptr<Packet> packet, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
-  Address sourceAddr;
-  Ptr<Packet> packet = socket->RecvFrom (sourceAddr);
-  InetSocketAddress inetSocketAddr = InetSocketAddress::ConvertFrom (sourceAddr);
-  Ipv4Address sourceAddress = inetSocketAddr.GetIpv4 ();
-  uint16_t sourcePort = inetSocketAddr.GetPort ();
   GUSearchMessage message;
+  // Document lists stay in the packet's arena until a handler keeps them
+  message.SetPayloadViews (true);
   packet->RemoveHeader (message);
 
-  switch (message.GetMessageType ())
+  static const MessageHandler handlers[] =
+    {
+      0,
+      &GUSearch::ProcessPingReq,  // PING_REQ
+      &GUSearch::ProcessPingRsp,  // PING_RSP
+      &GUSearch::ProcessStoreReq, // STORE_REQ
+      &GUSearch::ProcessFetchReq, // FETCH_REQ
+      &GUSearch::ProcessFetchRsp, // FETCH_RSP
+      &GUSearch::ProcessBulkData, // BULK_DATA
+      &GUSearch::ProcessBulkAck,  // BULK_ACK
+      &GUSearch::ProcessCountReq, // COUNT_REQ
+      &GUSearch::ProcessCountRsp, // COUNT_RSP
+    };
+  // fails to compile if a message type is added without a handler
+  typedef char HandlerTableIsComplete[(sizeof (handlers) / sizeof (handlers[0]) == GUSearchMessage::COUNT_RSP + 1) ? 1 : -1];
+  (void) sizeof (HandlerTableIsComplete);
+
+  uint32_t messageType = message.GetMessageType ();
+  if (messageType == 0 || messageType >= sizeof (handlers) / sizeof (handlers[0]))
     {
-      case GUSearchMessage::PING_REQ:
-        ProcessPingReq (message, sourceAddress, sourcePort);
-        break;
-      case GUSearchMessage::PING_RSP:
-        ProcessPingRsp (message, sourceAddress, sourcePort);
-        break;
-      case GUSearchMessage::STORE_REQ:
-        ProcessStoreReq (message, sourceAddress, sourcePort);
-        break;        
-      case GUSearchMessage::FETCH_REQ:
-        ProcessFetchReq (message, sourceAddress, sourcePort);
-        break;
-      case GUSearchMessage::FETCH_RSP:
-        ProcessFetchRsp (message, sourceAddress, sourcePort);
-        break;
-      default:
-        ERROR_LOG ("Unknown Message Type!");
-        break;
-    }
-}
-
-void
-GUSearch::ProcessPingReq (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort)
+      ERROR_LOG ("Unknown Message Type!");
+      return;
+    }
+  (this->*handlers[messageType]) (message, sourceAddress, sourcePort);
+}
+
+void
+GUSearch::ProcessPingReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
 
     // Use reverse lookup for ease of debug
@@ -426,131 +649,117 @@ GUSearch::ProcessPingReq (GUSearchMessage message, Ipv4Address sourceAddress, ui
     resp.SetPingRsp (message.GetPingReq().pingMessage);
     Ptr<Packet> packet = Create<Packet> ();
     packet->AddHeader (resp);
-    m_socket->SendTo (packet, 0 , InetSocketAddress (sourceAddress, sourcePort));
+    m_transport->Send (GUTransport::SEARCH_LAYER, packet, sourceAddress, sourcePort);
 }
 
 void
-GUSearch::ProcessPingRsp (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort)
+GUSearch::ProcessPingRsp (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort)
 {
-  // Remove from pingTracker
-  std::map<uint32_t, Ptr<PingRequest> >::iterator iter;
-  iter = m_pingTracker.find (message.GetTransactionId ());
-  if (iter != m_pingTracker.end ())
-    {
-      std::string fromNode = ReverseLookup (sourceAddress);
-      SEARCH_LOG ("Received PING_RSP, From Node: " << fromNode << ", Message: " << message.GetPingRsp().pingMessage);
-      m_pingTracker.erase (iter);
-    }
-  else
-    {
-      DEBUG_LOG ("Received invalid PING_RSP!");
-    }
+  // Liveness is tracked by the transport; nothing is waiting on the response itself
+  std::string fromNode = ReverseLookup (sourceAddress);
+  SEARCH_LOG ("Received PING_RSP, From Node: " << fromNode << ", Message: " << message.GetPingRsp().pingMessage);
 }
 
 void 
-GUSearch::ProcessStoreReq (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort) {
+GUSearch::ProcessStoreReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort) {
   
-  std::set<std::string> documents = message.GetStoreReq().documents;
+  const GUSearchMessage::StoreReq &storeReq = message.GetStoreReq();
+  GUDocumentDictionary::PostingList ids;
+  ids.reserve(storeReq.documentViews.size());
   std::stringstream ss;
-  for (std::set<std::string>::iterator it = documents.begin(); it != documents.end(); it++) {
-    m_documents[message.GetStoreReq().key].insert(*it);
+  for (StringViewList::const_iterator it = storeReq.documentViews.begin(); it != storeReq.documentViews.end(); it++) {
+    ids.push_back(m_dictionary.Intern(it->str()));
     ss << *it << " ";
   }
+  GUDocumentDictionary::Merge(m_documents[storeReq.key], ids);
 
-  SEARCH_LOG("Store< " << message.GetStoreReq().key << ", " << ss.str() << ">");
+  SEARCH_LOG("Store< " << storeReq.key << ", " << ss.str() << ">");
 }
 
 void 
-GUSearch::ProcessFetchReq(GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort){
+GUSearch::ProcessFetchReq(const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort){
 
-  std::string firstKey = message.GetFetchReq().key;
-  std::set<std::string> l_searchKeys = message.GetFetchReq().searchKeys;
-  
-  std::set<std::string> resultDocuments;
+  const GUSearchMessage::FetchReq &request = message.GetFetchReq();
+  std::string firstKey = request.key;
   
-  if (firstKey == "" && !l_searchKeys.empty()) {
-    // we are first!
-    
-    std::set<std::string>::iterator it = l_searchKeys.begin();
-    firstKey = *it;
-    l_searchKeys.erase(it); 
-  
-    // 1. hash the key
-    unsigned char temp[20];
-    SHA1((unsigned char *)firstKey.c_str(), strlen(firstKey.c_str()), temp);
-    std::ostringstream s;
-    s << std::hex << std::setfill('0');
-    for (int i = 0; i < 20; i++) {
-      s << std::setw(2) << static_cast<int>(temp[i]);
-    }
-    std::string lookupKey = s.str();
-    
-    // 2. send chord lookup
-    uint32_t transId = GetNextTransactionId();
+  GUDocumentDictionary::PostingList resultIds;
   
-    KeyLookupInformation kli;
-    kli.lookupKey = lookupKey;
-    kli.actualKey = firstKey;
-    kli.operationType = FETCH;
-    GUSearchMessage::FetchReq fetchReq;
-    fetchReq.key = firstKey;
-    fetchReq.originatorNum = message.GetFetchReq().originatorNum;
-    fetchReq.searchKeys = l_searchKeys;
-    fetchReq.documents = message.GetFetchReq().documents;
-    kli.fetchReq = fetchReq;
-    m_keyRequestTracker[transId] = kli;
-    
-    m_chord->SendChordLookup(lookupKey, transId);
+  if (firstKey == "" && !request.searchKeys.empty()) {
+    // we are first: find out how long each list is before choosing an order
+    PlanSearch(request);
     
   } else {
     // we are not first
     
-    std::set<std::string> myResults;
-    if (m_documents.find(firstKey) != m_documents.end())
-      myResults = (m_documents.find(firstKey))->second;
+    GUDocumentDictionary::PostingList none;
+    std::map<std::string,GUDocumentDictionary::PostingList>::const_iterator mine = m_documents.find(firstKey);
+    const GUDocumentDictionary::PostingList &myResults = mine != m_documents.end() ? mine->second : none;
     
     if (myResults.empty()) {
       
       SEARCH_LOG("SearchResults<" << g_nodeId << ",\"EmptyList\">");
       
       //  send "no results" to message.GetFetchReq().originatorNum
-      Ptr<Packet> packet = Create<Packet> ();
-      GUSearchMessage fetchRsp = GUSearchMessage (GUSearchMessage::FETCH_RSP, GetNextTransactionId());
-      uint32_t nodeNum = message.GetFetchReq().originatorNum;
+      uint32_t nodeNum = request.originatorNum;
       
-      fetchRsp.SetFetchRsp(myResults);
-      packet->AddHeader(fetchRsp);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(nodeNum), m_appPort));
+      SendFetchRsp (ResolveNodeIpAddress(nodeNum), message.GetTransactionId(), myResults);
       
       return;
     }
     
-    if (message.GetFetchReq().documents.empty()) {
-      resultDocuments = myResults;
+    const StringViewList &receivedViews = request.documentViews;
+    if (request.filterHashes > 0) {
+      // the candidates came as a filter: keep whatever of mine it may hold
+      GUBloomFilter candidates;
+      std::string bits = request.filter;
+      candidates.Assign(request.filterHashes, bits);
+      for (GUDocumentDictionary::PostingList::const_iterator it = myResults.begin(); it != myResults.end(); it++) {
+        if (candidates.MayContain(m_dictionary.GetName(*it)))
+          resultIds.push_back(*it);
+      }
+    } else if (receivedViews.empty()) {
+      resultIds = myResults;
     } else {
       
-      std::set<std::string> receivedDocuments = message.GetFetchReq().documents;
-      
-      // resultDocuments = receivedDocuments INTERSECT myResults
-      for(std::set<std::string>::iterator myit = myResults.begin(); myit != myResults.end(); myit++) {
-        for(std::set<std::string>::iterator rcvit = receivedDocuments.begin(); 
-            rcvit != receivedDocuments.end(); rcvit++) {
-          if(*myit == *rcvit){
-            resultDocuments.insert(*myit);
-          } 
-        }
+      // resultIds = receivedDocuments INTERSECT myResults
+      // A name this node never interned cannot be in any of its postings, so
+      // only known names are mapped; the ids then intersect as flat arrays.
+      GUDocumentDictionary::PostingList receivedIds;
+      receivedIds.reserve(receivedViews.size());
+      uint32_t id;
+      for (StringViewList::const_iterator v = receivedViews.begin(); v != receivedViews.end(); v++) {
+        if (m_dictionary.Find(v->str(), id))
+          receivedIds.push_back(id);
       }
+      std::sort(receivedIds.begin(), receivedIds.end());
+      GUPostingIntersection::Intersect(myResults, receivedIds, resultIds);
       
     }
     
+    // names are needed from here on: for the wire and the log
+    std::set<std::string> resultDocuments;
+    m_dictionary.Materialize(resultIds, resultDocuments);
     
-    if (l_searchKeys.empty()){
+    
+    if (!request.gatherOwners.empty() && !resultDocuments.empty()) {
+      Scatter(request, resultIds, resultDocuments);
+      return;
+    }
+    
+    std::vector<std::string> searchKeys = request.searchKeys;
+    std::vector<std::string> verifyKeys = request.verifyKeys;
+    bool verifying = request.verifying;
+    if (searchKeys.empty() && !verifyKeys.empty()) {
+      // only the lists that were applied through a filter can drop its false positives
+      searchKeys.swap(verifyKeys);
+      verifying = true;
+    }
+    
+    // an empty running intersection stays empty, so the rest of the chain is skipped
+    if (searchKeys.empty() || resultDocuments.empty()){
     
       //  send result to message.GetFetchReq().originatorNum
-      Ptr<Packet> packet = Create<Packet> ();
-      GUSearchMessage fetchRsp = GUSearchMessage (GUSearchMessage::FETCH_RSP, GetNextTransactionId());
-
-      uint32_t nodeNum = message.GetFetchReq().originatorNum;
+      uint32_t nodeNum = request.originatorNum;
 
       /*      
       std::set<std::string>::iterator d;
@@ -566,60 +775,410 @@ GUSearch::ProcessFetchReq(GUSearchMessage message, Ipv4Address sourceAddress, ui
       }
       */
 
-      fetchRsp.SetFetchRsp(resultDocuments);
-      packet->AddHeader(fetchRsp);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(nodeNum), m_appPort));
+      SendFetchRsp (ResolveNodeIpAddress(nodeNum), message.GetTransactionId(), resultDocuments);
       
     } else {
-      // extract key
-      std::set<std::string> remainingSearchKeys = message.GetFetchReq().searchKeys;
-      std::set<std::string>::iterator it = remainingSearchKeys.begin();
-      std::string extractedKey = *it;
-      remainingSearchKeys.erase(it); 
-            
-      // 1. hash the key
-      unsigned char temp[20];
-      SHA1((unsigned char *)extractedKey.c_str(), strlen(extractedKey.c_str()), temp);
-      std::ostringstream s;
-      s << std::hex << std::setfill('0');
-      for (int i = 0; i < 20; i++) {
-        s << std::setw(2) << static_cast<int>(temp[i]);
-      }
-      std::string lookupKey = s.str();
-      
-      // 2. send chord lookup
-      uint32_t transId = GetNextTransactionId();
-    
-      KeyLookupInformation kli;
-      kli.lookupKey = lookupKey;
-      kli.actualKey = extractedKey;
-      kli.operationType = FETCH;
-      GUSearchMessage::FetchReq fetchReq;
-      fetchReq.key = extractedKey;
-      fetchReq.originatorNum = message.GetFetchReq().originatorNum;
-      fetchReq.searchKeys = remainingSearchKeys;
-      fetchReq.documents = resultDocuments;
-      kli.fetchReq = fetchReq;
-      m_keyRequestTracker[transId] = kli;
-      
-      m_chord->SendChordLookup(lookupKey, transId);
-      
       std::stringstream res;
       for(std::set<std::string>::iterator i = resultDocuments.begin(); i != resultDocuments.end(); i++){  
         res << *i << " ";
       }
-      SEARCH_LOG("InvertedListShip< "<< extractedKey <<", " << res.str() << " >");
+      SEARCH_LOG("InvertedListShip< "<< searchKeys.front() <<", " << res.str() << " >");
       
+      GUSearchMessage::FetchReq next = GUSearchMessage::FetchReq();
+      next.originatorNum = request.originatorNum;
+      next.searchKeys.swap(searchKeys);
+      next.verifyKeys.swap(verifyKeys);
+      next.verifying = verifying;
+      if (m_candidateFilter && !verifying && next.verifyKeys.size() < 255 && IsFilterSmaller(resultDocuments)) {
+        GUBloomFilter filter;
+        filter.Init(resultDocuments.size(), m_filterFalsePositiveRate);
+        for (std::set<std::string>::iterator i = resultDocuments.begin(); i != resultDocuments.end(); i++) {
+          filter.Add(*i);
+        }
+        next.filterHashes = filter.GetHashCount();
+        next.filter.swap(filter.GetBits());
+        // the next hop cannot tell my false positives from real candidates
+        next.verifyKeys.push_back(firstKey);
+      } else {
+        next.documents.swap(resultDocuments);
+      }
+      ForwardFetchReq(next);
     }
   }
   
 }
+
+bool
+GUSearch::IsFilterSmaller (const std::set<std::string> &documents) {
+  uint32_t listSize = 0;
+  for (std::set<std::string>::const_iterator d = documents.begin(); d != documents.end(); d++) {
+    listSize += GUSearchMessage::GetDocumentSize(*d);
+  }
+  return GUBloomFilter::GetSizeFor(documents.size(), m_filterFalsePositiveRate) < listSize;
+}
+
+void
+GUSearch::ForwardFetchReq (GUSearchMessage::FetchReq &fetchReq) {
+  // extract key
+  std::string extractedKey = fetchReq.searchKeys.front();
+  fetchReq.searchKeys.erase(fetchReq.searchKeys.begin());
+        
+  // 1. hash the key
+  unsigned char temp[20];
+  SHA1((unsigned char *)extractedKey.c_str(), strlen(extractedKey.c_str()), temp);
+  std::ostringstream s;
+  s << std::hex << std::setfill('0');
+  for (int i = 0; i < 20; i++) {
+    s << std::setw(2) << static_cast<int>(temp[i]);
+  }
+  std::string lookupKey = s.str();
+  
+  // 2. send chord lookup
+  uint32_t transId = GetNextTransactionId();
+
+  KeyLookupInformation &kli = m_keyRequestTracker[transId];
+  kli.lookupKey = lookupKey;
+  kli.actualKey = extractedKey;
+  kli.operationType = FETCH;
+  kli.fetchReq.key = extractedKey;
+  kli.fetchReq.originatorNum = fetchReq.originatorNum;
+  kli.fetchReq.searchKeys.swap(fetchReq.searchKeys);
+  kli.fetchReq.documents.swap(fetchReq.documents);
+  kli.fetchReq.filterHashes = fetchReq.filterHashes;
+  kli.fetchReq.filter.swap(fetchReq.filter);
+  kli.fetchReq.verifyKeys.swap(fetchReq.verifyKeys);
+  kli.fetchReq.verifying = fetchReq.verifying;
+  
+  m_overlay->Lookup(lookupKey, transId);
+}
+
+void
+GUSearch::PlanSearch (const GUSearchMessage::FetchReq &request) {
+  uint32_t planId = GetNextTransactionId();
+  SearchPlan &plan = m_searchPlans[planId];
+  plan.originatorNum = request.originatorNum;
+  plan.countsLeft = 0;
+  for (StringViewList::const_iterator v = request.documentViews.begin(); v != request.documentViews.end(); v++) {
+    plan.documents.insert(plan.documents.end(), v->str());
+  }
+
+  for (std::vector<std::string>::const_iterator key = request.searchKeys.begin(); key != request.searchKeys.end(); key++) {
+    if (plan.counts.find(*key) != plan.counts.end())
+      continue;
+    std::map<std::string,GUDocumentDictionary::PostingList>::const_iterator mine = m_documents.find(*key);
+    if (mine != m_documents.end()) {
+      plan.counts[*key] = mine->second.size();
+      plan.owners[*key] = GetNodeNum();
+      continue;
+    }
+    // a cached count does not say who owns the term, which scatter-gather needs
+    uint32_t count;
+    if (!m_scatterGather && GetTermCount(*key, count)) {
+      plan.counts[*key] = count;
+      continue;
+    }
+    // unknown until the owner answers; unanswered terms go last
+    plan.counts[*key] = TERM_COUNT_UNKNOWN;
+    plan.countsLeft++;
+
+    unsigned char temp[20];
+    SHA1((unsigned char *)key->c_str(), strlen(key->c_str()), temp);
+    std::ostringstream s;
+    s << std::hex << std::setfill('0');
+    for (int i = 0; i < 20; i++) {
+      s << std::setw(2) << static_cast<int>(temp[i]);
+    }
+    uint32_t transId = GetNextTransactionId();
+    KeyLookupInformation &kli = m_keyRequestTracker[transId];
+    kli.lookupKey = s.str();
+    kli.actualKey = *key;
+    kli.operationType = COUNT;
+    kli.planId = planId;
+    m_overlay->Lookup(kli.lookupKey, transId);
+  }
+
+  if (plan.countsLeft == 0) {
+    RunSearchPlan(planId);
+  } else {
+    plan.timeout = Simulator::Schedule(m_planTimeout, &GUSearch::RunSearchPlan, this, planId);
+  }
+}
+
+bool
+GUSearch::GetTermCount (const std::string &key, uint32_t &count) {
+  // a term stored here is exact and needs no round trip
+  std::map<std::string,GUDocumentDictionary::PostingList>::const_iterator mine = m_documents.find(key);
+  if (mine != m_documents.end()) {
+    count = mine->second.size();
+    return true;
+  }
+  std::map<std::string, TermStats>::iterator stats = m_termStats.find(key);
+  if (stats == m_termStats.end())
+    return false;
+  if (stats->second.learned + m_termStatsTimeout <= Simulator::Now()) {
+    m_termStats.erase(stats);
+    return false;
+  }
+  count = stats->second.count;
+  return true;
+}
+
+void
+GUSearch::RunSearchPlan (uint32_t planId) {
+  std::map<uint32_t, SearchPlan>::iterator iter = m_searchPlans.find(planId);
+  if (iter == m_searchPlans.end())
+    return;
+  SearchPlan &plan = iter->second;
+  plan.timeout.Cancel();
+
+  // smallest list first: every later hop ships at most that many documents
+  std::vector<std::pair<uint32_t, std::string> > order;
+  for (std::map<std::string, uint32_t>::iterator c = plan.counts.begin(); c != plan.counts.end(); c++) {
+    order.push_back(std::make_pair(c->second, c->first));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::stringstream ss;
+  std::vector<std::string> searchKeys;
+  for (uint32_t i = 0; i < order.size(); i++) {
+    searchKeys.push_back(order[i].second);
+    ss << order[i].second << ":";
+    if (order[i].first == TERM_COUNT_UNKNOWN)
+      ss << "? ";
+    else
+      ss << order[i].first << " ";
+  }
+  SEARCH_LOG("SearchPlan< " << ss.str() << ">");
+
+  if (order.front().first == 0) {
+    // a term nobody holds empties the whole conjunction
+    SEARCH_LOG("SearchResults<" << g_nodeId << ",\"EmptyList\">");
+    std::set<std::string> none;
+    SendFetchRsp (ResolveNodeIpAddress(plan.originatorNum), GetNextTransactionId(), none);
+  } else if (m_scatterGather && order.size() > 1 && plan.owners.size() == plan.counts.size()) {
+    // the smallest list's owner asks every other owner at once
+    std::vector<uint32_t> owners;
+    for (uint32_t i = 1; i < order.size(); i++) {
+      owners.push_back(plan.owners[order[i].second]);
+    }
+    std::string firstKey = searchKeys.front();
+    searchKeys.erase(searchKeys.begin());
+    GUSearchMessage gatherReq = GUSearchMessage (GUSearchMessage::FETCH_REQ, GetNextTransactionId());
+    gatherReq.SetFetchReq(plan.originatorNum, firstKey, searchKeys, plan.documents);
+    gatherReq.SetFetchGather(owners);
+    SendSearchMessage(ResolveNodeIpAddress(plan.owners[firstKey]), gatherReq, false);
+  } else {
+    // one term, or an owner that never answered: walk the chain
+    GUSearchMessage::FetchReq first = GUSearchMessage::FetchReq();
+    first.originatorNum = plan.originatorNum;
+    first.searchKeys.swap(searchKeys);
+    first.documents.swap(plan.documents);
+    ForwardFetchReq(first);
+  }
+  m_searchPlans.erase(iter);
+}
+
+void
+GUSearch::ProcessCountReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort) {
+  const GUSearchMessage::CountReq &request = message.GetCountReq();
+  std::map<std::string,GUDocumentDictionary::PostingList>::const_iterator mine = m_documents.find(request.key);
+  uint32_t count = mine != m_documents.end() ? mine->second.size() : 0;
+
+  GUSearchMessage countRsp = GUSearchMessage (GUSearchMessage::COUNT_RSP, message.GetTransactionId());
+  countRsp.SetCountRsp (request.key, count);
+  SendSearchMessage (sourceAddress, countRsp, false);
+}
+
+void
+GUSearch::ProcessCountRsp (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort) {
+  const GUSearchMessage::CountRsp &response = message.GetCountRsp();
+  TermStats &stats = m_termStats[response.key];
+  stats.count = response.count;
+  stats.learned = Simulator::Now();
+
+  // the transaction id names the plan that asked
+  std::map<uint32_t, SearchPlan>::iterator iter = m_searchPlans.find(message.GetTransactionId());
+  if (iter == m_searchPlans.end())
+    return;
+  SearchPlan &plan = iter->second;
+  std::map<std::string, uint32_t>::iterator count = plan.counts.find(response.key);
+  if (count == plan.counts.end() || count->second != TERM_COUNT_UNKNOWN)
+    return;
+  count->second = response.count;
+  if (--plan.countsLeft == 0)
+    RunSearchPlan(iter->first);
+}
     
+uint32_t
+GUSearch::GetNodeNum () {
+  std::istringstream sin (g_nodeId);
+  uint32_t nodeNum;
+  sin >> nodeNum;
+  return nodeNum;
+}
+
+void
+GUSearch::Scatter (const GUSearchMessage::FetchReq &request, const GUDocumentDictionary::PostingList &candidates, std::set<std::string> &documents) {
+  uint32_t gatherId = GetNextTransactionId();
+  Gather &gather = m_gathers[gatherId];
+  gather.originatorNum = request.originatorNum;
+  gather.candidates = candidates;
+  gather.answersLeft = request.searchKeys.size();
+  gather.done = false;
+  gather.expired = false;
+  gather.timeout = Simulator::Schedule(m_gatherTimeout, &GUSearch::ExpireGather, this, gatherId);
+
+  // every owner gets the same candidates, and answers with the ones it holds
+  GUBloomFilter filter;
+  bool filtered = m_candidateFilter && IsFilterSmaller(documents);
+  if (filtered) {
+    filter.Init(documents.size(), m_filterFalsePositiveRate);
+    for (std::set<std::string>::iterator d = documents.begin(); d != documents.end(); d++) {
+      filter.Add(*d);
+    }
+  }
+  std::stringstream ss;
+  for (uint32_t i = 0; i < request.searchKeys.size(); i++) {
+    // one id per owner request: an owner may hold several of the terms
+    uint32_t requestId = GetNextTransactionId();
+    Ipv4Address owner = ResolveNodeIpAddress(request.gatherOwners[i]);
+    gather.requests.push_back(requestId);
+    m_gatherRequests[requestId] = std::make_pair(gatherId, owner);
+    ss << request.searchKeys[i] << "@" << request.gatherOwners[i] << " ";
+
+    std::vector<std::string> none;
+    std::set<std::string> ownerDocuments;
+    if (!filtered)
+      ownerDocuments = documents;
+    GUSearchMessage scatterReq = GUSearchMessage (GUSearchMessage::FETCH_REQ, requestId);
+    scatterReq.SetFetchReq(GetNodeNum(), request.searchKeys[i], none, ownerDocuments);
+    if (filtered) {
+      // the owner's answer is intersected with the exact candidates here, which drops false positives
+      std::string bits = filter.GetBits();
+      std::vector<std::string> noVerify;
+      scatterReq.SetFetchFilter(filter.GetHashCount(), bits, noVerify, false);
+    }
+    SendSearchMessage(owner, scatterReq, false);
+  }
+  SEARCH_LOG("Scatter< " << candidates.size() << " candidates to " << ss.str() << ">");
+}
+
+void
+GUSearch::GatherFetchRsp (uint32_t requestId, GUDocumentDictionary::PostingList &ids) {
+  std::map<uint32_t, std::pair<uint32_t, Ipv4Address> >::iterator request = m_gatherRequests.find(requestId);
+  uint32_t gatherId = request->second.first;
+  m_gatherRequests.erase(request);
+  Gather &gather = m_gathers[gatherId];
+  gather.answersLeft--;
+  if (!gather.done) {
+    std::sort(ids.begin(), ids.end());
+    GUDocumentDictionary::PostingList remaining;
+    GUPostingIntersection::Intersect(gather.candidates, ids, remaining);
+    gather.candidates.swap(remaining);
+    // an empty intersection cannot grow back, so later answers are not waited for
+    if (gather.answersLeft == 0 || gather.candidates.empty()) {
+      SendFetchRsp (ResolveNodeIpAddress(gather.originatorNum), GetNextTransactionId(), gather.candidates);
+      gather.done = true;
+    }
+  }
+  if (gather.answersLeft == 0) {
+    gather.timeout.Cancel();
+    m_gathers.erase(gatherId);
+  }
+}
+
+void
+GUSearch::ExpireGather (uint32_t gatherId) {
+  std::map<uint32_t, Gather>::iterator iter = m_gathers.find(gatherId);
+  if (iter == m_gathers.end())
+    return;
+  Gather &gather = iter->second;
+  if (!gather.expired) {
+    // Answer the originator now, then keep the request ids a while so late
+    // owner answers are not taken for search results of this node's own
+    if (!gather.done) {
+      DEBUG_LOG ("Gather expired. Owners missing: " << gather.answersLeft);
+      GUDocumentDictionary::PostingList none;
+      SendFetchRsp (ResolveNodeIpAddress(gather.originatorNum), GetNextTransactionId(), none);
+      gather.done = true;
+    }
+    gather.expired = true;
+    gather.timeout = Simulator::Schedule(MilliSeconds(m_gatherTimeout.GetMilliSeconds() * GATHER_TOMBSTONE_TIMEOUTS), &GUSearch::ExpireGather, this, gatherId);
+    return;
+  }
+  for (std::vector<uint32_t>::iterator r = iter->second.requests.begin(); r != iter->second.requests.end(); r++) {
+    m_gatherRequests.erase(*r);
+  }
+  m_gathers.erase(iter);
+}
+
+bool
+GUSearch::IsGatherRsp (uint32_t transactionId, Ipv4Address sourceAddress) {
+  // transaction ids are only unique per node, so the sender must be the owner asked
+  std::map<uint32_t, std::pair<uint32_t, Ipv4Address> >::iterator iter = m_gatherRequests.find(transactionId);
+  return iter != m_gatherRequests.end() && iter->second.second == sourceAddress;
+}
+
 void 
-GUSearch::ProcessFetchRsp (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort) {
-  std::set<std::string> results = message.GetFetchRsp().documents;
+GUSearch::ProcessFetchRsp (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort) {
+  const GUSearchMessage::FetchRsp &response = message.GetFetchRsp();
+  const StringViewList &results = response.documentViews;
+
+  if (response.chunkCount > 1) {
+    // Fold each chunk in as it arrives; report once the last one is in
+    FetchRspStream &stream = m_fetchRspStreams[std::make_pair(sourceAddress, message.GetTransactionId())];
+    if (stream.chunkReceived.empty()) {
+      stream.chunkReceived.resize(response.chunkCount, false);
+      stream.chunksLeft = response.chunkCount;
+    }
+    if (response.chunkIndex >= stream.chunkReceived.size() || stream.chunkReceived[response.chunkIndex]) {
+      DEBUG_LOG ("Dropping duplicate or invalid FETCH_RSP chunk " << response.chunkIndex << " from " << ReverseLookup(sourceAddress));
+      return;
+    }
+    stream.chunkReceived[response.chunkIndex] = true;
+    stream.chunksLeft--;
+    stream.lastChunk = Simulator::Now();
+    for (StringViewList::const_iterator v = results.begin(); v != results.end(); v++) {
+      stream.documents.insert(v->str());
+    }
+    if (stream.chunksLeft > 0) {
+      return;
+    }
 
-  std::set<std::string>::iterator d;
+    if (IsGatherRsp(message.GetTransactionId(), sourceAddress)) {
+      GUDocumentDictionary::PostingList ids;
+      uint32_t id;
+      for (std::set<std::string>::iterator d = stream.documents.begin(); d != stream.documents.end(); d++) {
+        if (m_dictionary.Find(*d, id))
+          ids.push_back(id);
+      }
+      m_fetchRspStreams.erase(std::make_pair(sourceAddress, message.GetTransactionId()));
+      GatherFetchRsp(message.GetTransactionId(), ids);
+      return;
+    }
+
+    std::stringstream res;
+    for (std::set<std::string>::iterator d = stream.documents.begin(); d != stream.documents.end(); d++) {
+      res << *d << " ";
+    }
+    SEARCH_LOG("SearchResults< "<< g_nodeId <<", " << res.str() << " >");
+    m_fetchRspStreams.erase(std::make_pair(sourceAddress, message.GetTransactionId()));
+    return;
+  }
+
+  if (IsGatherRsp(message.GetTransactionId(), sourceAddress)) {
+    // the candidates came from this node's own list, so every match is already interned
+    GUDocumentDictionary::PostingList ids;
+    uint32_t id;
+    for (StringViewList::const_iterator v = results.begin(); v != results.end(); v++) {
+      if (m_dictionary.Find(v->str(), id))
+        ids.push_back(id);
+    }
+    GatherFetchRsp(message.GetTransactionId(), ids);
+    return;
+  }
+
+  StringViewList::const_iterator d;
   std::stringstream res;
   for(d = results.begin(); d != results.end(); d++){  
     res << *d << " ";
@@ -632,18 +1191,36 @@ GUSearch::ProcessFetchRsp (GUSearchMessage message, Ipv4Address sourceAddress, u
   }
 }
 
+void
+GUSearch::ProcessBulkData (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort) {
+  const GUSearchMessage::BulkData &data = message.GetBulkData();
+  if (!m_bulkTransport.ReceiveData(sourceAddress, data.flowId, data.sequence))
+    return;
+
+  // Hand the carried message to its handler as if it had arrived on its own
+  Ptr<Packet> packet = Create<Packet> ((const uint8_t *) data.message.data(), data.message.length());
+  HandleMessage (packet, sourceAddress, sourcePort);
+}
+
+void
+GUSearch::ProcessBulkAck (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort) {
+  const GUSearchMessage::BulkAck &ack = message.GetBulkAck();
+  m_bulkTransport.ReceiveAck(sourceAddress, ack.flowId, ack.cumulativeAck, ack.sackedSequences);
+}
+
 void
 GUSearch::PrintMyDocuments() {
   
   std::cout << "DOCUMENTS FOR NODE " << g_nodeId << ": "<<std::endl;
   
   //m_documents
-  std::map<std::string,std::set<std::string> >::iterator a;
+  std::map<std::string,GUDocumentDictionary::PostingList>::iterator a;
   std::set<std::string>::iterator b;
   for(a = m_documents.begin(); a != m_documents.end(); a++){
     std::string key = a->first;
     std::cout << " " << key << ":";
-    std::set<std::string> tempSet = a->second;
+    std::set<std::string> tempSet;
+    m_dictionary.Materialize(a->second, tempSet);
     for(b = tempSet.begin(); b != tempSet.end(); b++){  
       std::cout<< *b << ",";
     }
@@ -651,23 +1228,25 @@ GUSearch::PrintMyDocuments() {
   }
 }
 
+uint32_t
+GUSearch::GetKeyCount() {
+  return m_documents.size();
+}
 
 void
 GUSearch::AuditPings ()
 {
-  std::map<uint32_t, Ptr<PingRequest> >::iterator iter;
-  for (iter = m_pingTracker.begin () ; iter != m_pingTracker.end();)
+  std::map<std::pair<Ipv4Address, uint32_t>, FetchRspStream>::iterator stream;
+  for (stream = m_fetchRspStreams.begin (); stream != m_fetchRspStreams.end ();)
     {
-      Ptr<PingRequest> pingRequest = iter->second;
-      if (pingRequest->GetTimestamp().GetMilliSeconds() + m_pingTimeout.GetMilliSeconds() <= Simulator::Now().GetMilliSeconds())
+      if (stream->second.lastChunk + m_streamTimeout <= Simulator::Now ())
         {
-          DEBUG_LOG ("Ping expired. Message: " << pingRequest->GetPingMessage () << " Timestamp: " << pingRequest->GetTimestamp().GetMilliSeconds () << " CurrentTime: " << Simulator::Now().GetMilliSeconds ());
-          // Remove stale entries
-          m_pingTracker.erase (iter++);
+          DEBUG_LOG ("FETCH_RSP stream expired. From: " << ReverseLookup (stream->first.first) << " Chunks missing: " << stream->second.chunksLeft);
+          m_fetchRspStreams.erase (stream++);
         }
       else
         {
-          ++iter;
+          ++stream;
         }
     }
   // Rechedule timer
@@ -677,10 +1256,10 @@ GUSearch::AuditPings ()
 uint32_t
 GUSearch::GetNextTransactionId ()
 {
-  return m_currentTransactionId++;
+  return m_transport->GetNextTransactionId ();
 }
 
-// Handle Chord Callbacks
+// Handle Overlay Callbacks
 
 void
 GUSearch::HandleChordPingFailure (Ipv4Address destAddress, std::string message)
@@ -691,9 +1270,16 @@ GUSearch::HandleChordPingFailure (Ipv4Address destAddress, std::string message)
 void
 GUSearch::HandleChordPingSuccess (Ipv4Address destAddress, std::string message)
 {
-  SEARCH_LOG ("Chord Ping Success! Destination nodeId: " << ReverseLookup(destAddress) << " IP: " << destAddress << " Message: " << message);
-  // Send ping via search layer 
-  SendGUSearchPing (destAddress, message);
+  // The overlay shares this node's endpoint, so its answer covers the search layer too
+  Time rtt;
+  if (m_transport->GetLiveness ()->GetRtt (destAddress, rtt))
+    {
+      SEARCH_LOG ("Chord Ping Success! Destination nodeId: " << ReverseLookup(destAddress) << " IP: " << destAddress << " Message: " << message << " SRTT: " << rtt.GetMilliSeconds () << "ms");
+    }
+  else
+    {
+      SEARCH_LOG ("Chord Ping Success! Destination nodeId: " << ReverseLookup(destAddress) << " IP: " << destAddress << " Message: " << message);
+    }
 }
 
 void
@@ -708,28 +1294,21 @@ GUSearch::HandleChordPingRecv (Ipv4Address destAddress, std::string message)
 
 
 void
-GUSearch::HandleChordLeaveRequest (Ipv4Address destAddress, uint32_t successorNodeNum)
+GUSearch::HandleLeaveCallback (Ipv4Address destAddress, uint32_t successorNodeNum)
 {
-  std::map<std::string,std::set<std::string> >::iterator a;
+  std::map<std::string,GUDocumentDictionary::PostingList>::iterator a;
   for(a = m_documents.begin(); a != m_documents.end(); a++){
     std::string key = a->first;
-    std::set<std::string> tempSet = a->second;
-    
-    Ptr<Packet> packet = Create<Packet> ();
-    GUSearchMessage storeReq = GUSearchMessage (GUSearchMessage::STORE_REQ, GetNextTransactionId());
     
-    storeReq.SetStoreReq (key, tempSet);
-    packet->AddHeader (storeReq);
-    m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(successorNodeNum), m_appPort));
+    SendStoreReq (ResolveNodeIpAddress(successorNodeNum), GetNextTransactionId(), key, a->second, true);
   }
   m_documents.clear();
 }
 
 void
-GUSearch::HandlePredecessorChangeCallback (Ipv4Address destAddress, std::string message) {
-  std::map<std::string,std::set<std::string> >::iterator a;
-  std::set<std::string>::iterator b;
-  for(a = m_documents.begin(); a != m_documents.end(); a++){
+GUSearch::HandleOwnershipChangeCallback (Ipv4Address destAddress, std::string nodeId) {
+  std::map<std::string,GUDocumentDictionary::PostingList>::iterator a;
+  for(a = m_documents.begin(); a != m_documents.end(); ){
     std::string key = a->first;
         
     // 1. hash the key
@@ -742,60 +1321,22 @@ GUSearch::HandlePredecessorChangeCallback (Ipv4Address destAddress, std::string
     }
     std::string lookupKeyStr = s.str();
     
-    // 2. compare yourself
-    
-    bool mine = false;
-  
-    mpz_t lookupKey;
-    mpz_init_set_str(lookupKey, lookupKeyStr.c_str() , 16);
-
-    mpz_t chordId;
-    mpz_init_set_str(chordId, m_chord->m_chordIdentifier.c_str(), 16);
-
-    mpz_t predHash;
-    mpz_init_set_str(predHash, m_chord->m_predecessor_hash.c_str(), 16);
-    
-    
-    if ( mpz_cmp(predHash, chordId) < 0 ) {
-      // I am bigger than my predecessor
-      if ( mpz_cmp(lookupKey, chordId) <= 0 && mpz_cmp(lookupKey, predHash) > 0) {
-        mine = true;
-      }
-    } else {
-      // I am less or equal than predecessor - crosses hash boundary
-      mpz_t modifiedMe;
-      mpz_init_set(modifiedMe, chordId);
-      mpz_add(modifiedMe, modifiedMe, m_chord->maxHash);
-      
-      if ( mpz_cmp(lookupKey, modifiedMe) <= 0 && mpz_cmp(lookupKey, predHash) > 0) {
-        mine = true;
-      } else {
-        mpz_t modifiedKey;
-        mpz_init_set(modifiedKey, lookupKey);
-        mpz_add(modifiedKey, modifiedKey, m_chord->maxHash);
-        
-        if ( mpz_cmp(modifiedKey, modifiedMe) <= 0 && mpz_cmp(modifiedKey, predHash) > 0) {
-          mine = true;
-        }
-      }
-    }
-    
-    if (!mine) {
-      GUSearchMessage storeReq = GUSearchMessage (GUSearchMessage::STORE_REQ, GetNextTransactionId());
-      Ptr<Packet> packet = Create<Packet> ();
-      storeReq.SetStoreReq (key, m_documents[key]);
-      packet->AddHeader (storeReq);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(m_chord->m_predecessor), m_appPort));
+    // 2. hand it over if the newcomer displaced us as its owner
+    Ipv4Address target;
+    if (m_overlay->GetHandoverTarget (nodeId, destAddress, lookupKeyStr, target)) {
+      SendStoreReq (target, GetNextTransactionId(), key, a->second, true);
       
       // erase that key from documents since I already sent it
-      m_documents.erase(key);
+      m_documents.erase(a++);
+    } else {
+      a++;
     }
 
   }
 }
 
 void
-GUSearch::HandleChordLookupCallback (Ipv4Address destAddress, uint32_t nodeNum, std::string nodeHash, uint32_t transId)
+GUSearch::HandleLookupCallback (Ipv4Address destAddress, uint32_t nodeNum, std::string nodeHash, uint32_t transId)
 {
   TRAFFIC_LOG ("Chord Layer Received Lookup Response! Source nodeId: " << ReverseLookup(destAddress) << " IP: " << destAddress << " ResultNodeNum: " << nodeNum << " ResultNodeHash: " << nodeHash << " Transaction ID:" << transId);
   
@@ -803,12 +1344,12 @@ GUSearch::HandleChordLookupCallback (Ipv4Address destAddress, uint32_t nodeNum,
   nodeNumStream << nodeNum;
   std::string nodeNumStr = nodeNumStream.str();
   
-  KeyLookupInformation kli = m_keyRequestTracker[transId];
+  // every case below erases the entry, so its sets are handed over, not copied
+  KeyLookupInformation &kli = m_keyRequestTracker[transId];
   std::string key = kli.actualKey;
   OperationType opType = kli.operationType;
-  GUSearchMessage::FetchReq fetchRq = kli.fetchReq;
+  GUSearchMessage::FetchReq &fetchRq = kli.fetchReq;
   
-  GUSearchMessage storeReq = GUSearchMessage (GUSearchMessage::STORE_REQ, transId);
   GUSearchMessage fetchReq = GUSearchMessage (GUSearchMessage::FETCH_REQ, transId);
   Ptr<Packet> packet = Create<Packet> ();
   
@@ -816,9 +1357,7 @@ GUSearch::HandleChordLookupCallback (Ipv4Address destAddress, uint32_t nodeNum,
     case STORE:
       // send the key + documents to ResolveNodeIpAddress(nodeNum) 
       // send Store Request 
-      storeReq.SetStoreReq (key, m_index[key]);
-      packet->AddHeader (storeReq);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(nodeNum), m_appPort));
+      SendStoreReq (ResolveNodeIpAddress(nodeNum), transId, key, m_index[key], false);
       
       // erase that key from documents since I already sent it
       m_index.erase(key);
@@ -830,18 +1369,29 @@ GUSearch::HandleChordLookupCallback (Ipv4Address destAddress, uint32_t nodeNum,
       // std::cout << "FETCH" << std::endl;
       
       fetchReq.SetFetchReq(fetchRq.originatorNum, fetchRq.key, fetchRq.searchKeys, fetchRq.documents);
+      fetchReq.SetFetchFilter(fetchRq.filterHashes, fetchRq.filter, fetchRq.verifyKeys, fetchRq.verifying);
       packet->AddHeader(fetchReq);
-      m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(nodeNum), m_appPort));
+      m_transport->Send (GUTransport::SEARCH_LAYER, packet, ResolveNodeIpAddress(nodeNum), m_appPort);
       
       m_keyRequestTracker.erase(transId);
       
+      break;
+    case COUNT:
+      {
+        std::map<uint32_t, SearchPlan>::iterator plan = m_searchPlans.find(kli.planId);
+        if (plan != m_searchPlans.end())
+          plan->second.owners[key] = nodeNum;
+        // answered under the plan's id so the response finds its plan
+        GUSearchMessage countReq = GUSearchMessage (GUSearchMessage::COUNT_REQ, kli.planId);
+        countReq.SetCountReq (key);
+        SendSearchMessage (ResolveNodeIpAddress(nodeNum), countReq, false);
+        m_keyRequestTracker.erase(transId);
+      }
       break;
     case CHECK:
       if (nodeNumStr != g_nodeId) {
         // it is not mine, send it..
-        storeReq.SetStoreReq (key, m_documents[key]);
-        packet->AddHeader (storeReq);
-        m_socket->SendTo (packet, 0 , InetSocketAddress (ResolveNodeIpAddress(nodeNum), m_appPort));
+        SendStoreReq (ResolveNodeIpAddress(nodeNum), transId, key, m_documents[key], true);
         
         // erase that key from documents since I already sent it
         m_documents.erase(key);
@@ -864,41 +1414,41 @@ GUSearch::HandleChordLookupCallback (Ipv4Address destAddress, uint32_t nodeNum,
 void
 GUSearch::SetTrafficVerbose (bool on)
 { 
-  m_chord->SetTrafficVerbose (on);
+  m_overlay->SetTrafficVerbose (on);
   g_trafficVerbose = on;
 }
 
 void
 GUSearch::SetErrorVerbose (bool on)
 { 
-  m_chord->SetErrorVerbose (on);
+  m_overlay->SetErrorVerbose (on);
   g_errorVerbose = on;
 }
 
 void
 GUSearch::SetDebugVerbose (bool on)
 {
-  m_chord->SetDebugVerbose (on);
+  m_overlay->SetDebugVerbose (on);
   g_debugVerbose = on;
 }
 
 void
 GUSearch::SetStatusVerbose (bool on)
 {
-  m_chord->SetStatusVerbose (on);
+  m_overlay->SetStatusVerbose (on);
   g_statusVerbose = on;
 }
 
 void
 GUSearch::SetChordVerbose (bool on)
 {
-  m_chord->SetChordVerbose (on);
+  m_overlay->SetChordVerbose (on);
   g_chordVerbose = on;
 }
 
 void
 GUSearch::SetSearchVerbose (bool on)
 {
-  m_chord->SetSearchVerbose (on);
+  m_overlay->SetSearchVerbose (on);
   g_searchVerbose = on;
 }
@@ -20,9 +20,11 @@
 #define GU_SEARCH_H
 
 #include "ns3/gu-application.h"
-#include "ns3/gu-chord.h"
+#include "ns3/gu-overlay.h"
 #include "ns3/gu-search-message.h"
-#include "ns3/ping-request.h"
+#include "ns3/gu-transport.h"
+#include "ns3/gu-bulk-transport.h"
+#include "ns3/gu-document-dictionary.h"
 
 #include "ns3/ipv4-address.h"
 #include <map>
@@ -30,12 +32,13 @@
 #include <vector>
 #include <string>
 #include <openssl/sha.h>
-#include <gmp.h>
 #include "ns3/socket.h"
 #include "ns3/nstime.h"
 #include "ns3/timer.h"
+#include "ns3/event-id.h"
 #include "ns3/uinteger.h"
 #include "ns3/boolean.h"
+#include "ns3/double.h"
 
 using namespace ns3;
 
@@ -47,31 +50,61 @@ class GUSearch : public GUApplication
     virtual ~GUSearch ();
 
     void SendPing (std::string nodeId, std::string pingMessage);
-    void SendGUSearchPing (Ipv4Address destAddress, std::string pingMessage);
-    void RecvMessage (Ptr<Socket> socket);
-    void ProcessPingReq (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessPingRsp (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessStoreReq (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessFetchReq (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
-    void ProcessFetchRsp (GUSearchMessage message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void HandleMessage (Ptr<Packet> packet, Ipv4Address sourceAddress, uint16_t sourcePort);
+    // Receive dispatch, indexed by GUSearchMessage::MessageType
+    typedef void (GUSearch::*MessageHandler) (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessPingReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessPingRsp (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessStoreReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFetchReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessFetchRsp (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessBulkData (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessBulkAck (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessCountReq (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
+    void ProcessCountRsp (const GUSearchMessage &message, Ipv4Address sourceAddress, uint16_t sourcePort);
     
     void AuditPings ();
 
     void CreateInvertedList(std::string filename);
     void PublishList();
     void SendSearchRequest(uint32_t , uint32_t , std::set<std::string>, std::set<std::string> );
+    // Query planning: visit terms from the shortest posting list to the longest
+    void PlanSearch (const GUSearchMessage::FetchReq &request);
+    void RunSearchPlan (uint32_t planId);
+    bool GetTermCount (const std::string &key, uint32_t &count);
+    // Looks up the owner of the first of fetchReq.searchKeys and sends it the request
+    void ForwardFetchReq (GUSearchMessage::FetchReq &fetchReq);
+    bool IsFilterSmaller (const std::set<std::string> &documents);
+    // Scatter-gather: candidates go to every remaining owner at once
+    void Scatter (const GUSearchMessage::FetchReq &request, const GUDocumentDictionary::PostingList &candidates, std::set<std::string> &documents);
+    void GatherFetchRsp (uint32_t requestId, GUDocumentDictionary::PostingList &ids);
+    void ExpireGather (uint32_t gatherId);
+    bool IsGatherRsp (uint32_t transactionId, Ipv4Address sourceAddress);
+    uint32_t GetNodeNum ();
+    // Bulk messages go through the reliable transport when ReliableBulk is set
+    void SendSearchMessage (Ipv4Address destAddress, GUSearchMessage &message, bool bulk);
+    void SendBulkData (Ipv4Address destAddress, uint32_t flowId, uint32_t sequence, Ptr<Packet> message);
+    void SendBulkAck (Ipv4Address destAddress, uint32_t flowId, uint32_t cumulativeAck, std::vector<uint32_t> sackedSequences);
+    void HandleBulkFailure (Ipv4Address destAddress, std::vector<Ptr<Packet> > messages);
+    // Document lists larger than MaxChunkSize go out as several numbered messages
+    void SendStoreReq (Ipv4Address destAddress, uint32_t transactionId, std::string key, std::set<std::string> &documents, bool bulk);
+    void SendFetchRsp (Ipv4Address destAddress, uint32_t transactionId, std::set<std::string> &documents);
+    // Names for the postings are looked up just before sending
+    void SendStoreReq (Ipv4Address destAddress, uint32_t transactionId, std::string key, const GUDocumentDictionary::PostingList &postings, bool bulk);
+    void SendFetchRsp (Ipv4Address destAddress, uint32_t transactionId, const GUDocumentDictionary::PostingList &postings);
+    void SplitDocuments (std::set<std::string> &documents, uint32_t overhead, std::vector<std::set<std::string> > &chunks);
 
     uint32_t GetNextTransactionId ();
    
 
-    // Chord Callbacks
+    // Overlay Callbacks
     void HandleChordPingSuccess (Ipv4Address destAddress, std::string message);
     void HandleChordPingFailure (Ipv4Address destAddress, std::string message);
     void HandleChordPingRecv (Ipv4Address destAddress, std::string message);
 
-    void HandleChordLookupCallback(Ipv4Address destAddress, uint32_t, std::string, uint32_t);
-    void HandleChordLeaveRequest (Ipv4Address destAddress, uint32_t successorNodeNum);
-    void HandlePredecessorChangeCallback (Ipv4Address destAddress, std::string message);
+    void HandleLookupCallback(Ipv4Address destAddress, uint32_t, std::string, uint32_t);
+    void HandleLeaveCallback (Ipv4Address destAddress, uint32_t successorNodeNum);
+    void HandleOwnershipChangeCallback (Ipv4Address destAddress, std::string nodeId);
     
     // From GUApplication
     virtual void ProcessCommand (std::vector<std::string> tokens);
@@ -84,24 +117,70 @@ class GUSearch : public GUApplication
     virtual void SetSearchVerbose (bool on);
 
     void PrintMyDocuments();
+    uint32_t GetKeyCount();
      
-    std::map<std::string, std::set<std::string> > m_index;
+    // Posting lists of ids into m_dictionary, keyed by search term
+    std::map<std::string, GUDocumentDictionary::PostingList> m_index;
     
     enum OperationType {
       STORE, 
       FETCH,
       CHECK,
+      COUNT,
     };
     struct KeyLookupInformation {
       std::string lookupKey;
       std::string actualKey;
       OperationType operationType;
       GUSearchMessage::FetchReq fetchReq;
+      uint32_t planId;                  //COUNT only
     };
 
     std::map<uint32_t, KeyLookupInformation> m_keyRequestTracker;
 
-    std::map<std::string, std::set<std::string> > m_documents;
+    std::map<std::string, GUDocumentDictionary::PostingList> m_documents;
+    GUDocumentDictionary m_dictionary;
+
+    // FETCH_RSP chunks received so far, keyed by sender and transaction id
+    struct FetchRspStream {
+      std::set<std::string> documents;
+      std::vector<bool> chunkReceived;
+      uint32_t chunksLeft;
+      Time lastChunk;
+    };
+    std::map<std::pair<Ipv4Address, uint32_t>, FetchRspStream> m_fetchRspStreams;
+
+    // Posting-list sizes learned from term owners
+    struct TermStats {
+      uint32_t count;
+      Time learned;
+    };
+    std::map<std::string, TermStats> m_termStats;
+
+    // Searches waiting for term sizes, keyed by plan id
+    struct SearchPlan {
+      uint32_t originatorNum;
+      std::map<std::string, uint32_t> counts;
+      std::map<std::string, uint32_t> owners;   //node numbers, as far as known
+      uint32_t countsLeft;
+      std::set<std::string> documents;
+      EventId timeout;
+    };
+    std::map<uint32_t, SearchPlan> m_searchPlans;
+
+    // Scatter-gather searches this node is intersecting
+    struct Gather {
+      uint32_t originatorNum;
+      GUDocumentDictionary::PostingList candidates;
+      std::vector<uint32_t> requests;   //transaction ids of the owner requests
+      uint32_t answersLeft;
+      bool done;                        //result sent; late answers are only collected
+      bool expired;                     //timed out; kept so late answers are recognised and dropped
+      EventId timeout;
+    };
+    std::map<uint32_t, Gather> m_gathers;
+    // owner request transaction id -> (gather id, owner asked)
+    std::map<uint32_t, std::pair<uint32_t, Ipv4Address> > m_gatherRequests;
     
   protected:
     virtual void DoDispose ();
@@ -110,16 +189,28 @@ class GUSearch : public GUApplication
     virtual void StartApplication (void);
     virtual void StopApplication (void);
 
-    Ptr<GUChord> m_chord;
-
-    uint32_t m_currentTransactionId;
-    Ptr<Socket> m_socket;
+    Ptr<GUOverlay> m_overlay;
+
+    Ptr<GUTransport> m_transport;       //this node's endpoint, shared with the overlay unless SharedSocket is off
+    Time m_coalesceWindow;
+    uint32_t m_maxDatagramSize;
+    uint32_t m_maxChunkSize;
+    GUBulkTransport m_bulkTransport;    //acked, windowed delivery for key handoff and large results
+    bool m_reliableBulk;
+    bool m_sharedSocket;
+    Time m_streamTimeout;
+    Time m_planTimeout;
+    Time m_termStatsTimeout;
+    bool m_scatterGather;
+    Time m_gatherTimeout;
+    bool m_candidateFilter;
+    double m_filterFalsePositiveRate;
     Time m_pingTimeout;
     uint16_t m_appPort, m_chordPort;
+    std::string m_domain;
+    std::string m_overlayType;
     // Timers
     Timer m_auditPingsTimer;
-    // Ping tracker
-    std::map<uint32_t, Ptr<PingRequest> > m_pingTracker;
 };
 
 #endif
@@ -0,0 +1,190 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_TAGGED_PAYLOAD_H
+#define GU_TAGGED_PAYLOAD_H
+
+#include "ns3/assert.h"
+#include <vector>
+
+// Released payloads kept per payload type for the next message of that type
+#define PAYLOAD_FREE_LIST_SIZE 64
+
+/**
+ *  Holds the one payload struct a message actually carries. The message's
+ *  type field is the tag; copying a TaggedPayload copies only that struct.
+ *  Payload storage is recycled through a free list per payload type, so a
+ *  steady stream of messages does not go back to the allocator.
+ *
+ *  The free lists are process-wide rather than per node: messages do not
+ *  know which node built them, and every simulated node runs on the one
+ *  simulator thread, so sharing needs no locking. A parallel (MPI)
+ *  simulator runs one process per rank and so still gets a list per rank.
+ */
+class TaggedPayload
+{
+  private:
+    class Holder
+      {
+        public:
+          virtual ~Holder () {}
+          virtual Holder* Clone () const = 0;
+          virtual void Release () = 0;
+      };
+
+    template <typename T>
+    class HolderOf : public Holder
+      {
+        public:
+          static HolderOf<T>* Allocate ()
+          {
+            std::vector<HolderOf<T>*> &freeList = GetFreeList ().holders;
+            if (freeList.empty ())
+              {
+                return new HolderOf<T> ();
+              }
+            HolderOf<T> *holder = freeList.back ();
+            freeList.pop_back ();
+            return holder;
+          }
+
+          virtual Holder* Clone () const
+          {
+            HolderOf<T> *copy = Allocate ();
+            copy->value = value;
+            return copy;
+          }
+
+          virtual void Release ()
+          {
+            std::vector<HolderOf<T>*> &freeList = GetFreeList ().holders;
+            if (freeList.size () >= PAYLOAD_FREE_LIST_SIZE)
+              {
+                delete this;
+                return;
+              }
+            value = T ();
+            freeList.push_back (this);
+          }
+
+          T value;
+
+        private:
+          struct FreeList
+            {
+              ~FreeList ()
+              {
+                for (uint32_t i = 0; i < holders.size (); i++)
+                  {
+                    delete holders[i];
+                  }
+              }
+              std::vector<HolderOf<T>*> holders;
+            };
+
+          static FreeList& GetFreeList ()
+          {
+            static FreeList freeList;
+            return freeList;
+          }
+      };
+
+    void ReleaseHolder ()
+    {
+      if (m_holder != 0)
+        {
+          m_holder->Release ();
+          m_holder = 0;
+        }
+    }
+
+  public:
+    TaggedPayload ()
+      : m_holder (0)
+    {
+    }
+
+    TaggedPayload (const TaggedPayload &other)
+      : m_holder (other.m_holder ? other.m_holder->Clone () : 0)
+    {
+    }
+
+    TaggedPayload& operator= (const TaggedPayload &other)
+    {
+      if (this != &other)
+        {
+          Holder *copy = other.m_holder ? other.m_holder->Clone () : 0;
+          ReleaseHolder ();
+          m_holder = copy;
+        }
+      return *this;
+    }
+
+    ~TaggedPayload ()
+    {
+      ReleaseHolder ();
+    }
+
+    /**
+     *  \returns the payload; a default T if no setter ran (e.g. empty requests)
+     */
+    template <typename T>
+    const T& Get () const
+    {
+      static const T empty = T ();
+      if (m_holder == 0)
+        {
+          return empty;
+        }
+      NS_ASSERT (dynamic_cast<const HolderOf<T>*> (m_holder) != 0);
+      return static_cast<const HolderOf<T>*> (m_holder)->value;
+    }
+
+    /**
+     *  \returns the payload for writing, created on first use
+     */
+    template <typename T>
+    T& GetOrCreate ()
+    {
+      if (m_holder == 0)
+        {
+          m_holder = HolderOf<T>::Allocate ();
+        }
+      NS_ASSERT (dynamic_cast<HolderOf<T>*> (m_holder) != 0);
+      return static_cast<HolderOf<T>*> (m_holder)->value;
+    }
+
+    /**
+     *  \returns a fresh payload for writing, dropping whatever was held
+     */
+    template <typename T>
+    T& Reset ()
+    {
+      ReleaseHolder ();
+      m_holder = HolderOf<T>::Allocate ();
+      return static_cast<HolderOf<T>*> (m_holder)->value;
+    }
+
+    void Clear ()
+    {
+      ReleaseHolder ();
+    }
+
+  private:
+    Holder *m_holder;
+};
+
+#endif
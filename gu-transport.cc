@@ -0,0 +1,149 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/gu-transport.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/random-variable.h"
+#include "ns3/log.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("GUTransport");
+
+GUTransport::GUTransport ()
+  : m_port (0),
+    m_liveness (Create<GUPeerLiveness> ())
+{
+  UniformVariable random;
+  m_currentTransactionId = random.GetInteger (0, 0xFFFFFFFF);
+}
+
+GUTransport::~GUTransport ()
+{
+  Close ();
+}
+
+void
+GUTransport::Open (Ptr<Node> node, uint16_t port)
+{
+  if (m_socket != 0)
+    {
+      return;
+    }
+  TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+  m_socket = Socket::CreateSocket (node, tid);
+  InetSocketAddress local = InetSocketAddress (Ipv4Address::GetAny (), port);
+  m_socket->Bind (local);
+  m_socket->SetRecvCallback (MakeCallback (&GUTransport::RecvDatagram, this));
+  m_port = port;
+  m_batcher.SetSocket (m_socket);
+}
+
+void
+GUTransport::Close ()
+{
+  m_batcher.Cancel ();
+  m_batcher.SetSocket (0);
+  if (m_socket)
+    {
+      m_socket->Close ();
+      m_socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
+      m_socket = 0;
+    }
+}
+
+bool
+GUTransport::IsOpen () const
+{
+  return m_socket != 0;
+}
+
+uint16_t
+GUTransport::GetPort () const
+{
+  return m_port;
+}
+
+void
+GUTransport::SetWindow (Time window)
+{
+  m_batcher.SetWindow (window);
+}
+
+void
+GUTransport::SetMaxDatagramSize (uint32_t maxDatagramSize)
+{
+  m_batcher.SetMaxDatagramSize (maxDatagramSize);
+}
+
+void
+GUTransport::SetReceiveCallback (uint8_t layer, ReceiveCallback receive)
+{
+  m_receivers[layer] = receive;
+}
+
+void
+GUTransport::Send (uint8_t layer, Ptr<Packet> message, Ipv4Address destAddress, uint16_t destPort)
+{
+  m_batcher.Send (message, layer, destAddress, destPort);
+}
+
+uint32_t
+GUTransport::GetNextTransactionId ()
+{
+  return m_currentTransactionId++;
+}
+
+Ptr<GUPeerLiveness>
+GUTransport::GetLiveness () const
+{
+  return m_liveness;
+}
+
+void
+GUTransport::SetLiveness (Ptr<GUPeerLiveness> liveness)
+{
+  m_liveness = liveness;
+}
+
+void
+GUTransport::RecvDatagram (Ptr<Socket> socket)
+{
+  Address sourceAddr;
+  Ptr<Packet> datagram = socket->RecvFrom (sourceAddr);
+  InetSocketAddress inetSocketAddr = InetSocketAddress::ConvertFrom (sourceAddr);
+  Ipv4Address sourceAddress = inetSocketAddr.GetIpv4 ();
+  uint16_t sourcePort = inetSocketAddr.GetPort ();
+
+  std::vector<Ptr<Packet> > messages;
+  std::vector<uint8_t> layers;
+  if (!GUMessageBatcher::Unpack (datagram, messages, layers))
+    {
+      NS_LOG_DEBUG ("Malformed datagram from " << sourceAddress);
+      return;
+    }
+  m_liveness->RecordHeard (sourceAddress);
+  for (uint32_t i = 0; i < messages.size (); i++)
+    {
+      std::map<uint8_t, ReceiveCallback>::iterator receiver = m_receivers.find (layers[i]);
+      // a layer that is not running (yet) simply drops its messages
+      if (receiver == m_receivers.end () || receiver->second.IsNull ())
+        {
+          continue;
+        }
+      receiver->second (messages[i], sourceAddress, sourcePort);
+    }
+}
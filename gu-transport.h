@@ -0,0 +1,92 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_TRANSPORT_H
+#define GU_TRANSPORT_H
+
+#include "ns3/gu-message-batcher.h"
+#include "ns3/gu-peer-liveness.h"
+#include "ns3/node.h"
+#include "ns3/socket.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+#include "ns3/simple-ref-count.h"
+#include <map>
+
+using namespace ns3;
+
+/**
+ *  The UDP endpoint of a node, shared by the overlay and the search layer.
+ *  Each message is tagged with the layer it belongs to in the datagram
+ *  framing and handed to that layer's receive callback. Messages of both
+ *  layers to the same peer share datagrams and the coalescing timer, draw
+ *  transaction ids from one counter and update one liveness table.
+ */
+class GUTransport : public SimpleRefCount<GUTransport>
+{
+  public:
+    enum Layer
+      {
+        OVERLAY_LAYER = 1,
+        SEARCH_LAYER = 2,
+      };
+
+    // (message, sourceAddress, sourcePort)
+    typedef Callback<void, Ptr<Packet>, Ipv4Address, uint16_t> ReceiveCallback;
+
+    GUTransport ();
+    ~GUTransport ();
+
+    /**
+     *  \brief Binds the socket on port; does nothing if already open
+     */
+    void Open (Ptr<Node> node, uint16_t port);
+    void Close ();
+    bool IsOpen () const;
+    uint16_t GetPort () const;
+
+    void SetWindow (Time window);
+    void SetMaxDatagramSize (uint32_t maxDatagramSize);
+
+    /**
+     *  \brief Routes received messages of layer to receive; a null callback drops them
+     */
+    void SetReceiveCallback (uint8_t layer, ReceiveCallback receive);
+
+    void Send (uint8_t layer, Ptr<Packet> message, Ipv4Address destAddress, uint16_t destPort);
+
+    uint32_t GetNextTransactionId ();
+
+    Ptr<GUPeerLiveness> GetLiveness () const;
+    /**
+     *  \brief Records received traffic in liveness instead of this transport's own table
+     */
+    void SetLiveness (Ptr<GUPeerLiveness> liveness);
+
+  private:
+    void RecvDatagram (Ptr<Socket> socket);
+
+    Ptr<Socket> m_socket;
+    uint16_t m_port;
+    GUMessageBatcher m_batcher;         //coalesces outgoing messages per destination
+    std::map<uint8_t, ReceiveCallback> m_receivers;
+    uint32_t m_currentTransactionId;
+    Ptr<GUPeerLiveness> m_liveness;
+};
+
+#endif
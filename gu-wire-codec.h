@@ -0,0 +1,443 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GU_WIRE_CODEC_H
+#define GU_WIRE_CODEC_H
+
+#include "ns3/gu-payload-view.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/assert.h"
+#include <string>
+#include <vector>
+#include <set>
+
+using namespace ns3;
+
+/**
+ *  Declarative payload codecs. A payload struct lists its fields once, in
+ *  wire order:
+ *
+ *    template <typename Codec>
+ *    void Fields (Codec &codec)
+ *    {
+ *      codec.Id (targetID);
+ *      codec.U8 (maxEntries);
+ *    }
+ *
+ *  and WIRE_CODEC_METHODS derives GetSerializedSize, Serialize and
+ *  Deserialize from that list. WireSizer, WireWriter and WireReader each
+ *  walk the same list, so the size always matches what is written. All of
+ *  it is inline and resolves at compile time into straight-line code.
+ */
+
+#define WIRE_ADDRESS_SIZE 4
+
+class WireSizer
+{
+  public:
+    WireSizer (uint8_t wireVersion)
+      : m_wireVersion (wireVersion),
+        m_size (0)
+    {
+    }
+
+    uint32_t GetSize () const { return m_size; }
+
+    void U8 (uint8_t &value) { m_size += sizeof (uint8_t); }
+    void U32 (uint32_t &value) { m_size += sizeof (uint32_t); }
+    void U64 (uint64_t &value) { m_size += sizeof (uint64_t); }
+    void Address (Ipv4Address &value) { m_size += WIRE_ADDRESS_SIZE; }
+    void Id (std::string &value) { m_size += WIRE_ID_SIZE; }
+
+    void String (std::string &value)
+    {
+      m_size += GetWireStringSize (m_wireVersion, value);
+    }
+
+    void Blob (std::string &value)
+    {
+      m_size += GetWireCountSize (m_wireVersion, sizeof (uint32_t), value.size ()) + value.size ();
+    }
+
+    void IdList (std::vector<std::string> &value, uint32_t countSize)
+    {
+      m_size += GetWireCountSize (m_wireVersion, countSize, value.size ()) + value.size () * WIRE_ID_SIZE;
+    }
+
+    void AddressList (std::vector<Ipv4Address> &value, uint32_t countSize)
+    {
+      m_size += GetWireCountSize (m_wireVersion, countSize, value.size ()) + value.size () * WIRE_ADDRESS_SIZE;
+    }
+
+    void U32List (std::vector<uint32_t> &value, uint32_t countSize)
+    {
+      m_size += GetWireCountSize (m_wireVersion, countSize, value.size ()) + value.size () * sizeof (uint32_t);
+    }
+
+    void StringList (std::vector<std::string> &value, uint32_t countSize)
+    {
+      m_size += GetWireCountSize (m_wireVersion, countSize, value.size ());
+      for (std::vector<std::string>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          m_size += GetWireStringSize (m_wireVersion, *it);
+        }
+    }
+
+    void StringSet (std::set<std::string> &value)
+    {
+      m_size += GetWireCountSize (m_wireVersion, sizeof (uint32_t), value.size ());
+      for (std::set<std::string>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          m_size += GetWireStringSize (m_wireVersion, *it);
+        }
+    }
+
+    // Views are receive-only, so only the owned set is ever sized
+    void StringSet (std::set<std::string> &value, StringViewList &views)
+    {
+      StringSet (value);
+    }
+
+  private:
+    uint8_t m_wireVersion;
+    uint32_t m_size;
+};
+
+class WireWriter
+{
+  public:
+    WireWriter (Buffer::Iterator &start, uint8_t wireVersion)
+      : m_start (start),
+        m_wireVersion (wireVersion)
+    {
+    }
+
+    void U8 (uint8_t &value) { m_start.WriteU8 (value); }
+    void U32 (uint32_t &value) { m_start.WriteHtonU32 (value); }
+    void U64 (uint64_t &value) { m_start.WriteHtonU64 (value); }
+    void Address (Ipv4Address &value) { m_start.WriteHtonU32 (value.Get ()); }
+    void Id (std::string &value) { WriteWireId (m_start, value); }
+
+    void String (std::string &value)
+    {
+      WriteWireString (m_start, m_wireVersion, value);
+    }
+
+    void Blob (std::string &value)
+    {
+      WriteWireCount (m_start, m_wireVersion, sizeof (uint32_t), value.size ());
+      m_start.Write ((const uint8_t *) value.data (), value.size ());
+    }
+
+    void IdList (std::vector<std::string> &value, uint32_t countSize)
+    {
+      WriteWireCount (m_start, m_wireVersion, countSize, value.size ());
+      for (std::vector<std::string>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          WriteWireId (m_start, *it);
+        }
+    }
+
+    void AddressList (std::vector<Ipv4Address> &value, uint32_t countSize)
+    {
+      WriteWireCount (m_start, m_wireVersion, countSize, value.size ());
+      for (std::vector<Ipv4Address>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          m_start.WriteHtonU32 ((*it).Get ());
+        }
+    }
+
+    void U32List (std::vector<uint32_t> &value, uint32_t countSize)
+    {
+      WriteWireCount (m_start, m_wireVersion, countSize, value.size ());
+      for (std::vector<uint32_t>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          m_start.WriteHtonU32 (*it);
+        }
+    }
+
+    void StringList (std::vector<std::string> &value, uint32_t countSize)
+    {
+      WriteWireCount (m_start, m_wireVersion, countSize, value.size ());
+      for (std::vector<std::string>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          WriteWireString (m_start, m_wireVersion, *it);
+        }
+    }
+
+    void StringSet (std::set<std::string> &value)
+    {
+      WriteWireCount (m_start, m_wireVersion, sizeof (uint32_t), value.size ());
+      for (std::set<std::string>::const_iterator it = value.begin (); it != value.end (); it++)
+        {
+          WriteWireString (m_start, m_wireVersion, *it);
+        }
+    }
+
+    void StringSet (std::set<std::string> &value, StringViewList &views)
+    {
+      StringSet (value);
+    }
+
+  private:
+    Buffer::Iterator &m_start;
+    uint8_t m_wireVersion;
+};
+
+class WireReader
+{
+  public:
+    /**
+     *  \param readViews read string sets as StringViews instead of owned strings
+     */
+    WireReader (Buffer::Iterator &start, uint8_t wireVersion, bool readViews)
+      : m_start (start),
+        m_wireVersion (wireVersion),
+        m_readViews (readViews),
+        m_size (0)
+    {
+    }
+
+    /**
+     *  \returns bytes consumed so far
+     */
+    uint32_t GetSize () const { return m_size; }
+
+    void U8 (uint8_t &value)
+    {
+      value = m_start.ReadU8 ();
+      m_size += sizeof (uint8_t);
+    }
+
+    void U32 (uint32_t &value)
+    {
+      value = m_start.ReadNtohU32 ();
+      m_size += sizeof (uint32_t);
+    }
+
+    void U64 (uint64_t &value)
+    {
+      value = m_start.ReadNtohU64 ();
+      m_size += sizeof (uint64_t);
+    }
+
+    void Address (Ipv4Address &value)
+    {
+      value = Ipv4Address (m_start.ReadNtohU32 ());
+      m_size += WIRE_ADDRESS_SIZE;
+    }
+
+    void Id (std::string &value)
+    {
+      m_size += ReadWireId (m_start, value);
+    }
+
+    void String (std::string &value)
+    {
+      m_size += ReadWireString (m_start, m_wireVersion, value);
+    }
+
+    void Blob (std::string &value)
+    {
+      uint32_t length;
+      m_size += ReadWireCount (m_start, m_wireVersion, sizeof (uint32_t), length);
+      value.resize (length);
+      if (length > 0)
+        {
+          m_start.Read ((uint8_t *) &value[0], length);
+        }
+      m_size += length;
+    }
+
+    void IdList (std::vector<std::string> &value, uint32_t countSize)
+    {
+      uint32_t count;
+      m_size += ReadWireCount (m_start, m_wireVersion, countSize, count);
+      value.resize (count);
+      for (uint32_t i = 0; i < count; i++)
+        {
+          m_size += ReadWireId (m_start, value[i]);
+        }
+    }
+
+    void AddressList (std::vector<Ipv4Address> &value, uint32_t countSize)
+    {
+      uint32_t count;
+      m_size += ReadWireCount (m_start, m_wireVersion, countSize, count);
+      value.reserve (count);
+      for (uint32_t i = 0; i < count; i++)
+        {
+          value.push_back (Ipv4Address (m_start.ReadNtohU32 ()));
+        }
+      m_size += count * WIRE_ADDRESS_SIZE;
+    }
+
+    void U32List (std::vector<uint32_t> &value, uint32_t countSize)
+    {
+      uint32_t count;
+      m_size += ReadWireCount (m_start, m_wireVersion, countSize, count);
+      value.resize (count);
+      for (uint32_t i = 0; i < count; i++)
+        {
+          value[i] = m_start.ReadNtohU32 ();
+        }
+      m_size += count * sizeof (uint32_t);
+    }
+
+    void StringList (std::vector<std::string> &value, uint32_t countSize)
+    {
+      uint32_t count;
+      m_size += ReadWireCount (m_start, m_wireVersion, countSize, count);
+      value.resize (count);
+      for (uint32_t i = 0; i < count; i++)
+        {
+          m_size += ReadWireString (m_start, m_wireVersion, value[i]);
+        }
+    }
+
+    void StringSet (std::set<std::string> &value)
+    {
+      uint32_t count;
+      m_size += ReadWireCount (m_start, m_wireVersion, sizeof (uint32_t), count);
+      ReadStrings (count, value);
+    }
+
+    void StringSet (std::set<std::string> &value, StringViewList &views)
+    {
+      uint32_t count;
+      m_size += ReadWireCount (m_start, m_wireVersion, sizeof (uint32_t), count);
+      if (m_readViews)
+        {
+          // views are laid out for u16 length prefixes
+          NS_ASSERT (m_wireVersion == WIRE_VERSION_1);
+          m_size += ReadWireStringViews (m_start, count, views);
+        }
+      else
+        {
+          ReadStrings (count, value);
+        }
+    }
+
+  private:
+    void ReadStrings (uint32_t count, std::set<std::string> &value)
+    {
+      std::string scratch;
+      for (uint32_t i = 0; i < count; i++)
+        {
+          m_size += ReadWireString (m_start, m_wireVersion, scratch);
+          // the sender writes sets in order, so each insert lands at the end
+          value.insert (value.end (), scratch);
+        }
+    }
+
+    Buffer::Iterator &m_start;
+    uint8_t m_wireVersion;
+    bool m_readViews;
+    uint32_t m_size;
+};
+
+template <typename Payload>
+uint32_t
+GetWirePayloadSize (const Payload &payload, uint8_t wireVersion)
+{
+  WireSizer sizer (wireVersion);
+  // the field list is shared with the reader, hence non-const
+  const_cast<Payload&> (payload).Fields (sizer);
+  return sizer.GetSize ();
+}
+
+template <typename Payload>
+void
+WriteWirePayload (Buffer::Iterator &start, const Payload &payload, uint8_t wireVersion)
+{
+  WireWriter writer (start, wireVersion);
+  const_cast<Payload&> (payload).Fields (writer);
+}
+
+template <typename Payload>
+uint32_t
+ReadWirePayload (Buffer::Iterator &start, Payload &payload, uint8_t wireVersion, bool readViews)
+{
+  WireReader reader (start, wireVersion, readViews);
+  payload.Fields (reader);
+  return reader.GetSize ();
+}
+
+/**
+ *  Routing fields of a relayed payload: its RouteFields list, which Fields
+ *  writes first, so a relay can read them without decoding the rest
+ */
+template <typename Payload>
+uint32_t
+GetWireRouteSize (const Payload &payload, uint8_t wireVersion)
+{
+  WireSizer sizer (wireVersion);
+  const_cast<Payload&> (payload).RouteFields (sizer);
+  return sizer.GetSize ();
+}
+
+template <typename Payload>
+void
+WriteWireRoute (Buffer::Iterator &start, const Payload &payload, uint8_t wireVersion)
+{
+  WireWriter writer (start, wireVersion);
+  const_cast<Payload&> (payload).RouteFields (writer);
+}
+
+template <typename Payload>
+uint32_t
+ReadWireRoute (Buffer::Iterator &start, Payload &payload, uint8_t wireVersion)
+{
+  WireReader reader (start, wireVersion, false);
+  payload.RouteFields (reader);
+  return reader.GetSize ();
+}
+
+/**
+ *  Codec methods of a payload struct, generated from its Fields list
+ */
+#define WIRE_CODEC_METHODS \
+    uint32_t GetSerializedSize (uint8_t wireVersion) const \
+    { \
+      return GetWirePayloadSize (*this, wireVersion); \
+    } \
+    void Serialize (Buffer::Iterator &start, uint8_t wireVersion) const \
+    { \
+      WriteWirePayload (start, *this, wireVersion); \
+    } \
+    uint32_t Deserialize (Buffer::Iterator &start, uint8_t wireVersion, bool readViews = false) \
+    { \
+      return ReadWirePayload (start, *this, wireVersion, readViews); \
+    }
+
+/**
+ *  Codec methods for the routing fields of a relayed payload struct
+ */
+#define WIRE_ROUTE_CODEC_METHODS \
+    uint32_t GetRouteSerializedSize (uint8_t wireVersion) const \
+    { \
+      return GetWireRouteSize (*this, wireVersion); \
+    } \
+    void SerializeRoute (Buffer::Iterator &start, uint8_t wireVersion) const \
+    { \
+      WriteWireRoute (start, *this, wireVersion); \
+    } \
+    uint32_t DeserializeRoute (Buffer::Iterator &start, uint8_t wireVersion) \
+    { \
+      return ReadWireRoute (start, *this, wireVersion); \
+    }
+
+#endif